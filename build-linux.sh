@@ -1 +1,4 @@
-clang -o bmp src/cl/*.c src/filters/*.c src/img/*.c src/misc/*.c src/test/main.c -Isrc/ -lpng -ljpeg -lcl -Wall
\ No newline at end of file
+# libnuma is optional, NYX_USE_LIBNUMA is only defined when <numa.h> is found
+NUMA_LIBS=""
+if echo '#include <numa.h>' | clang -E -x c - > /dev/null 2>&1; then NUMA_LIBS="-lnuma"; fi
+clang -o bmp src/cl/*.c src/filters/*.c src/img/*.c src/misc/*.c src/test/main.c -Isrc/ -lpng -lz -ljpeg -lcl -lpthread $NUMA_LIBS -Wall
\ No newline at end of file
@@ -1 +1 @@
-clang -o bmp src/cl/*.c src/filters/*.c src/img/*.c src/misc/*.c src/test/main.c -Isrc/ -lpng -ljpeg -framework OpenCL -Wall
\ No newline at end of file
+clang -o bmp src/cl/*.c src/filters/*.c src/img/*.c src/misc/*.c src/test/main.c -Isrc/ -lpng -lz -ljpeg -framework OpenCL -Wall
\ No newline at end of file
@@ -0,0 +1,194 @@
+#include "banded.h"
+#include <string.h>
+#include <stdatomic.h>
+
+
+/* Default amount of pixels in a band */
+#define NYX_BAND_DEFAULT_BYTES ((size_t)4 * 1024 * 1024)
+/* Default number of bands per worker, leaves room for stealing */
+#define NYX_BANDS_PER_WORKER 4
+
+/* Job of the parallel band drivers */
+typedef struct _nyx_band_job_struct
+{
+	const bitmap* bm_in;
+	bitmap* bm_out;
+	bm_filter_fptr filter;
+	bm_scale_rows_fptr scale_rows;
+	size_t band_height;
+	atomic_bool failed;
+} band_job;
+
+
+static size_t _nyx_band_height(const bitmap* bm, const size_t band_height);
+static size_t _nyx_band_height_parallel(const worker_pool* pool, const bitmap* bm, const size_t band_height);
+static bool _nyx_band_run(worker_pool* pool, band_job* job, const size_t height, worker_task_fptr task);
+static void _nyx_band_touch_task(void* ctx, const size_t task, const size_t worker);
+static void _nyx_band_filter_task(void* ctx, const size_t task, const size_t worker);
+static void _nyx_band_scale_task(void* ctx, const size_t task, const size_t worker);
+
+
+bool nyx_filter_banded(const bitmap* bm_in, bitmap* bm_out, bm_filter_fptr filter, const size_t band_height)
+{
+	if ((!bm_in) || (!bm_out) || (!filter))
+		return false;
+
+	if ((bm_in->width != bm_out->width) || (bm_in->height != bm_out->height))
+		return false;
+
+	// the bands are views, the whole output must stop sharing its buffer first
+	if (!nyx_bm_prepare_output(bm_in, bm_out))
+		return false;
+
+	const size_t rows = _nyx_band_height(bm_in, band_height);
+	bitmap band_in, band_out;
+	for (size_t y = 0; y < bm_in->height; y += rows)
+	{
+		const size_t h = NYX_MIN(rows, bm_in->height - y);
+		(void)nyx_bm_get_band(bm_in, y, h, &band_in);
+		(void)nyx_bm_get_band(bm_out, y, h, &band_out);
+		if (!filter(&band_in, &band_out))
+			return false;
+
+		// done with these rows
+		nyx_bm_evict_rows(bm_out, y, h);
+		if (bm_in->buffer != bm_out->buffer)
+			nyx_bm_evict_rows(bm_in, y, h);
+	}
+
+	return true;
+}
+
+bool nyx_scale_banded(const bitmap* bm_in, bitmap* bm_out, bm_scale_rows_fptr scale_rows, const size_t band_height)
+{
+	if ((!bm_in) || (!bm_out) || (!scale_rows))
+		return false;
+
+	if ((0 == bm_out->height) || (0 == bm_in->height))
+		return false;
+
+	if (!nyx_bm_prepare_output(bm_in, bm_out))
+		return false;
+
+	// bilinear maps output row y to input rows floor(y * (in_h - 1) / out_h) and the next one, nearest neighbor to floor(y * in_h / out_h),
+	// the same row or a later one, so input rows before the bilinear one are no longer needed by either
+	const float y_ratio = ((float)(bm_in->height - 1)) / bm_out->height;
+	const size_t rows = _nyx_band_height(bm_out, band_height);
+	size_t evicted = 0; // input rows before this one were evicted
+	for (size_t y = 0; y < bm_out->height; y += rows)
+	{
+		const size_t h = NYX_MIN(rows, bm_out->height - y);
+		if (!scale_rows(bm_in, bm_out, y, y + h))
+			return false;
+		nyx_bm_evict_rows(bm_out, y, h);
+
+		// keep one spare row against rounding
+		const size_t next_y = (size_t)(y_ratio * (y + h));
+		const size_t needed = (next_y > 0) ? (next_y - 1) : 0;
+		if (needed > evicted)
+		{
+			nyx_bm_evict_rows(bm_in, evicted, needed - evicted);
+			evicted = needed;
+		}
+	}
+	nyx_bm_evict_rows(bm_in, evicted, bm_in->height - evicted);
+
+	return true;
+}
+
+bool nyx_bm_first_touch(worker_pool* pool, bitmap* bm, const size_t band_height)
+{
+	if ((!pool) || (!bm))
+		return false;
+
+	if (!nyx_bm_prepare_overwrite(bm))
+		return false;
+
+	band_job job = (band_job){.bm_out = bm, .band_height = _nyx_band_height_parallel(pool, bm, band_height)};
+	return _nyx_band_run(pool, &job, bm->height, _nyx_band_touch_task);
+}
+
+bool nyx_filter_parallel(worker_pool* pool, const bitmap* bm_in, bitmap* bm_out, bm_filter_fptr filter, const size_t band_height)
+{
+	if ((!pool) || (!bm_in) || (!bm_out) || (!filter))
+		return false;
+
+	if ((bm_in->width != bm_out->width) || (bm_in->height != bm_out->height))
+		return false;
+
+	// the workers write through band views, the output must stop sharing its buffer before they start
+	if (!nyx_bm_prepare_output(bm_in, bm_out))
+		return false;
+
+	band_job job = (band_job){.bm_in = bm_in, .bm_out = bm_out, .filter = filter, .band_height = _nyx_band_height_parallel(pool, bm_out, band_height)};
+	return _nyx_band_run(pool, &job, bm_out->height, _nyx_band_filter_task);
+}
+
+bool nyx_scale_parallel(worker_pool* pool, const bitmap* bm_in, bitmap* bm_out, bm_scale_rows_fptr scale_rows, const size_t band_height)
+{
+	if ((!pool) || (!bm_in) || (!bm_out) || (!scale_rows))
+		return false;
+
+	if (!nyx_bm_prepare_output(bm_in, bm_out))
+		return false;
+
+	band_job job = (band_job){.bm_in = bm_in, .bm_out = bm_out, .scale_rows = scale_rows, .band_height = _nyx_band_height_parallel(pool, bm_out, band_height)};
+	return _nyx_band_run(pool, &job, bm_out->height, _nyx_band_scale_task);
+}
+
+/*** Private ***/
+static size_t _nyx_band_height(const bitmap* bm, const size_t band_height)
+{
+	if (band_height > 0)
+		return band_height;
+	return NYX_MAX((size_t)1, NYX_BAND_DEFAULT_BYTES / NYX_MAX((size_t)1, bm->stride));
+}
+
+static size_t _nyx_band_height_parallel(const worker_pool* pool, const bitmap* bm, const size_t band_height)
+{
+	if (band_height > 0)
+		return band_height;
+	const size_t num_bands = nyx_worker_pool_get_num_workers(pool) * NYX_BANDS_PER_WORKER;
+	return NYX_MAX((size_t)1, (bm->height + num_bands - 1) / num_bands);
+}
+
+static bool _nyx_band_run(worker_pool* pool, band_job* job, const size_t height, worker_task_fptr task)
+{
+	atomic_init(&job->failed, false);
+	const size_t num_bands = (height + job->band_height - 1) / job->band_height;
+	if (!nyx_worker_pool_run(pool, num_bands, task, job))
+		return false;
+	return !atomic_load(&job->failed);
+}
+
+static void _nyx_band_touch_task(void* ctx, const size_t task, const size_t worker)
+{
+#pragma unused(worker)
+	band_job* job = (band_job*)ctx;
+	const size_t y = task * job->band_height;
+	const size_t h = NYX_MIN(job->band_height, job->bm_out->height - y);
+	memset((uint8_t*)job->bm_out->buffer + (y * job->bm_out->stride), 0, h * job->bm_out->stride);
+}
+
+static void _nyx_band_filter_task(void* ctx, const size_t task, const size_t worker)
+{
+#pragma unused(worker)
+	band_job* job = (band_job*)ctx;
+	const size_t y = task * job->band_height;
+	const size_t h = NYX_MIN(job->band_height, job->bm_out->height - y);
+	bitmap band_in, band_out;
+	(void)nyx_bm_get_band(job->bm_in, y, h, &band_in);
+	(void)nyx_bm_get_band(job->bm_out, y, h, &band_out);
+	if (!job->filter(&band_in, &band_out))
+		atomic_store(&job->failed, true);
+}
+
+static void _nyx_band_scale_task(void* ctx, const size_t task, const size_t worker)
+{
+#pragma unused(worker)
+	band_job* job = (band_job*)ctx;
+	const size_t y = task * job->band_height;
+	const size_t h = NYX_MIN(job->band_height, job->bm_out->height - y);
+	if (!job->scale_rows(job->bm_in, job->bm_out, y, y + h))
+		atomic_store(&job->failed, true);
+}
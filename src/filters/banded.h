@@ -0,0 +1,67 @@
+#ifndef __NYX_BANDED_H__
+#define __NYX_BANDED_H__
+
+#include "img/bitmap.h"
+#include "misc/worker_pool.h"
+
+
+/* Filter of a whole bitmap, like nyx_filter_grayscale() */
+typedef bool (*bm_filter_fptr)(const bitmap* bm_in, bitmap* bm_out);
+
+/* Scaler of a range of output rows, like nyx_scale_bilinear_rows() */
+typedef bool (*bm_scale_rows_fptr)(const bitmap* bm_in, bitmap* bm_out, const size_t y_start, const size_t y_end);
+
+/**
+ * @brief Apply a pixel filter one band of rows at a time, each band is evicted once filtered so memory mapped bitmaps keep a bounded working set
+ * @param bm_in [in] : Original bitmap to filter, must not be NULL
+ * @param bm_out [out] : Filtered bitmap, must not be NULL, can be bm_in
+ * @param filter [in] : filter to apply to each band, must only read the pixels it writes
+ * @param band_height [in] : number of rows of a band, 0 for a few MB worth of rows
+ * @returns true if all OK
+ */
+bool nyx_filter_banded(const bitmap* bm_in, bitmap* bm_out, bm_filter_fptr filter, const size_t band_height);
+
+/**
+ * @brief Scale a bitmap one band of output rows at a time, input rows are evicted once no band needs them anymore
+ * @param bm_in [in] : Original bitmap to scale, must not be NULL
+ * @param bm_out [out] : Scaled bitmap, must not be NULL
+ * @param scale_rows [in] : scaler of a range of output rows
+ * @param band_height [in] : number of output rows of a band, 0 for a few MB worth of rows
+ * @returns true if all OK
+ */
+bool nyx_scale_banded(const bitmap* bm_in, bitmap* bm_out, bm_scale_rows_fptr scale_rows, const size_t band_height);
+
+/**
+ * @brief Zero a bitmap one band at a time from the workers which will own the same bands in nyx_filter_parallel() and nyx_scale_parallel(),
+ * so the kernel places each page on the node of its worker. Only effective on pages not touched yet, like the mapped buffers of large bitmaps
+ * @param pool [in] : workers
+ * @param bm [in/out] : bitmap
+ * @param band_height [in] : number of rows of a band, must be the one given to the processing, 0 for the default one
+ * @returns true if all OK
+ */
+bool nyx_bm_first_touch(worker_pool* pool, bitmap* bm, const size_t band_height);
+
+/**
+ * @brief Apply a pixel filter with a pool of workers, one band of rows per task, a band always goes to the same worker or one of the same node
+ * @param pool [in] : workers
+ * @param bm_in [in] : Original bitmap to filter, must not be NULL
+ * @param bm_out [out] : Filtered bitmap, must not be NULL, can be bm_in
+ * @param filter [in] : filter to apply to each band, must only read the pixels it writes
+ * @param band_height [in] : number of rows of a band, 0 for a few bands per worker
+ * @returns true if all OK
+ */
+bool nyx_filter_parallel(worker_pool* pool, const bitmap* bm_in, bitmap* bm_out, bm_filter_fptr filter, const size_t band_height);
+
+/**
+ * @brief Scale a bitmap with a pool of workers, one band of output rows per task, a band always goes to the same worker or one of the same node
+ * @param pool [in] : workers
+ * @param bm_in [in] : Original bitmap to scale, must not be NULL
+ * @param bm_out [out] : Scaled bitmap, must not be NULL
+ * @param scale_rows [in] : scaler of a range of output rows
+ * @param band_height [in] : number of output rows of a band, 0 for a few bands per worker
+ * @returns true if all OK
+ */
+bool nyx_scale_parallel(worker_pool* pool, const bitmap* bm_in, bitmap* bm_out, bm_scale_rows_fptr scale_rows, const size_t band_height);
+
+
+#endif /* __NYX_BANDED_H__ */
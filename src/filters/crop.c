@@ -1,4 +1,5 @@
 #include "crop.h"
+#include <string.h>
 
 
 bool nyx_crop(const bitmap* bm_in, const rect crop_rect, bitmap* bm_out)
@@ -18,13 +19,64 @@ bool nyx_crop(const bitmap* bm_in, const rect crop_rect, bitmap* bm_out)
 	if (!NYX_EQUAL_SIZES(tmp_s, crop_rect.size))
 		return false;
 	
-	int* in_ptr = (int*)bm_in->buffer, *out_ptr = (int*)bm_out->buffer;
+	if (bm_in->format != bm_out->format)
+		return false;
+
+	if (!nyx_bm_prepare_output(bm_in, bm_out))
+		return false;
+
+	// copy whole rows of the cropped rect
+	const size_t bpp = nyx_bytes_per_pixel_for_format(bm_in->format);
+	const size_t row_size = crop_rect.size.w * bpp;
+	const uint8_t* in_ptr = (const uint8_t*)bm_in->buffer + (crop_rect.origin.x * bpp);
+	uint8_t* out_ptr = (uint8_t*)bm_out->buffer;
 	for (size_t y = crop_rect.origin.y; y < yh; y++)
 	{
-		for (size_t x = crop_rect.origin.x; x < xw; x++)
+		memcpy(out_ptr, in_ptr + (y * bm_in->stride), row_size);
+		out_ptr += bm_out->stride;
+	}
+
+	return true;
+}
+
+bool nyx_crop_tiled(const tiled_bitmap* tbm_in, const rect crop_rect, tiled_bitmap* tbm_out)
+{
+	if ((!tbm_in) || (!tbm_out))
+		return false;
+
+	// Check if the cropped rect doesn't overflow from the original bitmap
+	if ((NYX_RECT_GET_MAX_X(crop_rect) > tbm_in->width) || (NYX_RECT_GET_MAX_Y(crop_rect) > tbm_in->height))
+		return false;
+
+	// If the cropped rect is not the same size as the out bitmap size, we have a problem
+	const size tmp_s = (size){.w = tbm_out->width, .h = tbm_out->height};
+	if ((!NYX_EQUAL_SIZES(tmp_s, crop_rect.size)) || (tbm_in->format != tbm_out->format))
+		return false;
+
+	// each row of an output tile comes from at most two input tiles
+	const size_t bpp = tbm_in->bpp;
+	for (size_t ty = 0; ty < tbm_out->tiles_y; ty++)
+	{
+		const size_t y0 = ty << NYX_TILE_SHIFT;
+		const size_t h = NYX_MIN(NYX_TILE_SIZE, tbm_out->height - y0);
+		for (size_t tx = 0; tx < tbm_out->tiles_x; tx++)
 		{
-			size_t index = x + y * width;
-			*out_ptr++ = in_ptr[index];
+			const size_t x0 = tx << NYX_TILE_SHIFT;
+			const size_t w = NYX_MIN(NYX_TILE_SIZE, tbm_out->width - x0);
+			uint8_t* out_ptr = NYX_TBM_GET_TILE(tbm_out, tx, ty);
+			for (size_t y = 0; y < h; y++)
+			{
+				const size_t sy = crop_rect.origin.y + y0 + y;
+				uint8_t* out_row = out_ptr + ((y << NYX_TILE_SHIFT) * bpp);
+				size_t x = 0;
+				while (x < w)
+				{
+					const size_t sx = crop_rect.origin.x + x0 + x;
+					const size_t run = NYX_MIN(NYX_TILE_SIZE - (sx & NYX_TILE_MASK), w - x);
+					memcpy(out_row + (x * bpp), NYX_TBM_GET_PIXEL(tbm_in, sx, sy), run * bpp);
+					x += run;
+				}
+			}
 		}
 	}
 
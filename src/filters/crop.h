@@ -2,16 +2,26 @@
 #define __NYX_CROP_H__
 
 #include "img/bitmap.h"
+#include "img/tiled_bitmap.h"
 
 
 /**
  * @brief Crop a bitmap
  * @param bm_in [in] : Original bitmap to crop, must not be NULL
  * @param crop_rect [in] : Zone to crop
- * @param bm_out [out] : Cropped bitmap, must not be NULL
+ * @param bm_out [out] : Cropped bitmap, must not be NULL, must have the same pixel format as bm_in
  * @returns true if all OK
  */
 bool nyx_crop(const bitmap* bm_in, const rect crop_rect, bitmap* bm_out);
 
+/**
+ * @brief Crop a tiled bitmap, one output tile at a time
+ * @param tbm_in [in] : Original tiled bitmap to crop, must not be NULL
+ * @param crop_rect [in] : Zone to crop
+ * @param tbm_out [out] : Cropped tiled bitmap, must not be NULL, must have the same pixel format as tbm_in
+ * @returns true if all OK
+ */
+bool nyx_crop_tiled(const tiled_bitmap* tbm_in, const rect crop_rect, tiled_bitmap* tbm_out);
+
 
 #endif /* __NYX_CROP_H__ */
@@ -1,6 +1,8 @@
 #include "filter_grayscale.h"
+#include "img/pixel_convert.h"
 #include "cl/cl_global.h"
 #include <math.h>
+#include <string.h>
 
 
 static const char* kernel_filter_grayscale1 = "\
@@ -112,6 +114,9 @@ __kernel void grayscale(__global int16* input, __global int16* output, const siz
 #pragma unused(kernel_filter_grayscale16)
 
 
+static bool _nyx_filter_grayscale_compact(const bitmap* bm_in, bitmap* bm_out);
+
+
 bool nyx_filter_grayscale(const bitmap* bm_in, bitmap* bm_out)
 {
 	if ((!bm_in) || (!bm_out))
@@ -119,19 +124,27 @@ bool nyx_filter_grayscale(const bitmap* bm_in, bitmap* bm_out)
 
 	const size_t width = bm_in->width;
 	const size_t height = bm_in->height;
-	if ((width != bm_out->width) && (height != bm_out->height))
+	if ((width != bm_out->width) || (height != bm_out->height))
+		return false;
+
+	if (!nyx_bm_prepare_output(bm_in, bm_out))
 		return false;
 
-	rgba_pixel* in_ptr = (rgba_pixel*)bm_in->buffer, *out_ptr = (rgba_pixel*)bm_out->buffer;
-	int lum;
+	if ((pixel_format_rgba32 != bm_in->format) || (pixel_format_rgba32 != bm_out->format))
+		return _nyx_filter_grayscale_compact(bm_in, bm_out);
+
+	// bm_in and bm_out can be the same bitmap, each pixel is fully loaded before being stored
+	const rgba_pixel* in_ptr = (const rgba_pixel*)bm_in->buffer;
+	rgba_pixel* out_ptr = (rgba_pixel*)bm_out->buffer;
 	for (size_t y = 0; y < height; y++)
 	{
 		for (size_t x = 0; x < width; x++)
 		{
-			lum = (int)((in_ptr->r * 0.2126f) + (in_ptr->g * 0.7152f) + (in_ptr->b * 0.0722f));
+			const rgba_pixel pixel = *in_ptr;
+			const uint8_t lum = NYX_PX_LUMA(pixel.r, pixel.g, pixel.b);
 
-			out_ptr->r = out_ptr->g = out_ptr->b = (uint8_t)NYX_SAFE_PIXEL_COMPONENT_VALUE(lum);
-			out_ptr->a = in_ptr->a;
+			out_ptr->r = out_ptr->g = out_ptr->b = lum;
+			out_ptr->a = pixel.a;
 
 			// next pixel
 			out_ptr++;
@@ -142,6 +155,41 @@ bool nyx_filter_grayscale(const bitmap* bm_in, bitmap* bm_out)
 	return true;
 }
 
+bool nyx_filter_grayscale_inplace(bitmap* bm)
+{
+	return nyx_filter_grayscale(bm, bm);
+}
+
+bool nyx_filter_grayscale_planar(const planar_bitmap* pbm_in, planar_bitmap* pbm_out)
+{
+	if ((!pbm_in) || (!pbm_out))
+		return false;
+
+	const size_t width = pbm_in->width;
+	const size_t height = pbm_in->height;
+	if ((width != pbm_out->width) || (height != pbm_out->height))
+		return false;
+
+	// one component per plane, no shuffling needed to vectorize the rows
+	for (size_t y = 0; y < height; y++)
+	{
+		const size_t in_offset = y * pbm_in->stride;
+		const size_t out_offset = y * pbm_out->stride;
+		const uint8_t* r = pbm_in->planes[plane_r] + in_offset;
+		const uint8_t* g = pbm_in->planes[plane_g] + in_offset;
+		const uint8_t* b = pbm_in->planes[plane_b] + in_offset;
+		uint8_t* out_r = pbm_out->planes[plane_r] + out_offset;
+		uint8_t* out_g = pbm_out->planes[plane_g] + out_offset;
+		uint8_t* out_b = pbm_out->planes[plane_b] + out_offset;
+		for (size_t x = 0; x < width; x++)
+			out_r[x] = out_g[x] = out_b[x] = NYX_PX_LUMA(r[x], g[x], b[x]);
+		if (pbm_in != pbm_out)
+			memcpy(pbm_out->planes[plane_a] + out_offset, pbm_in->planes[plane_a] + in_offset, width);
+	}
+
+	return true;
+}
+
 bool nyx_filter_grayscale_opencl(const bitmap* bm_in, bitmap* bm_out)
 {
 	if ((!bm_in) || (!bm_out))
@@ -149,7 +197,14 @@ bool nyx_filter_grayscale_opencl(const bitmap* bm_in, bitmap* bm_out)
 
 	const size_t width = bm_in->width;
 	const size_t height = bm_in->height;
-	if ((width != bm_out->width) && (height != bm_out->height))
+	if ((width != bm_out->width) || (height != bm_out->height))
+		return false;
+
+	// the kernels work on packed RGBA pixels
+	if ((pixel_format_rgba32 != bm_in->format) || (pixel_format_rgba32 != bm_out->format))
+		return false;
+
+	if (!nyx_bm_prepare_output(bm_in, bm_out))
 		return false;
 
 	const size_t bm_wh = width * height;
@@ -218,8 +273,17 @@ bool nyx_filter_grayscale_opencl(const bitmap* bm_in, bitmap* bm_out)
 	}
 
 	// create the input and output arrays in device memory for our calculation
-	input = clCreateBuffer(context, CL_MEM_READ_ONLY, bm_size, NULL, NULL);
-	output = clCreateBuffer(context, CL_MEM_WRITE_ONLY, bm_size, NULL, NULL);
+	// when filtering in place a single read-write buffer is enough, the kernel only touches its own pixel
+	if (bm_in->buffer == bm_out->buffer)
+	{
+		input = clCreateBuffer(context, CL_MEM_READ_WRITE, bm_size, NULL, NULL);
+		output = input;
+	}
+	else
+	{
+		input = clCreateBuffer(context, CL_MEM_READ_ONLY, bm_size, NULL, NULL);
+		output = clCreateBuffer(context, CL_MEM_WRITE_ONLY, bm_size, NULL, NULL);
+	}
 	if ((!input) || (!output))
 	{
 		NYX_ERRLOG("[!] Error: Failed to allocate device memory (%d)\n", err);
@@ -279,9 +343,66 @@ bool nyx_filter_grayscale_opencl(const bitmap* bm_in, bitmap* bm_out)
 out:
     // shutdown and cleanup
 	if (input) clReleaseMemObject(input);
-	if (output) clReleaseMemObject(output);
+	if ((output) && (output != input)) clReleaseMemObject(output);
 	if (program) clReleaseProgram(program);
 	if (kernel) clReleaseKernel(kernel);
 
 	return (CL_SUCCESS == err);
 }
+
+bool nyx_filter_grayscale_opencl_inplace(bitmap* bm)
+{
+	return nyx_filter_grayscale_opencl(bm, bm);
+}
+
+/*** Private ***/
+static bool _nyx_filter_grayscale_compact(const bitmap* bm_in, bitmap* bm_out)
+{
+	const size_t width = bm_in->width;
+	const size_t height = bm_in->height;
+	const uint8_t* in_ptr = (const uint8_t*)bm_in->buffer;
+	uint8_t* out_ptr = (uint8_t*)bm_out->buffer;
+
+	// any format to GRAY8, the conversion uses the same weights
+	if (pixel_format_gray8 == bm_out->format)
+	{
+		for (size_t y = 0; y < height; y++)
+			nyx_px_convert_row(in_ptr + (y * bm_in->stride), bm_in->format, out_ptr + (y * bm_out->stride), pixel_format_gray8, width);
+		return true;
+	}
+
+	if (bm_in->format != bm_out->format)
+		return false;
+
+	// GRAY8 is already gray
+	if (pixel_format_gray8 == bm_in->format)
+	{
+		if (in_ptr != out_ptr)
+		{
+			for (size_t y = 0; y < height; y++)
+				memcpy(out_ptr + (y * bm_out->stride), in_ptr + (y * bm_in->stride), width);
+		}
+		return true;
+	}
+
+	const size_t bpp = nyx_bytes_per_pixel_for_format(bm_in->format);
+	const size_t r_off = ((pixel_format_bgra32 == bm_in->format) || (pixel_format_bgr24 == bm_in->format)) ? 2 : 0;
+	const size_t b_off = 2 - r_off;
+	for (size_t y = 0; y < height; y++)
+	{
+		const uint8_t* in_row = in_ptr + (y * bm_in->stride);
+		uint8_t* out_row = out_ptr + (y * bm_out->stride);
+		for (size_t x = 0; x < width; x++)
+		{
+			// the alpha component, if any, is left untouched
+			const uint8_t lum = NYX_PX_LUMA(in_row[r_off], in_row[1], in_row[b_off]);
+			out_row[0] = out_row[1] = out_row[2] = lum;
+			if (4 == bpp)
+				out_row[3] = in_row[3];
+			in_row += bpp;
+			out_row += bpp;
+		}
+	}
+
+	return true;
+}
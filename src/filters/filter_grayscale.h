@@ -2,23 +2,46 @@
 #define __NYX_FILTERGRAYSCALE_H__
 
 #include "img/bitmap.h"
+#include "img/planar_bitmap.h"
 
 
 /**
  * @brief Apply a grayscale filter to a bitmap, both bitmap must have the same width and height
  * @param bm_in [in] : Original bitmap to filter, must not be NULL
- * @param bm_out [out] : Filtered bitmap, must not be NULL
+ * @param bm_out [out] : Filtered bitmap, must not be NULL, can be bm_in, must have the same pixel format as bm_in or be GRAY8
  * @returns true if all OK
  */
 bool nyx_filter_grayscale(const bitmap* bm_in, bitmap* bm_out);
 
 /**
- * @brief Apply a grayscale filter to a bitmap using OpenCL, both bitmap must have the same width and height
+ * @brief Apply a grayscale filter to a bitmap in place, no second bitmap is needed
+ * @param bm [in/out] : Bitmap to filter, must not be NULL
+ * @returns true if all OK
+ */
+bool nyx_filter_grayscale_inplace(bitmap* bm);
+
+/**
+ * @brief Apply a grayscale filter to a planar bitmap, both bitmap must have the same width and height
+ * @param pbm_in [in] : Original planar bitmap to filter, must not be NULL
+ * @param pbm_out [out] : Filtered planar bitmap, must not be NULL, can be pbm_in
+ * @returns true if all OK
+ */
+bool nyx_filter_grayscale_planar(const planar_bitmap* pbm_in, planar_bitmap* pbm_out);
+
+/**
+ * @brief Apply a grayscale filter to a bitmap using OpenCL, both bitmap must have the same width and height and be RGBA32
  * @param bm_in [in] : Original bitmap to filter, must not be NULL
- * @param bm_out [out] : Filtered bitmap, must not be NULL
+ * @param bm_out [out] : Filtered bitmap, must not be NULL, can be bm_in (only one device buffer is used then)
  * @returns true if all OK
  */
 bool nyx_filter_grayscale_opencl(const bitmap* bm_in, bitmap* bm_out);
 
+/**
+ * @brief Apply a grayscale filter to a bitmap in place using OpenCL
+ * @param bm [in/out] : Bitmap to filter, must not be NULL
+ * @returns true if all OK
+ */
+bool nyx_filter_grayscale_opencl_inplace(bitmap* bm);
+
 
 #endif /* __NYX_FILTERGRAYSCALE_H__ */
@@ -1,6 +1,7 @@
 #include "filter_sepia.h"
 #include "cl/cl_global.h"
 #include <math.h>
+#include <string.h>
 
 
 static const char* kernel_filter_sepia1 = "\
@@ -157,19 +158,27 @@ bool nyx_filter_sepia(const bitmap* bm_in, bitmap* bm_out)
 
 	const size_t width = bm_in->width;
 	const size_t height = bm_in->height;
-	if ((width != bm_out->width) && (height != bm_out->height))
+	if ((width != bm_out->width) || (height != bm_out->height))
+		return false;
+	if ((pixel_format_rgba32 != bm_in->format) || (pixel_format_rgba32 != bm_out->format))
+		return false;
+
+	if (!nyx_bm_prepare_output(bm_in, bm_out))
 		return false;
 
-	rgba_pixel* in_ptr = (rgba_pixel*)bm_in->buffer, *out_ptr = (rgba_pixel*)bm_out->buffer;
+	// bm_in and bm_out can be the same bitmap, each pixel is fully loaded before being stored
+	const rgba_pixel* in_ptr = (const rgba_pixel*)bm_in->buffer;
+	rgba_pixel* out_ptr = (rgba_pixel*)bm_out->buffer;
 	int newRed, newGreen, newBlue;
 	uint8_t r, g, b;
 	for (size_t y = 0; y < height; y++)
 	{
 		for (size_t x = 0; x < width; x++)
 		{
-			r = in_ptr->r;
-			g = in_ptr->g;
-			b = in_ptr->b;
+			const rgba_pixel pixel = *in_ptr;
+			r = pixel.r;
+			g = pixel.g;
+			b = pixel.b;
 			newRed = (int)((r * 0.393f) + (g * 0.769f) + (b * 0.189f));
 			newGreen = (int)((r * 0.349f) + (g * 0.686f) + (b * 0.168f));
 			newBlue = (int)((r * 0.272f) + (g * 0.534f) + (b * 0.131f));
@@ -177,7 +186,7 @@ bool nyx_filter_sepia(const bitmap* bm_in, bitmap* bm_out)
 			out_ptr->r = (uint8_t)NYX_SAFE_PIXEL_COMPONENT_VALUE(newRed);
 			out_ptr->g = (uint8_t)NYX_SAFE_PIXEL_COMPONENT_VALUE(newGreen);
 			out_ptr->b = (uint8_t)NYX_SAFE_PIXEL_COMPONENT_VALUE(newBlue);
-			out_ptr->a = in_ptr->a;
+			out_ptr->a = pixel.a;
 
 			// next pixel
 			out_ptr++;
@@ -205,6 +214,50 @@ bool nyx_filter_sepia(const bitmap* bm_in, bitmap* bm_out)
 	return true;
 }
 
+bool nyx_filter_sepia_inplace(bitmap* bm)
+{
+	return nyx_filter_sepia(bm, bm);
+}
+
+bool nyx_filter_sepia_planar(const planar_bitmap* pbm_in, planar_bitmap* pbm_out)
+{
+	if ((!pbm_in) || (!pbm_out))
+		return false;
+
+	const size_t width = pbm_in->width;
+	const size_t height = pbm_in->height;
+	if ((width != pbm_out->width) || (height != pbm_out->height))
+		return false;
+
+	// one component per plane, no shuffling needed to vectorize the rows
+	for (size_t y = 0; y < height; y++)
+	{
+		const size_t in_offset = y * pbm_in->stride;
+		const size_t out_offset = y * pbm_out->stride;
+		const uint8_t* r = pbm_in->planes[plane_r] + in_offset;
+		const uint8_t* g = pbm_in->planes[plane_g] + in_offset;
+		const uint8_t* b = pbm_in->planes[plane_b] + in_offset;
+		uint8_t* out_r = pbm_out->planes[plane_r] + out_offset;
+		uint8_t* out_g = pbm_out->planes[plane_g] + out_offset;
+		uint8_t* out_b = pbm_out->planes[plane_b] + out_offset;
+		for (size_t x = 0; x < width; x++)
+		{
+			// each component is loaded before any store, pbm_out can be pbm_in
+			const float red = r[x], green = g[x], blue = b[x];
+			const int newRed = (int)((red * 0.393f) + (green * 0.769f) + (blue * 0.189f));
+			const int newGreen = (int)((red * 0.349f) + (green * 0.686f) + (blue * 0.168f));
+			const int newBlue = (int)((red * 0.272f) + (green * 0.534f) + (blue * 0.131f));
+			out_r[x] = (uint8_t)NYX_SAFE_PIXEL_COMPONENT_VALUE(newRed);
+			out_g[x] = (uint8_t)NYX_SAFE_PIXEL_COMPONENT_VALUE(newGreen);
+			out_b[x] = (uint8_t)NYX_SAFE_PIXEL_COMPONENT_VALUE(newBlue);
+		}
+		if (pbm_in != pbm_out)
+			memcpy(pbm_out->planes[plane_a] + out_offset, pbm_in->planes[plane_a] + in_offset, width);
+	}
+
+	return true;
+}
+
 bool nyx_filter_sepia_opencl(const bitmap* bm_in, bitmap* bm_out)
 {
 	if ((!bm_in) || (!bm_out))
@@ -212,7 +265,12 @@ bool nyx_filter_sepia_opencl(const bitmap* bm_in, bitmap* bm_out)
 
 	const size_t width = bm_in->width;
 	const size_t height = bm_in->height;
-	if ((width != bm_out->width) && (height != bm_out->height))
+	if ((width != bm_out->width) || (height != bm_out->height))
+		return false;
+	if ((pixel_format_rgba32 != bm_in->format) || (pixel_format_rgba32 != bm_out->format))
+		return false;
+
+	if (!nyx_bm_prepare_output(bm_in, bm_out))
 		return false;
 
 	const size_t bm_wh = width * height;
@@ -281,8 +339,17 @@ bool nyx_filter_sepia_opencl(const bitmap* bm_in, bitmap* bm_out)
 	}
 
 	// create the input and output arrays in device memory for our calculation
-	input = clCreateBuffer(context, CL_MEM_READ_ONLY, bm_size, NULL, NULL);
-	output = clCreateBuffer(context, CL_MEM_WRITE_ONLY, bm_size, NULL, NULL);
+	// when filtering in place a single read-write buffer is enough, the kernel only touches its own pixel
+	if (bm_in->buffer == bm_out->buffer)
+	{
+		input = clCreateBuffer(context, CL_MEM_READ_WRITE, bm_size, NULL, NULL);
+		output = input;
+	}
+	else
+	{
+		input = clCreateBuffer(context, CL_MEM_READ_ONLY, bm_size, NULL, NULL);
+		output = clCreateBuffer(context, CL_MEM_WRITE_ONLY, bm_size, NULL, NULL);
+	}
 	if ((!input) || (!output))
 	{
 		NYX_ERRLOG("[!] Error: Failed to allocate device memory (%d)\n", err);
@@ -342,13 +409,18 @@ bool nyx_filter_sepia_opencl(const bitmap* bm_in, bitmap* bm_out)
 out:
     // shutdown and cleanup
 	if (input) clReleaseMemObject(input);
-	if (output) clReleaseMemObject(output);
+	if ((output) && (output != input)) clReleaseMemObject(output);
 	if (program) clReleaseProgram(program);
 	if (kernel) clReleaseKernel(kernel);
 
 	return (CL_SUCCESS == err);
 }
 
+bool nyx_filter_sepia_opencl_inplace(bitmap* bm)
+{
+	return nyx_filter_sepia_opencl(bm, bm);
+}
+
 bool nyx_filter_sepia_opencl2(const bitmap* bm_in, bitmap* bm_out)
 {
 	if ((!bm_in) || (!bm_out))
@@ -356,7 +428,12 @@ bool nyx_filter_sepia_opencl2(const bitmap* bm_in, bitmap* bm_out)
 
 	const size_t width = bm_in->width;
 	const size_t height = bm_in->height;
-	if ((width != bm_out->width) && (height != bm_out->height))
+	if ((width != bm_out->width) || (height != bm_out->height))
+		return false;
+	if ((pixel_format_rgba32 != bm_in->format) || (pixel_format_rgba32 != bm_out->format))
+		return false;
+
+	if (!nyx_bm_prepare_output(bm_in, bm_out))
 		return false;
 
 	cl_int err;
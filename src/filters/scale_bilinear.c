@@ -1,7 +1,21 @@
 #include "scale_bilinear.h"
 
 
+static bool _nyx_scale_bilinear_components(const bitmap* bm_in, bitmap* bm_out, const size_t bpp, const size_t y_start, const size_t y_end);
+
+
 bool nyx_scale_bilinear(const bitmap* bm_in, bitmap* bm_out)
+{
+	if ((!bm_in) || (!bm_out))
+		return false;
+
+	if (!nyx_bm_prepare_output(bm_in, bm_out))
+		return false;
+
+	return nyx_scale_bilinear_rows(bm_in, bm_out, 0, bm_out->height);
+}
+
+bool nyx_scale_bilinear_rows(const bitmap* bm_in, bitmap* bm_out, const size_t y_start, const size_t y_end)
 {
 	if ((!bm_in) || (!bm_out))
 		return false;
@@ -10,6 +24,14 @@ bool nyx_scale_bilinear(const bitmap* bm_in, bitmap* bm_out)
 	const size_t in_height = bm_in->height;
 	const size_t out_width = bm_out->width;
 	const size_t out_height = bm_out->height;
+	if ((bm_in->format != bm_out->format) || (y_start > y_end) || (y_end > out_height))
+		return false;
+
+	// 4 bytes pixels are interpolated packed, the components order doesn't matter
+	const size_t bpp = nyx_bytes_per_pixel_for_format(bm_in->format);
+	if (bpp != 4)
+		return _nyx_scale_bilinear_components(bm_in, bm_out, bpp, y_start, y_end);
+
 	int* in_ptr = (int*)bm_in->buffer;
 	int* out_ptr = (int*)bm_out->buffer;
 
@@ -18,8 +40,8 @@ bool nyx_scale_bilinear(const bitmap* bm_in, bitmap* bm_out)
 	const float y_ratio = ((float)(in_height - 1)) / out_height;
 	float x_diff, y_diff, xy_diff, mx_diff, my_diff;
 	int blue, red, green, alpha;
-	size_t offset = 0, index = 0, i, j;
-	for (size_t y = 0; y < out_height; y++)
+	size_t offset = y_start * out_width, index = 0, i, j;
+	for (size_t y = y_start; y < y_end; y++)
 	{
 		for (size_t x = 0; x < out_width; x++)
 		{
@@ -53,3 +75,84 @@ bool nyx_scale_bilinear(const bitmap* bm_in, bitmap* bm_out)
 
 	return true;
 }
+
+bool nyx_scale_bilinear_tiled(const tiled_bitmap* tbm_in, tiled_bitmap* tbm_out)
+{
+	if ((!tbm_in) || (!tbm_out))
+		return false;
+
+	if (tbm_in->format != tbm_out->format)
+		return false;
+
+	const size_t bpp = tbm_in->bpp;
+	const float x_ratio = ((float)(tbm_in->width - 1)) / tbm_out->width;
+	const float y_ratio = ((float)(tbm_in->height - 1)) / tbm_out->height;
+	// an output tile only reads a small area of the input, which stays in cache
+	for (size_t ty = 0; ty < tbm_out->tiles_y; ty++)
+	{
+		const size_t y0 = ty << NYX_TILE_SHIFT;
+		const size_t h = NYX_MIN(NYX_TILE_SIZE, tbm_out->height - y0);
+		for (size_t tx = 0; tx < tbm_out->tiles_x; tx++)
+		{
+			const size_t x0 = tx << NYX_TILE_SHIFT;
+			const size_t w = NYX_MIN(NYX_TILE_SIZE, tbm_out->width - x0);
+			uint8_t* out_ptr = NYX_TBM_GET_TILE(tbm_out, tx, ty);
+			for (size_t y = 0; y < h; y++)
+			{
+				const size_t j = (size_t)(y_ratio * (y0 + y));
+				const float y_diff = (y_ratio * (y0 + y)) - j;
+				uint8_t* out_row = out_ptr + ((y << NYX_TILE_SHIFT) * bpp);
+				for (size_t x = 0; x < w; x++)
+				{
+					// same formula as nyx_scale_bilinear(), the 4 neighbours can be in different tiles
+					const size_t i = (size_t)(x_ratio * (x0 + x));
+					const float x_diff = (x_ratio * (x0 + x)) - i;
+					const float wa = (1 - x_diff) * (1 - y_diff), wb = x_diff * (1 - y_diff), wc = y_diff * (1 - x_diff), wd = x_diff * y_diff;
+					const uint8_t* a = NYX_TBM_GET_PIXEL(tbm_in, i, j);
+					const uint8_t* b = NYX_TBM_GET_PIXEL(tbm_in, i + 1, j);
+					const uint8_t* c = NYX_TBM_GET_PIXEL(tbm_in, i, j + 1);
+					const uint8_t* d = NYX_TBM_GET_PIXEL(tbm_in, i + 1, j + 1);
+					for (size_t k = 0; k < bpp; k++)
+						*out_row++ = (uint8_t)(a[k] * wa + b[k] * wb + c[k] * wc + d[k] * wd);
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+/*** Private ***/
+static bool _nyx_scale_bilinear_components(const bitmap* bm_in, bitmap* bm_out, const size_t bpp, const size_t y_start, const size_t y_end)
+{
+	const size_t in_width = bm_in->width;
+	const size_t in_height = bm_in->height;
+	const size_t out_width = bm_out->width;
+	const size_t out_height = bm_out->height;
+	const uint8_t* in_ptr = (const uint8_t*)bm_in->buffer;
+	uint8_t* out_ptr = (uint8_t*)bm_out->buffer;
+
+	const float x_ratio = ((float)(in_width - 1)) / out_width;
+	const float y_ratio = ((float)(in_height - 1)) / out_height;
+	for (size_t y = y_start; y < y_end; y++)
+	{
+		const size_t j = (size_t)(y_ratio * y);
+		const float y_diff = (y_ratio * y) - j;
+		const uint8_t* row_a = in_ptr + (j * bm_in->stride);
+		const uint8_t* row_c = row_a + bm_in->stride;
+		uint8_t* out_row = out_ptr + (y * bm_out->stride);
+		for (size_t x = 0; x < out_width; x++)
+		{
+			// same formula as the packed version, applied to each of the bpp components
+			const size_t i = (size_t)(x_ratio * x);
+			const float x_diff = (x_ratio * x) - i;
+			const float wa = (1 - x_diff) * (1 - y_diff), wb = x_diff * (1 - y_diff), wc = y_diff * (1 - x_diff), wd = x_diff * y_diff;
+			const uint8_t* a = row_a + (i * bpp);
+			const uint8_t* c = row_c + (i * bpp);
+			for (size_t k = 0; k < bpp; k++)
+				*out_row++ = (uint8_t)(a[k] * wa + a[k + bpp] * wb + c[k] * wc + c[k + bpp] * wd);
+		}
+	}
+
+	return true;
+}
@@ -1,6 +1,7 @@
 #include "scale_nearestneighbor.h"
 #include "cl/cl_global.h"
 #include <math.h>
+#include <string.h>
 
 
 static const char* kernel_filter_scale_nearestneighbor = "\
@@ -18,6 +19,17 @@ __kernel void nearestneighbor(__read_only image2d_t input, __write_only image2d_
 
 
 bool nyx_scale_nearestneighbor(const bitmap* bm_in, bitmap* bm_out)
+{
+	if ((!bm_in) || (!bm_out))
+		return false;
+
+	if (!nyx_bm_prepare_output(bm_in, bm_out))
+		return false;
+
+	return nyx_scale_nearestneighbor_rows(bm_in, bm_out, 0, bm_out->height);
+}
+
+bool nyx_scale_nearestneighbor_rows(const bitmap* bm_in, bitmap* bm_out, const size_t y_start, const size_t y_end)
 {
 	if ((!bm_in) || (!bm_out))
 		return false;
@@ -26,19 +38,25 @@ bool nyx_scale_nearestneighbor(const bitmap* bm_in, bitmap* bm_out)
 	const size_t in_height = bm_in->height;
 	const size_t out_width = bm_out->width;
 	const size_t out_height = bm_out->height;
-	int* in_ptr = (int*)bm_in->buffer;
-	int* out_ptr = (int*)bm_out->buffer;
+	if ((bm_in->format != bm_out->format) || (y_start > y_end) || (y_end > out_height))
+		return false;
+
+	const size_t bpp = nyx_bytes_per_pixel_for_format(bm_in->format);
+	const uint8_t* in_ptr = (const uint8_t*)bm_in->buffer;
+	uint8_t* out_ptr = (uint8_t*)bm_out->buffer;
 
 	const float x_ratio = in_width / (float)out_width;
 	const float y_ratio = in_height / (float)out_height;
 	float px, py;
-	for (size_t y = 0; y < out_height; y++)
+	for (size_t y = y_start; y < y_end; y++)
 	{
+		py = floorf(y * y_ratio);
+		const uint8_t* in_row = in_ptr + ((size_t)py * bm_in->stride);
+		uint8_t* out_row = out_ptr + (y * bm_out->stride);
 		for (size_t x = 0; x < out_width; x++)
 		{
 			px = floorf(x * x_ratio);
-			py = floorf(y * y_ratio);
-			out_ptr[(y * out_width) + x] = in_ptr[(int)((py * in_width) + px)];
+			memcpy(out_row + (x * bpp), in_row + ((size_t)px * bpp), bpp);
 		}
 	}
 
@@ -56,6 +74,12 @@ bool nyx_scale_nearestneighbor_opencl(const bitmap* bm_in, bitmap* bm_out)
 	const size_t out_height = bm_out->height;
 	const float x_ratio = in_width / (float)out_width;
 	const float y_ratio = in_height / (float)out_height;
+	// the image is read as 4 x 8-bit channels, the components order doesn't matter
+	if ((bm_in->format != bm_out->format) || (nyx_bytes_per_pixel_for_format(bm_in->format) != 4))
+		return false;
+
+	if (!nyx_bm_prepare_output(bm_in, bm_out))
+		return false;
 
 	cl_int err;
 	cl_device_id device_id = nyx_cl_get_deviceid();
@@ -164,3 +188,41 @@ out:
 
 	return (CL_SUCCESS == err);
 }
+
+bool nyx_scale_nearestneighbor_tiled(const tiled_bitmap* tbm_in, tiled_bitmap* tbm_out)
+{
+	if ((!tbm_in) || (!tbm_out))
+		return false;
+
+	if (tbm_in->format != tbm_out->format)
+		return false;
+
+	const size_t bpp = tbm_in->bpp;
+	const float x_ratio = tbm_in->width / (float)tbm_out->width;
+	const float y_ratio = tbm_in->height / (float)tbm_out->height;
+	size_t src_x[NYX_TILE_SIZE];
+	// an output tile only reads a small area of the input, which stays in cache
+	for (size_t ty = 0; ty < tbm_out->tiles_y; ty++)
+	{
+		const size_t y0 = ty << NYX_TILE_SHIFT;
+		const size_t h = NYX_MIN(NYX_TILE_SIZE, tbm_out->height - y0);
+		for (size_t tx = 0; tx < tbm_out->tiles_x; tx++)
+		{
+			const size_t x0 = tx << NYX_TILE_SHIFT;
+			const size_t w = NYX_MIN(NYX_TILE_SIZE, tbm_out->width - x0);
+			for (size_t x = 0; x < w; x++)
+				src_x[x] = (size_t)floorf((x0 + x) * x_ratio);
+
+			uint8_t* out_ptr = NYX_TBM_GET_TILE(tbm_out, tx, ty);
+			for (size_t y = 0; y < h; y++)
+			{
+				const size_t py = (size_t)floorf((y0 + y) * y_ratio);
+				uint8_t* out_row = out_ptr + ((y << NYX_TILE_SHIFT) * bpp);
+				for (size_t x = 0; x < w; x++)
+					memcpy(out_row + (x * bpp), NYX_TBM_GET_PIXEL(tbm_in, src_x[x], py), bpp);
+			}
+		}
+	}
+
+	return true;
+}
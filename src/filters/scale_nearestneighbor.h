@@ -2,23 +2,42 @@
 #define __NYX_SCALENEARESTNEIGHBOR_H__
 
 #include "img/bitmap.h"
+#include "img/tiled_bitmap.h"
 
 
 /**
  * @brief Scale a bitmap using a a nearest neighbor algorithm
  * @param bm_in [in] : Original bitmap to scale, must not be NULL
- * @param bm_out [out] : Scaled bitmap, must not be NULL
+ * @param bm_out [out] : Scaled bitmap, must not be NULL, must have the same pixel format as bm_in
  * @returns true if all OK
  */
 bool nyx_scale_nearestneighbor(const bitmap* bm_in, bitmap* bm_out);
 
+/**
+ * @brief Same as nyx_scale_nearestneighbor(), but only compute a range of output rows, which only read the input rows they map to, bm_out must not be shared (see nyx_bm_prepare_output())
+ * @param bm_in [in] : Original bitmap to scale, must not be NULL
+ * @param bm_out [out] : Scaled bitmap, must not be NULL, must have the same pixel format as bm_in
+ * @param y_start [in] : first output row
+ * @param y_end [in] : output row after the last one
+ * @returns true if all OK
+ */
+bool nyx_scale_nearestneighbor_rows(const bitmap* bm_in, bitmap* bm_out, const size_t y_start, const size_t y_end);
+
 /**
  * @brief Scale a bitmap using a a nearest neighbor algorithm (OpenCL)
  * @param bm_in [in] : Original bitmap to scale, must not be NULL
- * @param bm_out [out] : Scaled bitmap, must not be NULL
+ * @param bm_out [out] : Scaled bitmap, must not be NULL, must have the same 32-bit pixel format as bm_in
  * @returns true if all OK
  */
 bool nyx_scale_nearestneighbor_opencl(const bitmap* bm_in, bitmap* bm_out);
 
+/**
+ * @brief Scale a tiled bitmap using a nearest neighbor algorithm, one output tile at a time
+ * @param tbm_in [in] : Original tiled bitmap to scale, must not be NULL
+ * @param tbm_out [out] : Scaled tiled bitmap, must not be NULL, must have the same pixel format as tbm_in
+ * @returns true if all OK
+ */
+bool nyx_scale_nearestneighbor_tiled(const tiled_bitmap* tbm_in, tiled_bitmap* tbm_out);
+
 
 #endif /* __NYX_SCALENEARESTNEIGHBOR_H__ */
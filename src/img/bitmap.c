@@ -1,102 +1,352 @@
 #include "bitmap.h"
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <stdatomic.h>
 #include "img_reader.h"
+#include "pixel_convert.h"
+#include "filters/scale_bilinear.h"
 
-#ifdef NYX_USE_ALIGNED_ALLOCATIONS
-#include "misc/utils.h"
-#define NYX_MEM_ALIGN 64
-#endif
+
+/* Pixel storage */
+struct _nyx_bm_storage_struct
+{
+	void* buffer;
+	size_t size;
+	const bm_allocator* allocator; // allocator which owns buffer
+	atomic_size_t refcount; // number of bitmaps using the storage
+};
+
+
+static bm_storage* _nyx_bm_storage_create(const bm_allocator* allocator, const size_t size);
+static void _nyx_bm_storage_release(bm_storage* storage);
+static bool _nyx_bm_unshare(bitmap* bm, const bool keep_pixels);
 
 
 /*** Bitmap memory management ***/
 bitmap* nyx_bm_alloc(const size_t width, const size_t height, const void* data)
 {
+	return nyx_bm_alloc_with_allocator(width, height, data, NULL);
+}
+
+bitmap* nyx_bm_alloc_with_allocator(const size_t width, const size_t height, const void* data, const bm_allocator* allocator)
+{
+	return nyx_bm_alloc_with_format(width, height, pixel_format_rgba32, data, allocator);
+}
+
+bitmap* nyx_bm_alloc_with_format(const size_t width, const size_t height, const pixel_format_t format, const void* data, const bm_allocator* allocator)
+{
+	const size_t bytes_per_pixel = nyx_bytes_per_pixel_for_format(format);
+	if (0 == bytes_per_pixel)
+		return NULL;
+
 	// alloc bitmap
 	bitmap* bm = (bitmap*)malloc(sizeof(bitmap));
 	if (!bm)
 		return NULL;
 
 	// alloc underlying buffer
-	const size_t stride = width * 4;
+	if (!allocator)
+		allocator = nyx_bm_allocator_get_current();
+	const size_t stride = width * bytes_per_pixel;
 	const size_t size = stride * height;
-#ifdef NYX_USE_ALIGNED_ALLOCATIONS
-    bm->buffer = nyx_aligned_malloc(size, NYX_MEM_ALIGN);
-#else
-	bm->buffer = calloc(size, sizeof(uint8_t));
-#endif
+	bm->storage = _nyx_bm_storage_create(allocator, size);
 	// if the alloc failed, useless to continue
-	if (!bm->buffer)
+	if (!bm->storage)
 	{
 		free(bm);
 		return NULL;
 	}
 
+	bm->buffer = bm->storage->buffer;
 	bm->width = width;
 	bm->height = height;
 	bm->stride = stride;
+	bm->format = format;
+	bm->allocator = allocator;
 	if (data)
 		memcpy(bm->buffer, data, size);
 	
 	return bm;
 }
 
+bitmap* nyx_bm_wrap_buffer(void* buffer, const size_t width, const size_t height, const size_t stride, const pixel_format_t format, const bm_allocator* allocator)
+{
+	// the filters see the pixels of a bitmap as contiguous rows
+	const size_t bytes_per_pixel = nyx_bytes_per_pixel_for_format(format);
+	if ((!buffer) || (!allocator) || (0 == bytes_per_pixel) || (stride != (width * bytes_per_pixel)))
+		return NULL;
+
+	bitmap* bm = (bitmap*)malloc(sizeof(bitmap));
+	if (!bm)
+		return NULL;
+
+	bm->storage = (bm_storage*)malloc(sizeof(bm_storage));
+	if (!bm->storage)
+	{
+		free(bm);
+		return NULL;
+	}
+	bm->storage->buffer = buffer;
+	bm->storage->size = stride * height;
+	bm->storage->allocator = allocator;
+	atomic_init(&bm->storage->refcount, 1);
+
+	bm->buffer = buffer;
+	bm->width = width;
+	bm->height = height;
+	bm->stride = stride;
+	bm->format = format;
+	bm->allocator = allocator;
+
+	return bm;
+}
+
 void nyx_bm_destroy(bitmap* bm)
 {
-	if (bm)
+	if ((bm) && (bm->storage))
 	{
-#ifdef NYX_USE_ALIGNED_ALLOCATIONS
-		nyx_aligned_free(bm->buffer);
-#else
-		free(bm->buffer);
-#endif
+		_nyx_bm_storage_release(bm->storage);
 		free(bm);
 	}
 }
 
 bitmap* nyx_bm_copy(const bitmap* src)
 {
-	bitmap* dst = nyx_bm_alloc(src->width, src->height, src->buffer);
+	if (!src)
+		return NULL;
+
+	// a band view doesn't own its rows, they can't be shared
+	if (!src->storage)
+		return nyx_bm_alloc_with_format(src->width, src->height, src->format, src->buffer, NULL);
+
+	bitmap* dst = (bitmap*)malloc(sizeof(bitmap));
+	if (!dst)
+		return NULL;
+
+	*dst = *src;
+	atomic_fetch_add_explicit(&src->storage->refcount, 1, memory_order_relaxed);
+
 	return dst;
 }
 
+bool nyx_bm_is_shared(const bitmap* bm)
+{
+	if ((!bm) || (!bm->storage))
+		return false;
+	return (atomic_load_explicit(&bm->storage->refcount, memory_order_acquire) > 1);
+}
+
+bool nyx_bm_prepare_write(bitmap* bm)
+{
+	return _nyx_bm_unshare(bm, true);
+}
+
+bool nyx_bm_prepare_overwrite(bitmap* bm)
+{
+	return _nyx_bm_unshare(bm, false);
+}
+
+bool nyx_bm_prepare_output(const bitmap* bm_in, bitmap* bm_out)
+{
+	// in place the output pixels are also the input ones, otherwise the input keeps the shared buffer
+	return (bm_in == bm_out) ? nyx_bm_prepare_write(bm_out) : nyx_bm_prepare_overwrite(bm_out);
+}
+
+bool nyx_bm_convert(const bitmap* bm_in, bitmap* bm_out)
+{
+	if ((!bm_in) || (!bm_out))
+		return false;
+
+	if ((bm_in->width != bm_out->width) || (bm_in->height != bm_out->height))
+		return false;
+
+	if (!nyx_bm_prepare_output(bm_in, bm_out))
+		return false;
+
+	for (size_t y = 0; y < bm_in->height; y++)
+	{
+		const uint8_t* in_row = (const uint8_t*)bm_in->buffer + (y * bm_in->stride);
+		uint8_t* out_row = (uint8_t*)bm_out->buffer + (y * bm_out->stride);
+		nyx_px_convert_row(in_row, bm_in->format, out_row, bm_out->format, bm_in->width);
+	}
+
+	return true;
+}
+
+/*** Bands ***/
+bool nyx_bm_get_band(const bitmap* bm, const size_t y, const size_t height, bitmap* out_band)
+{
+	if ((!bm) || (!out_band))
+		return false;
+
+	if ((y + height) > bm->height)
+		return false;
+
+	*out_band = *bm;
+	out_band->buffer = (uint8_t*)bm->buffer + (y * bm->stride);
+	out_band->height = height;
+	out_band->allocator = NULL;
+	out_band->storage = NULL;
+
+	return true;
+}
+
+void nyx_bm_evict_rows(const bitmap* bm, const size_t y, const size_t height)
+{
+	if ((!bm) || (!bm->allocator) || (!bm->allocator->evict_fptr))
+		return;
+
+	if ((0 == height) || ((y + height) > bm->height))
+		return;
+
+	// only evict the pages lying entirely in the band, the ones on its edges hold other rows
+	const uintptr_t page_size = (uintptr_t)sysconf(_SC_PAGESIZE);
+	const uintptr_t start = (uintptr_t)bm->buffer + (y * bm->stride);
+	const uintptr_t end = start + (height * bm->stride);
+	const uintptr_t page_start = (start + page_size - 1) & ~(page_size - 1);
+	const uintptr_t page_end = end & ~(page_size - 1);
+	if (page_end > page_start)
+		bm->allocator->evict_fptr(bm->allocator->ctx, (void*)page_start, (size_t)(page_end - page_start));
+}
+
 /*** Bitmap I/O ***/
 bitmap* nyx_bm_create_from_file(const char* filepath)
 {
-	// load image
-	uint8_t* buffer = NULL;
-	size_t width = 0, height = 0;
-	colorspace_t color_space = colorspace_unknown;
-	const bool ret = nyx_img_read_file(filepath, &buffer, &width, &height, &color_space);
+	// load image, decoders write directly into the bitmap buffer
+	bitmap* bm = NULL;
+	if (!nyx_img_read_file(filepath, NULL, &bm))
+		return NULL;
+
+	return bm;
+}
+
+bitmap* nyx_bm_create_from_file_at_least(const char* filepath, const size min_size)
+{
+	const img_read_options options = (img_read_options){.min_size = min_size};
+	bitmap* bm = NULL;
+	if (!nyx_img_read_file(filepath, &options, &bm))
+		return NULL;
+
+	return bm;
+}
+
+bitmap* nyx_bm_create_from_file_rect(const char* filepath, const rect crop_rect)
+{
+	if ((0 == crop_rect.size.w) || (0 == crop_rect.size.h))
+		return NULL;
+
+	const img_read_options options = (img_read_options){.roi = crop_rect};
+	bitmap* bm = NULL;
+	if (!nyx_img_read_file(filepath, &options, &bm))
+		return NULL;
+
+	return bm;
+}
+
+bitmap* nyx_bm_create_from_file_grayscale(const char* filepath)
+{
+	const img_read_options options = (img_read_options){.grayscale = true};
+	bitmap* bm = NULL;
+	if (!nyx_img_read_file(filepath, &options, &bm))
+		return NULL;
+
+	return bm;
+}
 
+bitmap* nyx_bm_create_from_file_with_format(const char* filepath, const pixel_format_t format)
+{
+	const img_read_options options = (img_read_options){.format = format};
 	bitmap* bm = NULL;
-	if ((ret) && (buffer != NULL) && (width > 0) && (height > 0) && (color_space != colorspace_unknown))
+	if (!nyx_img_read_file(filepath, &options, &bm))
+		return NULL;
+
+	return bm;
+}
+
+bitmap* nyx_bm_create_from_file_scaled(const char* filepath, const size target_size)
+{
+	if ((0 == target_size.w) || (0 == target_size.h))
+		return NULL;
+
+	bitmap* bm = nyx_bm_create_from_file_at_least(filepath, target_size);
+	if (!bm)
+		return NULL;
+
+	// the decoder may already have given the right size
+	const size bm_size = (size){.w = bm->width, .h = bm->height};
+	if (NYX_EQUAL_SIZES(bm_size, target_size))
+		return bm;
+
+	bitmap* scaled = nyx_bm_alloc_with_format(target_size.w, target_size.h, bm->format, NULL, NULL);
+	if ((!scaled) || (!nyx_scale_bilinear(bm, scaled)))
 	{
-		if (colorspace_rgba == color_space)
-		{
-			// Same colorspace
-			bm = nyx_bm_alloc(width, height, buffer);
-			//memcpy(bm->buffer, buffer, bm->stride * height);
-		}
-		else if (colorspace_rgb == color_space)
-		{
-			// bitmap struct only support RGBA so convert
-			rgba_pixel* pixels = (rgba_pixel*)malloc(sizeof(rgba_pixel) * width * height);
-			const size_t num_components = nyx_num_components_for_colorspace(color_space);
-			const size_t tmp_siz = (width * height * num_components);
-			for (size_t i = 0, ct = 0; i < tmp_siz; i += num_components, ++ct)
-			{
-				pixels[ct].r = buffer[i];
-				pixels[ct].g = buffer[i + 1];
-				pixels[ct].b = buffer[i + 2];
-				pixels[ct].a = NYX_MAX_PIXEL_COMPONENT_VALUE;
-			}
-			bm = nyx_bm_alloc(width, height, (void*)pixels);
-			//memcpy(bm->buffer, pixels, bm->stride * height);
-			free(pixels);
-		}
+		nyx_bm_destroy(scaled);
+		scaled = NULL;
 	}
-	free(buffer);
+	nyx_bm_destroy(bm);
 
-	return bm;
+	return scaled;
+}
+
+/*** Private ***/
+static bm_storage* _nyx_bm_storage_create(const bm_allocator* allocator, const size_t size)
+{
+	bm_storage* storage = (bm_storage*)malloc(sizeof(bm_storage));
+	if (!storage)
+		return NULL;
+
+	storage->buffer = allocator->alloc_fptr(allocator->ctx, size);
+	if (!storage->buffer)
+	{
+		free(storage);
+		return NULL;
+	}
+	storage->size = size;
+	storage->allocator = allocator;
+	atomic_init(&storage->refcount, 1);
+
+	return storage;
+}
+
+static void _nyx_bm_storage_release(bm_storage* storage)
+{
+	// the last release must see every write done through the other bitmaps
+	if (atomic_fetch_sub_explicit(&storage->refcount, 1, memory_order_acq_rel) != 1)
+		return;
+
+	storage->allocator->free_fptr(storage->allocator->ctx, storage->buffer, storage->size);
+	free(storage);
+}
+
+/**
+ * @brief Replace a shared storage by a private one
+ * @param bm [in] : bitmap
+ * @param keep_pixels [in] : copy the shared pixels into the new buffer
+ * @returns true if all OK, false if memory alloc failed
+ */
+static bool _nyx_bm_unshare(bitmap* bm, const bool keep_pixels)
+{
+	if (!bm)
+		return false;
+
+	// band views write straight into their bitmap, the owner unshares it before taking them
+	bm_storage* shared = bm->storage;
+	if ((!shared) || (atomic_load_explicit(&shared->refcount, memory_order_acquire) == 1))
+		return true;
+
+	bm_storage* storage = _nyx_bm_storage_create(shared->allocator, shared->size);
+	if (!storage)
+	{
+		NYX_ERRLOG("[!] failed to unshare a %zux%zu bitmap\n", bm->width, bm->height);
+		return false;
+	}
+	if (keep_pixels)
+		memcpy(storage->buffer, shared->buffer, shared->size);
+
+	bm->storage = storage;
+	bm->buffer = storage->buffer;
+	_nyx_bm_storage_release(shared);
+
+	return true;
 }
@@ -2,8 +2,12 @@
 #define __NYX_BITMAP_H__
 
 #include "misc/global.h"
+#include "bitmap_allocator.h"
 
 
+/* Reference counted pixel storage, shared by the copies of a bitmap */
+typedef struct _nyx_bm_storage_struct bm_storage;
+
 /* Bitmap */
 typedef struct _nyx_bitmap_struct
 {
@@ -11,12 +15,15 @@ typedef struct _nyx_bitmap_struct
 	size_t width;
 	size_t height;
 	size_t stride;
+	pixel_format_t format;
+	const bm_allocator* allocator; // allocator which owns buffer, NULL for a band view
+	bm_storage* storage; // storage of buffer, NULL for a band view
 } bitmap;
 
 /*** Bitmap memory management ***/
 
 /**
- * @brief Create a bitmap object
+ * @brief Create a RGBA32 bitmap object, its buffer comes from the current thread allocator
  * @param width [in] : bitmap width
  * @param height [in] : bitmap height
  * @param data [in] : {OPTIONAL} Pointer to bitmap data
@@ -25,18 +32,108 @@ typedef struct _nyx_bitmap_struct
 bitmap* nyx_bm_alloc(const size_t width, const size_t height, const void* data);
 
 /**
- * @brief free the bitmap and its buffer
+ * @brief Create a RGBA32 bitmap object whose buffer comes from a given allocator
+ * @param width [in] : bitmap width
+ * @param height [in] : bitmap height
+ * @param data [in] : {OPTIONAL} Pointer to bitmap data
+ * @param allocator [in] : allocator for the buffer, NULL for the current thread allocator
+ * @returns the bitmap, NULL if memory alloc failed
+ */
+bitmap* nyx_bm_alloc_with_allocator(const size_t width, const size_t height, const void* data, const bm_allocator* allocator);
+
+/**
+ * @brief Create a bitmap object with a given pixel format
+ * @param width [in] : bitmap width
+ * @param height [in] : bitmap height
+ * @param format [in] : pixel format
+ * @param data [in] : {OPTIONAL} Pointer to bitmap data, in format
+ * @param allocator [in] : allocator for the buffer, NULL for the current thread allocator
+ * @returns the bitmap, NULL if memory alloc failed
+ */
+bitmap* nyx_bm_alloc_with_format(const size_t width, const size_t height, const pixel_format_t format, const void* data, const bm_allocator* allocator);
+
+/**
+ * @brief Create a bitmap object around a buffer which already holds its pixels, the buffer is then freed with the last bitmap sharing it
+ * @param buffer [in] : height rows of stride bytes, must have been allocated by allocator
+ * @param width [in] : bitmap width
+ * @param height [in] : bitmap height
+ * @param stride [in] : bytes between two rows, must be width * bytes per pixel, rows can't be padded
+ * @param format [in] : pixel format
+ * @param allocator [in] : allocator which frees buffer, it also allocates the private copies of the bitmap
+ * @returns the bitmap, NULL if memory alloc failed or stride is invalid, buffer is then left to the caller
+ */
+bitmap* nyx_bm_wrap_buffer(void* buffer, const size_t width, const size_t height, const size_t stride, const pixel_format_t format, const bm_allocator* allocator);
+
+/**
+ * @brief free the bitmap, its buffer is freed with the last bitmap sharing it
  * @param bm [in] : bitmap object to destroy
  */
 void nyx_bm_destroy(bitmap* bm);
 
 /**
- * @brief Make a copy of a bitmap object
+ * @brief Make a copy of a bitmap object, the copy shares the buffer of src until one of them is written, band views are copied for real
  * @param src [in] : bitmap object to copy
  * @returns A copy of src, or NULL if there was a malloc error
  */
 bitmap* nyx_bm_copy(const bitmap* src);
 
+/**
+ * @brief Check if the buffer of a bitmap is shared with other copies
+ * @param bm [in] : bitmap
+ * @returns true if writing the buffer would change other bitmaps
+ */
+bool nyx_bm_is_shared(const bitmap* bm);
+
+/**
+ * @brief Give a bitmap its own buffer before modifying its pixels, the shared pixels are copied into it
+ * @param bm [in] : bitmap about to be written, band views are left untouched
+ * @returns true if all OK, false if memory alloc failed
+ */
+bool nyx_bm_prepare_write(bitmap* bm);
+
+/**
+ * @brief Give a bitmap its own buffer before replacing all its pixels, the shared pixels are not copied
+ * @param bm [in] : bitmap about to be overwritten, band views are left untouched
+ * @returns true if all OK, false if memory alloc failed
+ */
+bool nyx_bm_prepare_overwrite(bitmap* bm);
+
+/**
+ * @brief Prepare the output of a transformation, its pixels are copied only when the transformation works in place
+ * @param bm_in [in] : input of the transformation
+ * @param bm_out [out] : output of the transformation, about to be overwritten
+ * @returns true if all OK, false if memory alloc failed
+ */
+bool nyx_bm_prepare_output(const bitmap* bm_in, bitmap* bm_out);
+
+/**
+ * @brief Convert the pixels of a bitmap to the pixel format of another one, both bitmap must have the same width and height
+ * @param bm_in [in] : Original bitmap, must not be NULL
+ * @param bm_out [out] : Converted bitmap, must not be NULL
+ * @returns true if all OK
+ */
+bool nyx_bm_convert(const bitmap* bm_in, bitmap* bm_out);
+
+/*** Bands ***/
+
+/**
+ * @brief Get a view on a band of rows of a bitmap, no pixel is copied
+ * @param bm [in] : bitmap
+ * @param y [in] : first row of the band
+ * @param height [in] : number of rows, must fit in the bitmap
+ * @param out_band [out] : view on the rows, valid as long as bm is, must not be destroyed
+ * @returns true if all OK
+ */
+bool nyx_bm_get_band(const bitmap* bm, const size_t y, const size_t height, bitmap* out_band);
+
+/**
+ * @brief Tell the allocator of a bitmap that a band of rows is not needed for now, memory mapped storage writes them back and releases their pages
+ * @param bm [in] : bitmap
+ * @param y [in] : first row of the band
+ * @param height [in] : number of rows, must fit in the bitmap
+ */
+void nyx_bm_evict_rows(const bitmap* bm, const size_t y, const size_t height);
+
 /*** Bitmap I/O ***/
 
 /**
@@ -46,5 +143,44 @@ bitmap* nyx_bm_copy(const bitmap* src);
  */
 bitmap* nyx_bm_create_from_file(const char* filepath);
 
+/**
+ * @brief Create a bitmap object from a filepath, decoding at the smallest size which is at least min_size, JPEG are downscaled in the DCT domain
+ * @param filepath [in] : Path of the file
+ * @param min_size [in] : Minimum size of the bitmap, the aspect ratio is kept
+ * @returns the bitmap, NULL failed
+ */
+bitmap* nyx_bm_create_from_file_at_least(const char* filepath, const size min_size);
+
+/**
+ * @brief Create a bitmap object of a given size from a filepath, decodes with nyx_bm_create_from_file_at_least() then finishes with a bilinear scaling
+ * @param filepath [in] : Path of the file
+ * @param target_size [in] : Size of the bitmap
+ * @returns the bitmap, NULL failed
+ */
+bitmap* nyx_bm_create_from_file_scaled(const char* filepath, const size target_size);
+
+/**
+ * @brief Create a bitmap object from a region of a file, JPEG only decode the iMCU rows and columns covering it
+ * @param filepath [in] : Path of the file
+ * @param crop_rect [in] : Zone to decode, must fit in the image
+ * @returns the bitmap, NULL failed
+ */
+bitmap* nyx_bm_create_from_file_rect(const char* filepath, const rect crop_rect);
+
+/**
+ * @brief Create a grayscale bitmap object from a filepath, JPEG only decode their luma channel
+ * @param filepath [in] : Path of the file
+ * @returns the bitmap (R = G = B), NULL failed
+ */
+bitmap* nyx_bm_create_from_file_grayscale(const char* filepath);
+
+/**
+ * @brief Create a bitmap object with a given pixel format from a filepath, pixels are decoded straight to that format when possible
+ * @param filepath [in] : Path of the file
+ * @param format [in] : pixel format of the bitmap, GRAY8 JPEG only decode their luma channel
+ * @returns the bitmap, NULL failed
+ */
+bitmap* nyx_bm_create_from_file_with_format(const char* filepath, const pixel_format_t format);
+
 
 #endif /* __NYX_BITMAP_H__ */
@@ -0,0 +1,640 @@
+#include "bitmap_allocator.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "misc/utils.h"
+
+
+/* 4 size classes per power of two, enough to cover a 64-bit size */
+#define NYX_POOL_CLASSES_PER_POW2 4
+#define NYX_POOL_NUM_CLASSES ((64 * NYX_POOL_CLASSES_PER_POW2) + 1)
+/* Assumed page size when pre-faulting */
+#define NYX_PREFAULT_PAGE_SIZE 4096
+
+/* Size class pool */
+struct _nyx_bm_pool_struct
+{
+	bm_allocator allocator;
+	pthread_mutex_t lock;
+	void* free_lists[NYX_POOL_NUM_CLASSES]; // idle buffers, the next pointer is stored in the buffer itself
+	size_t max_cached_bytes;
+	size_t bytes_cached;
+	alloc_stats stats;
+};
+
+/* Linear arena */
+struct _nyx_bm_arena_struct
+{
+	bm_allocator allocator;
+	pthread_mutex_t lock;
+	uint8_t* block;
+	size_t capacity;
+	size_t offset; // next free byte in block
+	size_t touched; // bytes of block which were already handed out once
+	size_t num_live; // allocations in block not yet released
+	alloc_stats stats;
+};
+
+/* Memory mapped storage */
+struct _nyx_bm_mmap_struct
+{
+	bm_allocator allocator;
+	pthread_mutex_t lock;
+	char* scratch_dir; // NULL for anonymous mappings
+	alloc_stats stats;
+};
+
+static void* _nyx_default_alloc(void* ctx, const size_t size);
+static void _nyx_default_free(void* ctx, void* ptr, const size_t size);
+static void _nyx_default_stats(void* ctx, alloc_stats* out_stats);
+static void* _nyx_pool_alloc(void* ctx, const size_t size);
+static void _nyx_pool_free(void* ctx, void* ptr, const size_t size);
+static void _nyx_pool_stats(void* ctx, alloc_stats* out_stats);
+static size_t _nyx_pool_size_class(const size_t size, size_t* out_class_size);
+static size_t _nyx_pool_class_size(const size_t index);
+static void* _nyx_arena_alloc(void* ctx, const size_t size);
+static void _nyx_arena_free(void* ctx, void* ptr, const size_t size);
+static void _nyx_arena_stats(void* ctx, alloc_stats* out_stats);
+static void* _nyx_mmap_alloc(void* ctx, const size_t size);
+static void _nyx_mmap_free(void* ctx, void* ptr, const size_t size);
+static void _nyx_mmap_stats(void* ctx, alloc_stats* out_stats);
+static void _nyx_mmap_evict(void* ctx, void* ptr, const size_t size);
+static void _nyx_stats_add(alloc_stats* stats, const size_t in_use, const size_t reserved);
+static void _nyx_prefault(uint8_t* ptr, const size_t size);
+static void* _nyx_buffer_alloc(const size_t size, const bool prefault);
+static void _nyx_buffer_free(void* ptr, const size_t size);
+
+
+static pthread_mutex_t __default_lock = PTHREAD_MUTEX_INITIALIZER;
+static alloc_stats __default_stats = {0};
+static const bm_allocator __default_allocator = {
+	.alloc_fptr = _nyx_default_alloc,
+	.free_fptr = _nyx_default_free,
+	.stats_fptr = _nyx_default_stats,
+	.ctx = NULL,
+};
+static _Thread_local const bm_allocator* __current_allocator = NULL;
+
+
+/*** Allocator selection ***/
+const bm_allocator* nyx_bm_allocator_default(void)
+{
+	return &__default_allocator;
+}
+
+const bm_allocator* nyx_bm_allocator_get_current(void)
+{
+	return (__current_allocator != NULL) ? __current_allocator : &__default_allocator;
+}
+
+void nyx_bm_allocator_set_current(const bm_allocator* allocator)
+{
+	__current_allocator = allocator;
+}
+
+void nyx_bm_allocator_get_stats(const bm_allocator* allocator, alloc_stats* out_stats)
+{
+	if ((!allocator) || (!out_stats))
+		return;
+
+	memset(out_stats, 0, sizeof(alloc_stats));
+	if (allocator->stats_fptr)
+		allocator->stats_fptr(allocator->ctx, out_stats);
+}
+
+/*** Size class pool ***/
+bm_pool* nyx_bm_pool_create(const size_t max_cached_bytes)
+{
+	bm_pool* pool = (bm_pool*)calloc(1, sizeof(bm_pool));
+	if (!pool)
+		return NULL;
+
+	if (pthread_mutex_init(&pool->lock, NULL) != 0)
+	{
+		free(pool);
+		return NULL;
+	}
+	pool->max_cached_bytes = max_cached_bytes;
+	pool->allocator.alloc_fptr = _nyx_pool_alloc;
+	pool->allocator.free_fptr = _nyx_pool_free;
+	pool->allocator.stats_fptr = _nyx_pool_stats;
+	pool->allocator.ctx = pool;
+
+	return pool;
+}
+
+void nyx_bm_pool_destroy(bm_pool* pool)
+{
+	if (pool)
+	{
+		if (pool->stats.bytes_in_use > 0)
+			NYX_ERRLOG("[!] pool destroyed with %zu bytes still in use\n", pool->stats.bytes_in_use);
+		nyx_bm_pool_trim(pool);
+		pthread_mutex_destroy(&pool->lock);
+		free(pool);
+	}
+}
+
+const bm_allocator* nyx_bm_pool_get_allocator(bm_pool* pool)
+{
+	return (pool != NULL) ? &pool->allocator : NULL;
+}
+
+bool nyx_bm_pool_reserve(bm_pool* pool, const size_t size, const size_t count)
+{
+	if (!pool)
+		return false;
+
+	size_t class_size = 0;
+	const size_t index = _nyx_pool_size_class(size, &class_size);
+	for (size_t i = 0; i < count; i++)
+	{
+		uint8_t* ptr = (uint8_t*)_nyx_buffer_alloc(class_size, true);
+		if (!ptr)
+			return false;
+
+		pthread_mutex_lock(&pool->lock);
+		*(void**)ptr = pool->free_lists[index];
+		pool->free_lists[index] = ptr;
+		pool->bytes_cached += class_size;
+		_nyx_stats_add(&pool->stats, 0, class_size);
+		pthread_mutex_unlock(&pool->lock);
+	}
+
+	return true;
+}
+
+void nyx_bm_pool_trim(bm_pool* pool)
+{
+	if (!pool)
+		return;
+
+	pthread_mutex_lock(&pool->lock);
+	for (size_t i = 0; i < NYX_POOL_NUM_CLASSES; i++)
+	{
+		const size_t class_size = _nyx_pool_class_size(i);
+		void* ptr = pool->free_lists[i];
+		while (ptr != NULL)
+		{
+			void* next = *(void**)ptr;
+			_nyx_buffer_free(ptr, class_size);
+			ptr = next;
+		}
+		pool->free_lists[i] = NULL;
+	}
+	pool->stats.bytes_reserved -= pool->bytes_cached;
+	pool->bytes_cached = 0;
+	pthread_mutex_unlock(&pool->lock);
+}
+
+/*** Arena ***/
+bm_arena* nyx_bm_arena_create(const size_t capacity, const bool prefault)
+{
+	bm_arena* arena = (bm_arena*)calloc(1, sizeof(bm_arena));
+	if (!arena)
+		return NULL;
+
+	arena->block = (uint8_t*)_nyx_buffer_alloc(capacity, prefault);
+	if ((!arena->block) || (pthread_mutex_init(&arena->lock, NULL) != 0))
+	{
+		_nyx_buffer_free(arena->block, capacity);
+		free(arena);
+		return NULL;
+	}
+	arena->capacity = capacity;
+	if (prefault)
+		arena->touched = capacity;
+	_nyx_stats_add(&arena->stats, 0, capacity);
+	arena->allocator.alloc_fptr = _nyx_arena_alloc;
+	arena->allocator.free_fptr = _nyx_arena_free;
+	arena->allocator.stats_fptr = _nyx_arena_stats;
+	arena->allocator.ctx = arena;
+
+	return arena;
+}
+
+void nyx_bm_arena_destroy(bm_arena* arena)
+{
+	if (arena)
+	{
+		if (arena->stats.bytes_in_use > 0)
+			NYX_ERRLOG("[!] arena destroyed with %zu bytes still in use\n", arena->stats.bytes_in_use);
+		pthread_mutex_destroy(&arena->lock);
+		_nyx_buffer_free(arena->block, arena->capacity);
+		free(arena);
+	}
+}
+
+const bm_allocator* nyx_bm_arena_get_allocator(bm_arena* arena)
+{
+	return (arena != NULL) ? &arena->allocator : NULL;
+}
+
+bool nyx_bm_arena_reset(bm_arena* arena)
+{
+	if (!arena)
+		return false;
+
+	// a buffer released after the rewind couldn't be told apart from the next job's ones at the same address
+	pthread_mutex_lock(&arena->lock);
+	const size_t num_live = arena->num_live;
+	if (0 == num_live)
+		arena->offset = 0;
+	pthread_mutex_unlock(&arena->lock);
+	if (num_live > 0)
+	{
+		NYX_ERRLOG("[!] arena not reset, %zu allocations still live\n", num_live);
+		return false;
+	}
+
+	return true;
+}
+
+/*** Memory mapped storage ***/
+bm_mmap* nyx_bm_mmap_create(const char* scratch_dir)
+{
+	bm_mmap* mm = (bm_mmap*)calloc(1, sizeof(bm_mmap));
+	if (!mm)
+		return NULL;
+
+	if (scratch_dir)
+		mm->scratch_dir = strdup(scratch_dir);
+	if (((scratch_dir) && (!mm->scratch_dir)) || (pthread_mutex_init(&mm->lock, NULL) != 0))
+	{
+		free(mm->scratch_dir);
+		free(mm);
+		return NULL;
+	}
+	mm->allocator.alloc_fptr = _nyx_mmap_alloc;
+	mm->allocator.free_fptr = _nyx_mmap_free;
+	mm->allocator.stats_fptr = _nyx_mmap_stats;
+	mm->allocator.evict_fptr = (scratch_dir) ? _nyx_mmap_evict : NULL;
+	mm->allocator.ctx = mm;
+
+	return mm;
+}
+
+void nyx_bm_mmap_destroy(bm_mmap* mm)
+{
+	if (mm)
+	{
+		if (mm->stats.bytes_in_use > 0)
+			NYX_ERRLOG("[!] mapped storage destroyed with %zu bytes still in use\n", mm->stats.bytes_in_use);
+		pthread_mutex_destroy(&mm->lock);
+		free(mm->scratch_dir);
+		free(mm);
+	}
+}
+
+const bm_allocator* nyx_bm_mmap_get_allocator(bm_mmap* mm)
+{
+	return (mm != NULL) ? &mm->allocator : NULL;
+}
+
+/*** Private ***/
+static void* _nyx_default_alloc(void* ctx, const size_t size)
+{
+#pragma unused(ctx)
+#ifdef NYX_USE_ALIGNED_ALLOCATIONS
+	void* ptr = _nyx_buffer_alloc(size, false);
+#else
+	void* ptr = (size >= NYX_HUGE_PAGES_THRESHOLD) ? _nyx_buffer_alloc(size, false) : calloc(size, sizeof(uint8_t));
+#endif
+	if (ptr)
+	{
+		pthread_mutex_lock(&__default_lock);
+		_nyx_stats_add(&__default_stats, size, size);
+		pthread_mutex_unlock(&__default_lock);
+	}
+	return ptr;
+}
+
+static void _nyx_default_free(void* ctx, void* ptr, const size_t size)
+{
+#pragma unused(ctx)
+	if (!ptr)
+		return;
+
+#ifdef NYX_USE_ALIGNED_ALLOCATIONS
+	_nyx_buffer_free(ptr, size);
+#else
+	if (size >= NYX_HUGE_PAGES_THRESHOLD)
+		_nyx_buffer_free(ptr, size);
+	else
+		free(ptr);
+#endif
+	pthread_mutex_lock(&__default_lock);
+	__default_stats.num_frees++;
+	__default_stats.bytes_in_use -= size;
+	__default_stats.bytes_reserved -= size;
+	pthread_mutex_unlock(&__default_lock);
+}
+
+static void _nyx_default_stats(void* ctx, alloc_stats* out_stats)
+{
+#pragma unused(ctx)
+	pthread_mutex_lock(&__default_lock);
+	*out_stats = __default_stats;
+	pthread_mutex_unlock(&__default_lock);
+}
+
+static void* _nyx_pool_alloc(void* ctx, const size_t size)
+{
+	bm_pool* pool = (bm_pool*)ctx;
+	size_t class_size = 0;
+	const size_t index = _nyx_pool_size_class(size, &class_size);
+
+	// reuse an idle buffer of the same class if possible
+	pthread_mutex_lock(&pool->lock);
+	void* ptr = pool->free_lists[index];
+	if (ptr != NULL)
+	{
+		pool->free_lists[index] = *(void**)ptr;
+		pool->bytes_cached -= class_size;
+		pool->stats.num_reused++;
+		_nyx_stats_add(&pool->stats, class_size, 0);
+		pthread_mutex_unlock(&pool->lock);
+		return ptr;
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	ptr = _nyx_buffer_alloc(class_size, false);
+	if (ptr)
+	{
+		pthread_mutex_lock(&pool->lock);
+		_nyx_stats_add(&pool->stats, class_size, class_size);
+		pthread_mutex_unlock(&pool->lock);
+	}
+	return ptr;
+}
+
+static void _nyx_pool_free(void* ctx, void* ptr, const size_t size)
+{
+	if (!ptr)
+		return;
+
+	bm_pool* pool = (bm_pool*)ctx;
+	size_t class_size = 0;
+	const size_t index = _nyx_pool_size_class(size, &class_size);
+
+	pthread_mutex_lock(&pool->lock);
+	pool->stats.num_frees++;
+	pool->stats.bytes_in_use -= class_size;
+	if ((0 == pool->max_cached_bytes) || ((pool->bytes_cached + class_size) <= pool->max_cached_bytes))
+	{
+		// keep it warm for the next allocation of this class
+		*(void**)ptr = pool->free_lists[index];
+		pool->free_lists[index] = ptr;
+		pool->bytes_cached += class_size;
+		ptr = NULL;
+	}
+	else
+		pool->stats.bytes_reserved -= class_size;
+	pthread_mutex_unlock(&pool->lock);
+
+	_nyx_buffer_free(ptr, class_size);
+}
+
+static void _nyx_pool_stats(void* ctx, alloc_stats* out_stats)
+{
+	bm_pool* pool = (bm_pool*)ctx;
+	pthread_mutex_lock(&pool->lock);
+	*out_stats = pool->stats;
+	pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * @brief Get the size class of an allocation, classes are 2^n, 1.25 * 2^n, 1.5 * 2^n and 1.75 * 2^n
+ * @param size [in] : Requested size
+ * @param out_class_size [out] : Size of the class, >= size
+ * @returns index of the class
+ */
+static size_t _nyx_pool_size_class(const size_t size, size_t* out_class_size)
+{
+	if (size <= NYX_BM_MEM_ALIGN)
+	{
+		*out_class_size = NYX_BM_MEM_ALIGN;
+		return 0;
+	}
+
+	size_t msb = 0;
+	const size_t n = size - 1;
+	while ((n >> (msb + 1)) != 0)
+		msb++;
+	const size_t base = (size_t)1 << msb;
+	const size_t step = base / NYX_POOL_CLASSES_PER_POW2;
+	const size_t quarter = ((n - base) / step) + 1;
+	*out_class_size = base + (quarter * step);
+	return (msb * NYX_POOL_CLASSES_PER_POW2) + quarter;
+}
+
+/**
+ * @brief Get the size of a class, inverse of _nyx_pool_size_class()
+ * @param index [in] : index of the class
+ * @returns Size of the class
+ */
+static size_t _nyx_pool_class_size(const size_t index)
+{
+	if (0 == index)
+		return NYX_BM_MEM_ALIGN;
+
+	const size_t msb = (index - 1) / NYX_POOL_CLASSES_PER_POW2;
+	const size_t quarter = index - (msb * NYX_POOL_CLASSES_PER_POW2);
+	const size_t base = (size_t)1 << msb;
+	return base + (quarter * (base / NYX_POOL_CLASSES_PER_POW2));
+}
+
+static void* _nyx_arena_alloc(void* ctx, const size_t size)
+{
+	bm_arena* arena = (bm_arena*)ctx;
+	const size_t aligned_size = (size + (NYX_BM_MEM_ALIGN - 1)) & ~((size_t)NYX_BM_MEM_ALIGN - 1);
+
+	pthread_mutex_lock(&arena->lock);
+	if (aligned_size <= (arena->capacity - arena->offset))
+	{
+		uint8_t* ptr = arena->block + arena->offset;
+		arena->offset += aligned_size;
+		arena->num_live++;
+		if (arena->offset <= arena->touched)
+			arena->stats.num_reused++;
+		else
+			arena->touched = arena->offset;
+		_nyx_stats_add(&arena->stats, aligned_size, 0);
+		pthread_mutex_unlock(&arena->lock);
+		return ptr;
+	}
+	pthread_mutex_unlock(&arena->lock);
+
+	// doesn't fit, overflow to the heap
+	void* ptr = _nyx_buffer_alloc(aligned_size, false);
+	if (ptr)
+	{
+		pthread_mutex_lock(&arena->lock);
+		_nyx_stats_add(&arena->stats, aligned_size, aligned_size);
+		pthread_mutex_unlock(&arena->lock);
+	}
+	return ptr;
+}
+
+static void _nyx_arena_free(void* ctx, void* ptr, const size_t size)
+{
+	if (!ptr)
+		return;
+
+	bm_arena* arena = (bm_arena*)ctx;
+	const size_t aligned_size = (size + (NYX_BM_MEM_ALIGN - 1)) & ~((size_t)NYX_BM_MEM_ALIGN - 1);
+	uint8_t* p = (uint8_t*)ptr;
+
+	pthread_mutex_lock(&arena->lock);
+	arena->stats.num_frees++;
+	arena->stats.bytes_in_use -= aligned_size;
+	if ((p >= arena->block) && (p < (arena->block + arena->capacity)))
+	{
+		if (arena->num_live > 0)
+			arena->num_live--;
+		if (0 == arena->num_live)
+			arena->offset = 0; // everything was released, rewind
+		else if ((p + aligned_size) == (arena->block + arena->offset))
+			arena->offset -= aligned_size; // last allocation, pop it
+		p = NULL;
+	}
+	else
+		arena->stats.bytes_reserved -= aligned_size;
+	pthread_mutex_unlock(&arena->lock);
+
+	_nyx_buffer_free(p, aligned_size);
+}
+
+static void _nyx_arena_stats(void* ctx, alloc_stats* out_stats)
+{
+	bm_arena* arena = (bm_arena*)ctx;
+	pthread_mutex_lock(&arena->lock);
+	*out_stats = arena->stats;
+	pthread_mutex_unlock(&arena->lock);
+}
+
+static void* _nyx_mmap_alloc(void* ctx, const size_t size)
+{
+	bm_mmap* mm = (bm_mmap*)ctx;
+	if (0 == size)
+		return NULL;
+
+	void* ptr = MAP_FAILED;
+	if (!mm->scratch_dir)
+	{
+		int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_NORESERVE
+		flags |= MAP_NORESERVE;
+#endif
+		ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+	}
+	else
+	{
+		// the file is unlinked right away, its blocks go away with the last mapping
+		const size_t len = strlen(mm->scratch_dir) + sizeof("/nyx-XXXXXX");
+		char* path = (char*)malloc(len);
+		if (!path)
+			return NULL;
+		snprintf(path, len, "%s/nyx-XXXXXX", mm->scratch_dir);
+		const int fd = mkstemp(path);
+		if (fd < 0)
+		{
+			NYX_ERRLOG("[!] failed to create scratch file in %s\n", mm->scratch_dir);
+			free(path);
+			return NULL;
+		}
+		unlink(path);
+		free(path);
+		if (0 == ftruncate(fd, (off_t)size))
+			ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+	}
+	if (MAP_FAILED == ptr)
+	{
+		NYX_ERRLOG("[!] failed to map %zu bytes\n", size);
+		return NULL;
+	}
+
+	pthread_mutex_lock(&mm->lock);
+	_nyx_stats_add(&mm->stats, size, size);
+	pthread_mutex_unlock(&mm->lock);
+	return ptr;
+}
+
+static void _nyx_mmap_free(void* ctx, void* ptr, const size_t size)
+{
+	if (!ptr)
+		return;
+
+	bm_mmap* mm = (bm_mmap*)ctx;
+	munmap(ptr, size);
+	pthread_mutex_lock(&mm->lock);
+	mm->stats.num_frees++;
+	mm->stats.bytes_in_use -= size;
+	mm->stats.bytes_reserved -= size;
+	pthread_mutex_unlock(&mm->lock);
+}
+
+static void _nyx_mmap_stats(void* ctx, alloc_stats* out_stats)
+{
+	bm_mmap* mm = (bm_mmap*)ctx;
+	pthread_mutex_lock(&mm->lock);
+	*out_stats = mm->stats;
+	pthread_mutex_unlock(&mm->lock);
+}
+
+static void _nyx_mmap_evict(void* ctx, void* ptr, const size_t size)
+{
+#pragma unused(ctx)
+	// write the dirty pages back to the scratch file, then unmap them, they are read back on the next access
+	if (0 == msync(ptr, size, MS_SYNC))
+		madvise(ptr, size, MADV_DONTNEED);
+}
+
+static void _nyx_stats_add(alloc_stats* stats, const size_t in_use, const size_t reserved)
+{
+	if (in_use > 0)
+	{
+		stats->num_allocs++;
+		stats->bytes_in_use += in_use;
+		stats->bytes_high_water = NYX_MAX(stats->bytes_high_water, stats->bytes_in_use);
+	}
+	stats->bytes_reserved += reserved;
+	stats->bytes_reserved_high_water = NYX_MAX(stats->bytes_reserved_high_water, stats->bytes_reserved);
+}
+
+static void _nyx_prefault(uint8_t* ptr, const size_t size)
+{
+	// write one byte per page so the kernel maps them now
+	for (size_t i = 0; i < size; i += NYX_PREFAULT_PAGE_SIZE)
+		ptr[i] = 0;
+}
+
+static void* _nyx_buffer_alloc(const size_t size, const bool prefault)
+{
+#ifdef NYX_USE_HUGE_PAGES
+	// large buffers get their own mapping, backed by huge pages when possible
+	if (size >= NYX_HUGE_PAGES_THRESHOLD)
+		return nyx_page_alloc(size, prefault, NULL);
+#endif
+	uint8_t* ptr = (uint8_t*)nyx_aligned_malloc(size, NYX_BM_MEM_ALIGN);
+	if ((ptr) && (prefault))
+		_nyx_prefault(ptr, size);
+	return ptr;
+}
+
+static void _nyx_buffer_free(void* ptr, const size_t size)
+{
+#ifdef NYX_USE_HUGE_PAGES
+	if (size >= NYX_HUGE_PAGES_THRESHOLD)
+	{
+		nyx_page_free(ptr, size);
+		return;
+	}
+#else
+#pragma unused(size)
+#endif
+	nyx_aligned_free(ptr);
+}
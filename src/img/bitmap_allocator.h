@@ -0,0 +1,158 @@
+#ifndef __NYX_BITMAPALLOCATOR_H__
+#define __NYX_BITMAPALLOCATOR_H__
+
+#include "misc/global.h"
+
+
+/* Allocation statistics */
+typedef struct _nyx_alloc_stats_struct
+{
+	size_t num_allocs; // number of allocations served
+	size_t num_frees; // number of allocations released
+	size_t num_reused; // allocations served from already touched memory
+	size_t bytes_in_use; // bytes currently handed out
+	size_t bytes_high_water; // peak of bytes_in_use
+	size_t bytes_reserved; // bytes kept by the allocator, in use or not
+	size_t bytes_reserved_high_water; // peak of bytes_reserved
+} alloc_stats;
+
+/* Bitmap buffer allocator, buffers should be aligned on NYX_BM_MEM_ALIGN bytes */
+typedef struct _nyx_bm_allocator_struct
+{
+	void* (*alloc_fptr)(void* ctx, const size_t size);
+	void (*free_fptr)(void* ctx, void* ptr, const size_t size);
+	void (*stats_fptr)(void* ctx, alloc_stats* out_stats);
+	void (*evict_fptr)(void* ctx, void* ptr, const size_t size); // {OPTIONAL} release the memory of a page aligned range, its content is kept
+	void* ctx;
+} bm_allocator;
+
+/* Size class pool */
+typedef struct _nyx_bm_pool_struct bm_pool;
+
+/* Linear arena */
+typedef struct _nyx_bm_arena_struct bm_arena;
+
+/* Memory mapped storage */
+typedef struct _nyx_bm_mmap_struct bm_mmap;
+
+/* Alignment of bitmap buffers */
+#define NYX_BM_MEM_ALIGN 64
+
+/*** Allocator selection ***/
+
+/**
+ * @brief Get the default heap allocator
+ * @returns the default allocator
+ */
+const bm_allocator* nyx_bm_allocator_default(void);
+
+/**
+ * @brief Get the allocator used by nyx_bm_alloc() on the calling thread
+ * @returns the current allocator, the default one if none was set
+ */
+const bm_allocator* nyx_bm_allocator_get_current(void);
+
+/**
+ * @brief Set the allocator used by nyx_bm_alloc() on the calling thread
+ * @param allocator [in] : allocator to use, NULL to restore the default one
+ */
+void nyx_bm_allocator_set_current(const bm_allocator* allocator);
+
+/**
+ * @brief Retrieve the statistics of an allocator
+ * @param allocator [in] : allocator
+ * @param out_stats [out] : statistics
+ */
+void nyx_bm_allocator_get_stats(const bm_allocator* allocator, alloc_stats* out_stats);
+
+/*** Size class pool ***/
+
+/**
+ * @brief Create a pool which keeps released buffers for later allocations of the same size class
+ * @param max_cached_bytes [in] : maximum amount of idle memory kept by the pool, 0 for no limit
+ * @returns the pool, NULL if memory alloc failed
+ */
+bm_pool* nyx_bm_pool_create(const size_t max_cached_bytes);
+
+/**
+ * @brief Destroy a pool and release its cached buffers, bitmaps allocated from it must be destroyed first
+ * @param pool [in] : pool to destroy
+ */
+void nyx_bm_pool_destroy(bm_pool* pool);
+
+/**
+ * @brief Get the allocator interface of a pool
+ * @param pool [in] : pool
+ * @returns the allocator
+ */
+const bm_allocator* nyx_bm_pool_get_allocator(bm_pool* pool);
+
+/**
+ * @brief Allocate, pre-fault and cache buffers so that the first allocations are already warm
+ * @param pool [in] : pool
+ * @param size [in] : buffer size
+ * @param count [in] : number of buffers
+ * @returns true if all buffers were allocated
+ */
+bool nyx_bm_pool_reserve(bm_pool* pool, const size_t size, const size_t count);
+
+/**
+ * @brief Release all the idle buffers of a pool
+ * @param pool [in] : pool
+ */
+void nyx_bm_pool_trim(bm_pool* pool);
+
+/*** Arena ***/
+
+/**
+ * @brief Create an arena, allocations are carved out of a single block which is rewound when all of them are released
+ * @param capacity [in] : size of the block, allocations which don't fit are served by the default allocator
+ * @param prefault [in] : touch every page of the block now instead of on first use
+ * @returns the arena, NULL if memory alloc failed
+ */
+bm_arena* nyx_bm_arena_create(const size_t capacity, const bool prefault);
+
+/**
+ * @brief Destroy an arena, bitmaps allocated from it must be destroyed first
+ * @param arena [in] : arena to destroy
+ */
+void nyx_bm_arena_destroy(bm_arena* arena);
+
+/**
+ * @brief Get the allocator interface of an arena
+ * @param arena [in] : arena
+ * @returns the allocator
+ */
+const bm_allocator* nyx_bm_arena_get_allocator(bm_arena* arena);
+
+/**
+ * @brief Rewind an arena at the end of a job, the bitmaps allocated from it must all have been destroyed
+ * @param arena [in] : arena
+ * @returns false if allocations are still live, the arena is then left as it is
+ */
+bool nyx_bm_arena_reset(bm_arena* arena);
+
+/*** Memory mapped storage ***/
+
+/**
+ * @brief Create a memory mapped storage, each buffer is a mapping of its own unlinked scratch file so it can be larger than RAM
+ * @param scratch_dir [in] : {OPTIONAL} directory of the scratch files, NULL for anonymous mappings which can't be evicted
+ * @returns the storage, NULL if memory alloc failed
+ */
+bm_mmap* nyx_bm_mmap_create(const char* scratch_dir);
+
+/**
+ * @brief Destroy a memory mapped storage, bitmaps allocated from it must be destroyed first
+ * @param mm [in] : storage to destroy
+ */
+void nyx_bm_mmap_destroy(bm_mmap* mm);
+
+/**
+ * @brief Get the allocator interface of a memory mapped storage
+ * @param mm [in] : storage
+ * @returns the allocator
+ */
+const bm_allocator* nyx_bm_mmap_get_allocator(bm_mmap* mm);
+
+
+#endif /* __NYX_BITMAPALLOCATOR_H__ */
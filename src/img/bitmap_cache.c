@@ -0,0 +1,266 @@
+#include "bitmap_cache.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <zlib.h>
+
+
+/* Cache file signature */
+#define NYX_BMC_MAGIC "NYXBMC\r\n"
+#define NYX_BMC_VERSION 1
+/* Written in native byte order, a file from a machine of the other endianness reads it reversed */
+#define NYX_BMC_BYTE_ORDER 0x01020304
+/* Bytes checksummed at a time, crc32() takes an unsigned int length */
+#define NYX_BMC_CHECKSUM_BLOCK ((size_t)1 << 30)
+
+/* Cache file header, the pixels follow it */
+typedef struct _nyx_bm_cache_header_struct
+{
+	char magic[8]; // NYX_BMC_MAGIC
+	uint32_t version;
+	uint32_t byte_order; // NYX_BMC_BYTE_ORDER
+	uint64_t width;
+	uint64_t height;
+	uint64_t stride; // bytes between two rows
+	uint32_t format; // pixel_format_t
+	uint32_t checksum; // crc32 of the height * stride bytes of pixels
+	uint8_t reserved[16];
+} bm_cache_header;
+
+/* Mapping of a cache file, allocator of the bitmaps loaded from it */
+typedef struct _nyx_bm_cache_mapping_struct
+{
+	bm_allocator allocator;
+	pthread_mutex_t lock;
+	uint8_t* map;
+	size_t map_size;
+	size_t num_buffers; // the mapping and the private copies of its bitmaps, the mapping is released with the last one
+	alloc_stats stats;
+} bm_cache_mapping;
+
+
+static void* _nyx_bmc_alloc(void* ctx, const size_t size);
+static void _nyx_bmc_free(void* ctx, void* ptr, const size_t size);
+static void _nyx_bmc_stats(void* ctx, alloc_stats* out_stats);
+static bool _nyx_bmc_check_header(const bm_cache_header* header, const size_t file_size);
+static uint32_t _nyx_bmc_checksum(const uint8_t* pixels, const size_t size);
+
+
+bool nyx_bm_cache_write(const char* filepath, const bitmap* bm)
+{
+	// Sanity checks
+	if ((!filepath) || (!bm) || (!bm->buffer))
+		return false;
+
+	// the rows of a bitmap, and of a band view, are contiguous
+	const size_t pixels_size = bm->stride * bm->height;
+	bm_cache_header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, NYX_BMC_MAGIC, sizeof(header.magic));
+	header.version = NYX_BMC_VERSION;
+	header.byte_order = NYX_BMC_BYTE_ORDER;
+	header.width = bm->width;
+	header.height = bm->height;
+	header.stride = bm->stride;
+	header.format = (uint32_t)bm->format;
+	header.checksum = _nyx_bmc_checksum((const uint8_t*)bm->buffer, pixels_size);
+
+	const int fd = open(filepath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+	{
+		NYX_ERRLOG("[!] failed to create <%s>\n", filepath);
+		return false;
+	}
+
+	// a single writev, which only returns early for huge files or signals
+	struct iovec iov[2] = {{.iov_base = &header, .iov_len = sizeof(header)}, {.iov_base = bm->buffer, .iov_len = pixels_size}};
+	struct iovec* next = iov;
+	int count = 2;
+	while (count > 0)
+	{
+		const ssize_t written = writev(fd, next, count);
+		if (written < 0)
+		{
+			if (EINTR == errno)
+				continue;
+			break;
+		}
+		size_t left = (size_t)written;
+		while ((count > 0) && (left >= next->iov_len))
+		{
+			left -= next->iov_len;
+			next++;
+			count--;
+		}
+		if (count > 0)
+		{
+			next->iov_base = (uint8_t*)next->iov_base + left;
+			next->iov_len -= left;
+		}
+	}
+	bool ret = (0 == count);
+	if (close(fd) != 0)
+		ret = false;
+	if (!ret)
+		NYX_ERRLOG("[!] failed to write <%s>\n", filepath);
+
+	return ret;
+}
+
+bitmap* nyx_bm_cache_load(const char* filepath, const bool verify)
+{
+	// Sanity checks
+	if (!filepath)
+		return NULL;
+
+	const int fd = open(filepath, O_RDONLY);
+	if (fd < 0)
+	{
+		NYX_ERRLOG("[!] failed to open <%s>\n", filepath);
+		return NULL;
+	}
+	struct stat st;
+	if ((fstat(fd, &st) != 0) || ((size_t)st.st_size < sizeof(bm_cache_header)))
+	{
+		close(fd);
+		return NULL;
+	}
+
+	// private mapping, written pages are copied and the file stays as it is
+	const size_t map_size = (size_t)st.st_size;
+	uint8_t* map = (uint8_t*)mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (MAP_FAILED == map)
+	{
+		NYX_ERRLOG("[!] failed to map <%s>\n", filepath);
+		return NULL;
+	}
+
+	const bm_cache_header* header = (const bm_cache_header*)map;
+	uint8_t* pixels = map + sizeof(bm_cache_header);
+	if ((!_nyx_bmc_check_header(header, map_size)) || ((verify) && (_nyx_bmc_checksum(pixels, map_size - sizeof(bm_cache_header)) != header->checksum)))
+	{
+		NYX_ERRLOG("[!] invalid bitmap cache <%s>\n", filepath);
+		munmap(map, map_size);
+		return NULL;
+	}
+
+	bm_cache_mapping* mapping = (bm_cache_mapping*)calloc(1, sizeof(bm_cache_mapping));
+	if ((!mapping) || (pthread_mutex_init(&mapping->lock, NULL) != 0))
+	{
+		free(mapping);
+		munmap(map, map_size);
+		return NULL;
+	}
+	mapping->allocator.alloc_fptr = _nyx_bmc_alloc;
+	mapping->allocator.free_fptr = _nyx_bmc_free;
+	mapping->allocator.stats_fptr = _nyx_bmc_stats;
+	mapping->allocator.ctx = mapping;
+	mapping->map = map;
+	mapping->map_size = map_size;
+	mapping->num_buffers = 1;
+	mapping->stats = (alloc_stats){.num_allocs = 1, .bytes_in_use = map_size, .bytes_high_water = map_size, .bytes_reserved = map_size, .bytes_reserved_high_water = map_size};
+
+	bitmap* bm = nyx_bm_wrap_buffer(pixels, (size_t)header->width, (size_t)header->height, (size_t)header->stride, (pixel_format_t)header->format, &mapping->allocator);
+	if (!bm)
+	{
+		_nyx_bmc_free(mapping, pixels, map_size - sizeof(bm_cache_header));
+		return NULL;
+	}
+
+	return bm;
+}
+
+/*** Private ***/
+static void* _nyx_bmc_alloc(void* ctx, const size_t size)
+{
+	// private copies of the bitmaps loaded from the mapping come from the heap
+	bm_cache_mapping* mapping = (bm_cache_mapping*)ctx;
+	const bm_allocator* heap = nyx_bm_allocator_default();
+	void* ptr = heap->alloc_fptr(heap->ctx, size);
+	if (!ptr)
+		return NULL;
+
+	pthread_mutex_lock(&mapping->lock);
+	mapping->num_buffers++;
+	mapping->stats.num_allocs++;
+	mapping->stats.bytes_in_use += size;
+	mapping->stats.bytes_reserved += size;
+	mapping->stats.bytes_high_water = NYX_MAX(mapping->stats.bytes_high_water, mapping->stats.bytes_in_use);
+	mapping->stats.bytes_reserved_high_water = NYX_MAX(mapping->stats.bytes_reserved_high_water, mapping->stats.bytes_reserved);
+	pthread_mutex_unlock(&mapping->lock);
+	return ptr;
+}
+
+static void _nyx_bmc_free(void* ctx, void* ptr, const size_t size)
+{
+	if (!ptr)
+		return;
+
+	// the mapping context goes away with the last of the mapping and the private copies
+	bm_cache_mapping* mapping = (bm_cache_mapping*)ctx;
+	const bool mapped = ((uint8_t*)ptr == mapping->map + sizeof(bm_cache_header));
+	if (mapped)
+		munmap(mapping->map, mapping->map_size);
+	else
+	{
+		const bm_allocator* heap = nyx_bm_allocator_default();
+		heap->free_fptr(heap->ctx, ptr, size);
+	}
+
+	pthread_mutex_lock(&mapping->lock);
+	const size_t released = (mapped) ? mapping->map_size : size;
+	mapping->stats.num_frees++;
+	mapping->stats.bytes_in_use -= released;
+	mapping->stats.bytes_reserved -= released;
+	const bool last = (0 == --mapping->num_buffers);
+	pthread_mutex_unlock(&mapping->lock);
+	if (last)
+	{
+		pthread_mutex_destroy(&mapping->lock);
+		free(mapping);
+	}
+}
+
+static void _nyx_bmc_stats(void* ctx, alloc_stats* out_stats)
+{
+	bm_cache_mapping* mapping = (bm_cache_mapping*)ctx;
+	pthread_mutex_lock(&mapping->lock);
+	*out_stats = mapping->stats;
+	pthread_mutex_unlock(&mapping->lock);
+}
+
+/**
+ * @brief Check the header of a cache file
+ * @param header [in] : header, at the start of the file
+ * @param file_size [in] : size of the file in bytes
+ * @returns true if the header is valid and the file holds exactly its pixels
+ */
+static bool _nyx_bmc_check_header(const bm_cache_header* header, const size_t file_size)
+{
+	if ((memcmp(header->magic, NYX_BMC_MAGIC, sizeof(header->magic)) != 0) || (header->version != NYX_BMC_VERSION) || (header->byte_order != NYX_BMC_BYTE_ORDER))
+		return false;
+
+	const size_t bytes_per_pixel = nyx_bytes_per_pixel_for_format((pixel_format_t)header->format);
+	// rows without padding, as in bitmaps
+	if ((0 == bytes_per_pixel) || (0 == header->width) || (0 == header->height) || (header->stride % bytes_per_pixel != 0) || (header->width != header->stride / bytes_per_pixel))
+		return false;
+
+	// truncated or extended files are rejected, without overflowing
+	const size_t pixels_size = file_size - sizeof(bm_cache_header);
+	return (header->height <= pixels_size / header->stride) && (header->height * header->stride == pixels_size);
+}
+
+static uint32_t _nyx_bmc_checksum(const uint8_t* pixels, const size_t size)
+{
+	uLong crc = crc32(0L, Z_NULL, 0);
+	for (size_t offset = 0; offset < size; offset += NYX_BMC_CHECKSUM_BLOCK)
+		crc = crc32(crc, pixels + offset, (uInt)NYX_MIN(NYX_BMC_CHECKSUM_BLOCK, size - offset));
+	return (uint32_t)crc;
+}
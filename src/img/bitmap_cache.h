@@ -0,0 +1,28 @@
+#ifndef __NYX_BITMAPCACHE_H__
+#define __NYX_BITMAPCACHE_H__
+
+#include "bitmap.h"
+
+
+/* Cache files hold a bitmap as it is in memory : a 64-byte header then the rows, aligned on NYX_BM_MEM_ALIGN bytes in the file.
+ * They are meant to be reloaded on the same machine, the header is in native byte order */
+
+/**
+ * @brief Save a bitmap to a cache file, the header and the rows are written in one system call
+ * @param filepath [in] : Path to save the file to
+ * @param bm [in] : Bitmap, or band view
+ * @returns true if the file was successfully written
+ */
+bool nyx_bm_cache_write(const char* filepath, const bitmap* bm);
+
+/**
+ * @brief Map a cache file as a bitmap, no pixel is read until it is accessed
+ * The mapping is copy-on-write, pixels written through the bitmap or its copies never reach the file
+ * @param filepath [in] : Path of the file
+ * @param verify [in] : check the pixels against the checksum of the header, this reads the whole file
+ * @returns the bitmap, to destroy with nyx_bm_destroy(), NULL if the file isn't a valid cache file
+ */
+bitmap* nyx_bm_cache_load(const char* filepath, const bool verify);
+
+
+#endif /* __NYX_BITMAPCACHE_H__ */
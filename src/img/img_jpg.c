@@ -0,0 +1,144 @@
+#include "img_jpg.h"
+#include <string.h>
+
+
+static void _nyx_jpg_error_exit(j_common_ptr cinfo);
+
+
+struct jpeg_error_mgr* nyx_jpg_std_error(jpg_error_mgr* err)
+{
+	struct jpeg_error_mgr* pub = jpeg_std_error(&err->pub);
+	pub->error_exit = _nyx_jpg_error_exit;
+	return pub;
+}
+
+pixel_format_t nyx_jpg_set_out_format(struct jpeg_decompress_struct* cinfo, const pixel_format_t format, const bool grayscale)
+{
+	if ((grayscale) || (pixel_format_gray8 == format) || (JCS_GRAYSCALE == cinfo->out_color_space))
+	{
+		// only decode the Y plane, no chroma upsampling nor color conversion
+		cinfo->out_color_space = JCS_GRAYSCALE;
+		return pixel_format_gray8;
+	}
+
+#ifdef JCS_EXTENSIONS
+	// libjpeg-turbo can output the bitmap pixel format by itself
+	switch (format)
+	{
+		case pixel_format_rgba32:
+			cinfo->out_color_space = JCS_EXT_RGBA;
+			return format;
+		case pixel_format_bgra32:
+			cinfo->out_color_space = JCS_EXT_BGRA;
+			return format;
+		case pixel_format_bgr24:
+			cinfo->out_color_space = JCS_EXT_BGR;
+			return format;
+		default:
+			break;
+	}
+#endif
+	cinfo->out_color_space = JCS_RGB;
+	return pixel_format_rgb24;
+}
+
+pixel_format_t nyx_jpg_get_scanline_format(const pixel_format_t format, const bool gray)
+{
+	if (gray)
+		return pixel_format_gray8;
+#ifdef JCS_EXTENSIONS
+	if (format != pixel_format_gray8)
+		return format;
+#else
+#pragma unused(format)
+#endif
+	return pixel_format_rgb24;
+}
+
+void nyx_jpg_set_compress_params(struct jpeg_compress_struct* cinfo, const pixel_format_t scanline_format, const img_write_options* options)
+{
+	cinfo->input_components = (int)nyx_bytes_per_pixel_for_format(scanline_format);
+	switch (scanline_format)
+	{
+		case pixel_format_gray8:
+			cinfo->in_color_space = JCS_GRAYSCALE;
+			break;
+#ifdef JCS_EXTENSIONS
+		case pixel_format_rgba32:
+			cinfo->in_color_space = JCS_EXT_RGBX;
+			break;
+		case pixel_format_bgra32:
+			cinfo->in_color_space = JCS_EXT_BGRX;
+			break;
+		case pixel_format_bgr24:
+			cinfo->in_color_space = JCS_EXT_BGR;
+			break;
+#endif
+		case pixel_format_rgb24:
+		default:
+			cinfo->in_color_space = JCS_RGB;
+			break;
+	}
+	jpeg_set_defaults(cinfo);
+	jpeg_set_quality(cinfo, ((options) && (options->jpg_quality > 0)) ? NYX_MIN(options->jpg_quality, 100) : 100, TRUE);
+	if (!options)
+		return;
+
+	// luma sampling factors, the chroma components stay at 1x1
+	if ((3 == cinfo->num_components) && (options->jpg_subsampling != jpg_subsampling_default))
+	{
+		cinfo->comp_info[0].h_samp_factor = (jpg_subsampling_444 == options->jpg_subsampling) ? 1 : 2;
+		cinfo->comp_info[0].v_samp_factor = (jpg_subsampling_420 == options->jpg_subsampling) ? 2 : 1;
+		for (int i = 1; i < 3; i++)
+			cinfo->comp_info[i].h_samp_factor = cinfo->comp_info[i].v_samp_factor = 1;
+	}
+	switch (options->jpg_dct)
+	{
+		case jpg_dct_ifast:
+			cinfo->dct_method = JDCT_IFAST;
+			break;
+		case jpg_dct_float:
+			cinfo->dct_method = JDCT_FLOAT;
+			break;
+		case jpg_dct_islow:
+			cinfo->dct_method = JDCT_ISLOW;
+			break;
+		case jpg_dct_default:
+		default:
+			break;
+	}
+	cinfo->optimize_coding = (options->jpg_optimize_coding) ? TRUE : FALSE;
+	if (options->jpg_progressive)
+		jpeg_simple_progression(cinfo);
+}
+
+const uint8_t* nyx_jpg_get_opaque_scanline(const uint8_t* row, const pixel_format_t scanline_format, uint8_t* scratch, const size_t width)
+{
+	// libjpeg ignores the X byte, most rows have no fully transparent pixel and are given as they are
+	if (!nyx_format_has_alpha(scanline_format))
+		return row;
+	size_t x = 0;
+	while ((x < width) && (row[(x * 4) + 3] != NYX_MIN_PIXEL_COMPONENT_VALUE))
+		x++;
+	if (x == width)
+		return row;
+
+	memcpy(scratch, row, width * 4);
+	for (; x < width; x++)
+	{
+		uint8_t* px = scratch + (x * 4);
+		if (NYX_MIN_PIXEL_COMPONENT_VALUE == px[3])
+			px[0] = px[1] = px[2] = NYX_MAX_PIXEL_COMPONENT_VALUE;
+	}
+	return scratch;
+}
+
+/*** Private ***/
+static void _nyx_jpg_error_exit(j_common_ptr cinfo)
+{
+	// the default handler exits, a corrupted image must only fail its own decoding
+	char message[JMSG_LENGTH_MAX];
+	(*cinfo->err->format_message)(cinfo, message);
+	NYX_ERRLOG("[!] libjpeg : %s\n", message);
+	longjmp(((jpg_error_mgr*)cinfo->err)->jmp, 1);
+}
@@ -0,0 +1,59 @@
+#ifndef __NYX_IMGJPG_H__
+#define __NYX_IMGJPG_H__
+
+#include "img_writer.h"
+#include <setjmp.h>
+#include <jpeglib.h>
+
+
+/* libjpeg error manager which jumps back to the caller instead of exiting the process */
+typedef struct _nyx_jpg_error_mgr_struct
+{
+	struct jpeg_error_mgr pub;
+	jmp_buf jmp; // set with setjmp() before calling libjpeg
+} jpg_error_mgr;
+
+/**
+ * @brief Initialize a libjpeg error manager whose fatal errors are logged then longjmp() to err->jmp
+ * @param err [in] : error manager
+ * @returns the error manager to store in the cinfo err field
+ */
+struct jpeg_error_mgr* nyx_jpg_std_error(jpg_error_mgr* err);
+
+/**
+ * @brief Pick the decompressor output colorspace closest to a bitmap pixel format, libjpeg-turbo outputs the color formats as they are
+ * @param cinfo [in] : decompressor, its header must have been read and its colorspace must be RGB or gray
+ * @param format [in] : pixel format of the bitmap, gray8 implies grayscale
+ * @param grayscale [in] : only decode the luma
+ * @returns the pixel format of the decoded scanlines
+ */
+pixel_format_t nyx_jpg_set_out_format(struct jpeg_decompress_struct* cinfo, const pixel_format_t format, const bool grayscale);
+
+/**
+ * @brief Get the pixel format of the scanlines given to the compressor, libjpeg-turbo takes the color formats as they are
+ * @param format [in] : pixel format of the rows to encode
+ * @param gray [in] : encode a gray image
+ * @returns the scanlines pixel format
+ */
+pixel_format_t nyx_jpg_get_scanline_format(const pixel_format_t format, const bool gray);
+
+/**
+ * @brief Set the compression parameters shared by the serial and parallel encoders
+ * @param cinfo [in] : compressor, its image size must be set
+ * @param scanline_format [in] : pixel format of the scanlines, from nyx_jpg_get_scanline_format()
+ * @param options [in] : {OPTIONAL} Encoding options
+ */
+void nyx_jpg_set_compress_params(struct jpeg_compress_struct* cinfo, const pixel_format_t scanline_format, const img_write_options* options);
+
+/**
+ * @brief Get the scanline to give the compressor for a row in the scanline format, fully transparent pixels become white like in nyx_px_convert_row_opaque()
+ * @param row [in] : row
+ * @param scanline_format [in] : pixel format of row
+ * @param scratch [in] : a row worth of memory, used only when row has fully transparent pixels
+ * @param width [in] : number of pixels
+ * @returns row, or scratch
+ */
+const uint8_t* nyx_jpg_get_opaque_scanline(const uint8_t* row, const pixel_format_t scanline_format, uint8_t* scratch, const size_t width);
+
+
+#endif /* __NYX_IMGJPG_H__ */
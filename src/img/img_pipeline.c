@@ -0,0 +1,386 @@
+#include "img_pipeline.h"
+#include <stdlib.h>
+#include <string.h>
+#include "pixel_convert.h"
+
+
+/* Row stage, delivers its rows one at a time from top to bottom */
+typedef struct _nyx_pipeline_stage_struct pipeline_stage;
+struct _nyx_pipeline_stage_struct
+{
+	pipeline_stage* upstream; // stage the rows are pulled from, NULL for the decoder
+	size_t width; // width of the delivered rows
+	size_t height; // number of delivered rows
+	pixel_format_t format; // pixel format of the delivered rows
+	size_t y; // next row to deliver
+	bool (*pull_row_fptr)(pipeline_stage* stage, uint8_t* row);
+	uint8_t* in_row; // row of upstream, when it can't be pulled in the delivered row
+	// decoder
+	img_row_reader* reader;
+	// filter
+	bm_filter_fptr filter;
+	// crop
+	rect crop_rect;
+	// bilinear scaling
+	float* ring; // two horizontally scaled input rows, input row y is in slot y & 1
+	size_t* x_offsets; // offsets of the two input pixels of each output column
+	float* x_weights; // weight of the right input pixel of each output column
+	float y_ratio;
+};
+
+/* Pipeline */
+struct _nyx_img_pipeline_struct
+{
+	img_row_reader* reader;
+	pipeline_stage* last; // last stage, the chain goes up to the decoder
+};
+
+
+static img_pipeline* _nyx_pipeline_create(img_row_reader* reader);
+static bool _nyx_pipeline_run(img_pipeline* pipeline, img_row_writer* writer);
+static pipeline_stage* _nyx_pipeline_add_stage(img_pipeline* pipeline, const size_t width, const size_t height, const pixel_format_t format, bool (*pull_row_fptr)(pipeline_stage*, uint8_t*), const bool needs_in_row);
+static bool _nyx_pipeline_pull(pipeline_stage* stage, uint8_t* row);
+static bool _nyx_pipeline_decode_row(pipeline_stage* stage, uint8_t* row);
+static bool _nyx_pipeline_filter_row(pipeline_stage* stage, uint8_t* row);
+static bool _nyx_pipeline_convert_row(pipeline_stage* stage, uint8_t* row);
+static bool _nyx_pipeline_crop_row(pipeline_stage* stage, uint8_t* row);
+static bool _nyx_pipeline_scale_row(pipeline_stage* stage, uint8_t* row);
+static void _nyx_pipeline_scale_horizontally(const pipeline_stage* stage, const uint8_t* src, float* dst);
+
+
+img_pipeline* nyx_img_pipeline_create(const char* filepath, const img_read_options* options)
+{
+	return _nyx_pipeline_create(nyx_img_row_reader_open(filepath, options));
+}
+
+img_pipeline* nyx_img_pipeline_create_from_memory(const void* data, const size_t data_size, const img_read_options* options)
+{
+	return _nyx_pipeline_create(nyx_img_row_reader_open_memory(data, data_size, options));
+}
+
+void nyx_img_pipeline_destroy(img_pipeline* pipeline)
+{
+	if (!pipeline)
+		return;
+
+	pipeline_stage* stage = pipeline->last;
+	while (stage)
+	{
+		pipeline_stage* upstream = stage->upstream;
+		free(stage->in_row);
+		free(stage->ring);
+		free(stage->x_offsets);
+		free(stage->x_weights);
+		free(stage);
+		stage = upstream;
+	}
+	nyx_img_row_reader_close(pipeline->reader);
+	free(pipeline);
+}
+
+bool nyx_img_pipeline_add_filter(img_pipeline* pipeline, bm_filter_fptr filter)
+{
+	if ((!pipeline) || (!filter))
+		return false;
+
+	// same rows as upstream, filtered where they were pulled
+	const pipeline_stage* upstream = pipeline->last;
+	pipeline_stage* stage = _nyx_pipeline_add_stage(pipeline, upstream->width, upstream->height, upstream->format, _nyx_pipeline_filter_row, false);
+	if (!stage)
+		return false;
+	stage->filter = filter;
+
+	return true;
+}
+
+bool nyx_img_pipeline_add_convert(img_pipeline* pipeline, const pixel_format_t format)
+{
+	if ((!pipeline) || (0 == nyx_bytes_per_pixel_for_format(format)))
+		return false;
+
+	const pipeline_stage* upstream = pipeline->last;
+	if (upstream->format == format)
+		return true;
+
+	return (_nyx_pipeline_add_stage(pipeline, upstream->width, upstream->height, format, _nyx_pipeline_convert_row, true) != NULL);
+}
+
+bool nyx_img_pipeline_add_crop(img_pipeline* pipeline, const rect crop_rect)
+{
+	if (!pipeline)
+		return false;
+
+	// Check if the cropped rect doesn't overflow from the upstream rows
+	const pipeline_stage* upstream = pipeline->last;
+	if ((0 == crop_rect.size.w) || (0 == crop_rect.size.h) || (NYX_RECT_GET_MAX_X(crop_rect) > upstream->width) || (NYX_RECT_GET_MAX_Y(crop_rect) > upstream->height))
+		return false;
+
+	pipeline_stage* stage = _nyx_pipeline_add_stage(pipeline, crop_rect.size.w, crop_rect.size.h, upstream->format, _nyx_pipeline_crop_row, true);
+	if (!stage)
+		return false;
+	stage->crop_rect = crop_rect;
+
+	return true;
+}
+
+bool nyx_img_pipeline_add_scale_bilinear(img_pipeline* pipeline, const size out_size)
+{
+	if ((!pipeline) || (0 == out_size.w) || (0 == out_size.h))
+		return false;
+
+	// the input columns of each output column never change, compute them once
+	const pipeline_stage* upstream = pipeline->last;
+	const size_t bpp = nyx_bytes_per_pixel_for_format(upstream->format);
+	float* ring = (float*)malloc(2 * out_size.w * bpp * sizeof(float));
+	size_t* x_offsets = (size_t*)malloc(2 * out_size.w * sizeof(size_t));
+	float* x_weights = (float*)malloc(out_size.w * sizeof(float));
+	pipeline_stage* stage = ((ring) && (x_offsets) && (x_weights)) ? _nyx_pipeline_add_stage(pipeline, out_size.w, out_size.h, upstream->format, _nyx_pipeline_scale_row, true) : NULL;
+	if (!stage)
+	{
+		free(ring);
+		free(x_offsets);
+		free(x_weights);
+		return false;
+	}
+
+	const float x_ratio = ((float)(upstream->width - 1)) / out_size.w;
+	for (size_t x = 0; x < out_size.w; x++)
+	{
+		const size_t x0 = (size_t)(x_ratio * x);
+		x_offsets[2 * x] = x0 * bpp;
+		x_offsets[(2 * x) + 1] = NYX_MIN(x0 + 1, upstream->width - 1) * bpp;
+		x_weights[x] = (x_ratio * x) - x0;
+	}
+	stage->ring = ring;
+	stage->x_offsets = x_offsets;
+	stage->x_weights = x_weights;
+	stage->y_ratio = ((float)(upstream->height - 1)) / out_size.h;
+
+	return true;
+}
+
+size nyx_img_pipeline_get_size(const img_pipeline* pipeline)
+{
+	return (pipeline != NULL) ? (size){.w = pipeline->last->width, .h = pipeline->last->height} : (size){.w = 0, .h = 0};
+}
+
+pixel_format_t nyx_img_pipeline_get_format(const img_pipeline* pipeline)
+{
+	return (pipeline != NULL) ? pipeline->last->format : pixel_format_rgba32;
+}
+
+bool nyx_img_pipeline_read_row(img_pipeline* pipeline, uint8_t* row)
+{
+	if ((!pipeline) || (!row))
+		return false;
+
+	return _nyx_pipeline_pull(pipeline->last, row);
+}
+
+bool nyx_img_pipeline_run(img_pipeline* pipeline, const char* filepath, const img_type_t type, const colorspace_t output_colorspace, const img_write_options* options)
+{
+	if ((!pipeline) || (!filepath))
+		return false;
+
+	const size img_size = (size){.w = pipeline->last->width, .h = pipeline->last->height};
+	return _nyx_pipeline_run(pipeline, nyx_img_row_writer_open(filepath, img_size, pipeline->last->format, type, output_colorspace, options));
+}
+
+bool nyx_img_pipeline_run_to_memory(img_pipeline* pipeline, const img_type_t type, const colorspace_t output_colorspace, const img_write_options* options, img_buffer* out_buffer)
+{
+	if ((!pipeline) || (!out_buffer))
+		return false;
+
+	const size img_size = (size){.w = pipeline->last->width, .h = pipeline->last->height};
+	return _nyx_pipeline_run(pipeline, nyx_img_row_writer_open_memory(out_buffer, img_size, pipeline->last->format, type, output_colorspace, options));
+}
+
+/*** Private ***/
+/**
+ * @brief Create a pipeline whose first stage is a decoder
+ * @param reader [in] : {OPTIONAL} decoder, owned by the pipeline, NULL if it couldn't be opened
+ * @returns the pipeline, NULL if something failed
+ */
+static img_pipeline* _nyx_pipeline_create(img_row_reader* reader)
+{
+	if (!reader)
+		return NULL;
+
+	img_pipeline* pipeline = (img_pipeline*)calloc(1, sizeof(img_pipeline));
+	if (!pipeline)
+	{
+		nyx_img_row_reader_close(reader);
+		return NULL;
+	}
+	pipeline->reader = reader;
+
+	// the decoder is the first stage
+	const size img_size = nyx_img_row_reader_get_size(reader);
+	pipeline_stage* stage = _nyx_pipeline_add_stage(pipeline, img_size.w, img_size.h, nyx_img_row_reader_get_format(reader), _nyx_pipeline_decode_row, false);
+	if (!stage)
+	{
+		nyx_img_pipeline_destroy(pipeline);
+		return NULL;
+	}
+	stage->reader = reader;
+
+	return pipeline;
+}
+
+/**
+ * @brief Pull every row out of the last stage into a writer, then close it
+ * @param pipeline [in] : pipeline
+ * @param writer [in] : {OPTIONAL} writer, NULL if it couldn't be opened
+ * @returns true if the image was successfully written
+ */
+static bool _nyx_pipeline_run(img_pipeline* pipeline, img_row_writer* writer)
+{
+	if (!writer)
+		return false;
+
+	pipeline_stage* last = pipeline->last;
+	if (last->y > 0)
+	{
+		NYX_ERRLOG("[!] pipeline rows were already pulled\n");
+		(void)nyx_img_row_writer_close(writer);
+		return false;
+	}
+
+	// one row travels from the decoder to the encoder at a time
+	uint8_t* row = (uint8_t*)malloc(last->width * nyx_bytes_per_pixel_for_format(last->format));
+	bool ret = (row != NULL);
+	for (size_t y = 0; (y < last->height) && (ret); y++)
+		ret = (_nyx_pipeline_pull(last, row)) && (nyx_img_row_writer_write_row(writer, row));
+	free(row);
+
+	return nyx_img_row_writer_close(writer) && ret;
+}
+
+/**
+ * @brief Append a stage to a pipeline
+ * @param pipeline [in] : pipeline
+ * @param width [in] : width of the rows delivered by the stage
+ * @param height [in] : number of rows delivered by the stage
+ * @param format [in] : pixel format of the rows delivered by the stage
+ * @param pull_row_fptr [in] : computes the next row of the stage
+ * @param needs_in_row [in] : allocate a row of the previous stage
+ * @returns the stage, NULL if memory alloc failed
+ */
+static pipeline_stage* _nyx_pipeline_add_stage(img_pipeline* pipeline, const size_t width, const size_t height, const pixel_format_t format, bool (*pull_row_fptr)(pipeline_stage*, uint8_t*), const bool needs_in_row)
+{
+	pipeline_stage* stage = (pipeline_stage*)calloc(1, sizeof(pipeline_stage));
+	if (!stage)
+		return NULL;
+
+	stage->upstream = pipeline->last;
+	stage->width = width;
+	stage->height = height;
+	stage->format = format;
+	stage->pull_row_fptr = pull_row_fptr;
+	if ((needs_in_row) && (stage->upstream))
+	{
+		stage->in_row = (uint8_t*)malloc(stage->upstream->width * nyx_bytes_per_pixel_for_format(stage->upstream->format));
+		if (!stage->in_row)
+		{
+			free(stage);
+			return NULL;
+		}
+	}
+	pipeline->last = stage;
+
+	return stage;
+}
+
+static bool _nyx_pipeline_pull(pipeline_stage* stage, uint8_t* row)
+{
+	if (stage->y >= stage->height)
+		return false;
+
+	if (!stage->pull_row_fptr(stage, row))
+		return false;
+	stage->y++;
+
+	return true;
+}
+
+static bool _nyx_pipeline_decode_row(pipeline_stage* stage, uint8_t* row)
+{
+	return nyx_img_row_reader_read_row(stage->reader, row);
+}
+
+static bool _nyx_pipeline_filter_row(pipeline_stage* stage, uint8_t* row)
+{
+	if (!_nyx_pipeline_pull(stage->upstream, row))
+		return false;
+
+	// the row is a one row band view, filters work on it in place
+	bitmap band = (bitmap){.buffer = row, .width = stage->width, .height = 1, .stride = stage->width * nyx_bytes_per_pixel_for_format(stage->format), .format = stage->format, .allocator = NULL, .storage = NULL};
+	return stage->filter(&band, &band);
+}
+
+static bool _nyx_pipeline_convert_row(pipeline_stage* stage, uint8_t* row)
+{
+	if (!_nyx_pipeline_pull(stage->upstream, stage->in_row))
+		return false;
+
+	nyx_px_convert_row(stage->in_row, stage->upstream->format, row, stage->format, stage->width);
+	return true;
+}
+
+static bool _nyx_pipeline_crop_row(pipeline_stage* stage, uint8_t* row)
+{
+	// drop the rows above the rect, the ones below it are never pulled
+	pipeline_stage* upstream = stage->upstream;
+	while (upstream->y < stage->crop_rect.origin.y)
+	{
+		if (!_nyx_pipeline_pull(upstream, stage->in_row))
+			return false;
+	}
+	if (!_nyx_pipeline_pull(upstream, stage->in_row))
+		return false;
+
+	const size_t bpp = nyx_bytes_per_pixel_for_format(stage->format);
+	memcpy(row, stage->in_row + (stage->crop_rect.origin.x * bpp), stage->width * bpp);
+	return true;
+}
+
+static bool _nyx_pipeline_scale_row(pipeline_stage* stage, uint8_t* row)
+{
+	// output row y blends the input rows y0 and y0 + 1, like nyx_scale_bilinear()
+	pipeline_stage* upstream = stage->upstream;
+	const size_t row_len = stage->width * nyx_bytes_per_pixel_for_format(stage->format);
+	const float y_pos = stage->y_ratio * stage->y;
+	const size_t y0 = (size_t)y_pos;
+	const size_t y1 = NYX_MIN(y0 + 1, upstream->height - 1);
+	const float y_diff = y_pos - y0;
+
+	// pull the input rows up to y1, only the ones an output row needs are scaled horizontally
+	while (upstream->y <= y1)
+	{
+		const size_t in_y = upstream->y;
+		if (!_nyx_pipeline_pull(upstream, stage->in_row))
+			return false;
+		if (in_y >= y0)
+			_nyx_pipeline_scale_horizontally(stage, stage->in_row, stage->ring + ((in_y & 1) * row_len));
+	}
+
+	const float* top = stage->ring + ((y0 & 1) * row_len);
+	const float* bottom = stage->ring + ((y1 & 1) * row_len);
+	for (size_t i = 0; i < row_len; i++)
+		row[i] = (uint8_t)(top[i] + ((bottom[i] - top[i]) * y_diff));
+
+	return true;
+}
+
+static void _nyx_pipeline_scale_horizontally(const pipeline_stage* stage, const uint8_t* src, float* dst)
+{
+	const size_t bpp = nyx_bytes_per_pixel_for_format(stage->format);
+	for (size_t x = 0; x < stage->width; x++)
+	{
+		const uint8_t* left = src + stage->x_offsets[2 * x];
+		const uint8_t* right = src + stage->x_offsets[(2 * x) + 1];
+		const float x_diff = stage->x_weights[x];
+		for (size_t c = 0; c < bpp; c++)
+			*dst++ = left[c] + ((right[c] - left[c]) * x_diff);
+	}
+}
@@ -0,0 +1,112 @@
+#ifndef __NYX_IMGPIPELINE_H__
+#define __NYX_IMGPIPELINE_H__
+
+#include "img_reader.h"
+#include "img_writer.h"
+#include "filters/banded.h"
+
+
+/* Streaming pipeline, rows are pulled from a decoder through a chain of row stages, only a few rows are in memory at a time */
+typedef struct _nyx_img_pipeline_struct img_pipeline;
+
+/**
+ * @brief Create a pipeline decoding an image file, stages are then added one after the other
+ * @param filepath [in] : Path of the file
+ * @param options [in] : {OPTIONAL} Decoding options, a region of interest is cheaper than a crop stage for JPEG
+ * @returns the pipeline, NULL if the file can't be decoded
+ */
+img_pipeline* nyx_img_pipeline_create(const char* filepath, const img_read_options* options);
+
+/**
+ * @brief Create a pipeline decoding an image held in memory
+ * @param data [in] : encoded image, must stay valid until the pipeline is destroyed
+ * @param data_size [in] : size of data in bytes
+ * @param options [in] : {OPTIONAL} Decoding options
+ * @returns the pipeline, NULL if the image can't be decoded
+ */
+img_pipeline* nyx_img_pipeline_create_from_memory(const void* data, const size_t data_size, const img_read_options* options);
+
+/**
+ * @brief Destroy a pipeline and its stages, closes the decoder
+ * @param pipeline [in] : pipeline to destroy
+ */
+void nyx_img_pipeline_destroy(img_pipeline* pipeline);
+
+/**
+ * @brief Add a pixel filter stage, applied in place to each row
+ * @param pipeline [in] : pipeline
+ * @param filter [in] : filter, must only read the pixels it writes (like nyx_filter_grayscale()) and support the rows pixel format
+ * @returns true if all OK
+ */
+bool nyx_img_pipeline_add_filter(img_pipeline* pipeline, bm_filter_fptr filter);
+
+/**
+ * @brief Add a pixel format conversion stage
+ * @param pipeline [in] : pipeline
+ * @param format [in] : pixel format of the rows after this stage
+ * @returns true if all OK
+ */
+bool nyx_img_pipeline_add_convert(img_pipeline* pipeline, const pixel_format_t format);
+
+/**
+ * @brief Add a crop stage, the rows below the rect are never decoded
+ * @param pipeline [in] : pipeline
+ * @param crop_rect [in] : Zone to keep, must fit in the rows of the previous stage
+ * @returns true if all OK
+ */
+bool nyx_img_pipeline_add_crop(img_pipeline* pipeline, const rect crop_rect);
+
+/**
+ * @brief Add a bilinear scaling stage, same sampling as nyx_scale_bilinear() computed separably, only two scaled input rows are kept
+ * @param pipeline [in] : pipeline
+ * @param out_size [in] : size of the rows after this stage
+ * @returns true if all OK
+ */
+bool nyx_img_pipeline_add_scale_bilinear(img_pipeline* pipeline, const size out_size);
+
+/**
+ * @brief Get the size of the image coming out of the last stage
+ * @param pipeline [in] : pipeline
+ * @returns the size of the image
+ */
+size nyx_img_pipeline_get_size(const img_pipeline* pipeline);
+
+/**
+ * @brief Get the pixel format of the rows coming out of the last stage
+ * @param pipeline [in] : pipeline
+ * @returns the pixel format
+ */
+pixel_format_t nyx_img_pipeline_get_format(const img_pipeline* pipeline);
+
+/**
+ * @brief Pull the next row out of the last stage
+ * @param pipeline [in] : pipeline
+ * @param row [out] : pixels, width * bytes per pixel of the pipeline format
+ * @returns true if all OK, false if a stage failed or all rows were already pulled
+ */
+bool nyx_img_pipeline_read_row(img_pipeline* pipeline, uint8_t* row);
+
+/**
+ * @brief Pull every row out of the last stage and encode them to a file
+ * @param pipeline [in] : pipeline, no row must have been pulled yet
+ * @param filepath [in] : Path to save the file to
+ * @param type [in] : image type to save to
+ * @param output_colorspace [in] : colorspace to save the image (RGB, RGBA, gray), JPEG ignores alpha
+ * @param options [in] : {OPTIONAL} Encoding options, NULL for defaults
+ * @returns true if the image was successfully written
+ */
+bool nyx_img_pipeline_run(img_pipeline* pipeline, const char* filepath, const img_type_t type, const colorspace_t output_colorspace, const img_write_options* options);
+
+/**
+ * @brief Pull every row out of the last stage and encode them in memory
+ * @param pipeline [in] : pipeline, no row must have been pulled yet
+ * @param type [in] : image type to encode to
+ * @param output_colorspace [in] : colorspace to save the image (RGB, RGBA, gray), JPEG ignores alpha
+ * @param options [in] : {OPTIONAL} Encoding options, NULL for defaults
+ * @param out_buffer [out] : receives the encoded image, its previous content is replaced and its memory reused
+ * @returns true if the image was successfully encoded
+ */
+bool nyx_img_pipeline_run_to_memory(img_pipeline* pipeline, const img_type_t type, const colorspace_t output_colorspace, const img_write_options* options, img_buffer* out_buffer);
+
+
+#endif /* __NYX_IMGPIPELINE_H__ */
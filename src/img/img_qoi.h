@@ -0,0 +1,30 @@
+#ifndef __NYX_IMGQOI_H__
+#define __NYX_IMGQOI_H__
+
+#include "misc/global.h"
+
+
+/* QOI ("Quite OK Image") stream : 14-byte header, chunks of 1 to 5 bytes, then 7 zero bytes and a one */
+#define NYX_QOI_HEADER_SIZE 14
+#define NYX_QOI_END_MARKER_SIZE 8
+/* Largest chunk, an RGBA pixel */
+#define NYX_QOI_MAX_CHUNK_SIZE 5
+/* Longest run, 63 and 64 would collide with the RGB and RGBA tags */
+#define NYX_QOI_MAX_RUN 62
+/* Largest image the reference decoder accepts */
+#define NYX_QOI_MAX_PIXELS ((size_t)400000000)
+
+/* Chunk tags, the 2-bit ones are in the top bits of the first byte */
+#define NYX_QOI_OP_INDEX 0x00
+#define NYX_QOI_OP_DIFF 0x40
+#define NYX_QOI_OP_LUMA 0x80
+#define NYX_QOI_OP_RUN 0xC0
+#define NYX_QOI_OP_RGB 0xFE
+#define NYX_QOI_OP_RGBA 0xFF
+#define NYX_QOI_MASK_2 0xC0
+
+/* Slot of a pixel in the table of the 64 previously seen pixels */
+#define NYX_QOI_HASH(PX) ((((PX).r * 3) + ((PX).g * 5) + ((PX).b * 7) + ((PX).a * 11)) & 63)
+
+
+#endif /* __NYX_IMGQOI_H__ */
@@ -2,182 +2,1240 @@
 #include <stdlib.h>
 #include <string.h>
 #include <png.h>
-#include <jpeglib.h>
+#include "img_jpg.h"
+#include "pixel_convert.h"
+#include "img_qoi.h"
+#include "misc/utils.h"
 
 
-static bool _nyx_img_read_png(FILE* fp, uint8_t** out_data, size_t* out_width, size_t* out_height, colorspace_t* out_colorspace);
-static bool _nyx_img_read_jpg(FILE* fp, uint8_t** out_data, size_t* out_width, size_t* out_height, colorspace_t* out_colorspace);
+/* Bytes of the header needed to sniff the type and probe PNG or TGA, PNG IHDR ends at byte 29 */
+#define NYX_IMG_HEADER_SIZE 32
+/* Size of the TGA header */
+#define NYX_TGA_HEADER_SIZE 18
+/* Block read from a TGA or QOI file at a time, their packets are only a few bytes */
+#define NYX_IMG_IO_BUFFER_SIZE ((size_t)64 * 1024)
+
+/* Row decoder */
+struct _nyx_img_row_reader_struct
+{
+	FILE* fp; // NULL when decoding from memory
+	const uint8_t* data; // encoded image in memory
+	size_t data_size;
+	bool mapped; // data is a mapping of the file, unmapped on close
+	size_t data_pos; // next byte of data to read
+	size_t width; // width of the delivered rows
+	size_t height; // number of delivered rows
+	pixel_format_t format; // pixel format of the delivered rows
+	size_t y; // next row to deliver
+	size_t x_skip; // decoded pixels on the left of the area
+	bool direct; // rows are decoded in the destination row
+	uint8_t* row_buffer; // decoded row, when it can't be decoded in the destination row
+	bool (*read_row_fptr)(img_row_reader* reader, uint8_t* row);
+	void (*close_fptr)(img_row_reader* reader);
+	// PNG
+	png_structp png_ptr;
+	png_infop info_ptr;
+	bitmap* full_bm; // whole decoded image, interlaced PNG and bottom-up RLE TGA only
+	size_t y_origin; // first row of the area in full_bm
+	bool to_luma; // replace the decoded colors by their luma
+	// JPEG
+	struct jpeg_decompress_struct cinfo;
+	jpg_error_mgr jerr;
+	pixel_format_t decoded_format; // JPEG, PNG and TGA
+	bool started; // decompression was started
+	// TGA
+	size img_size; // size of the whole image
+	size_t pixels_offset; // first byte of the pixels
+	bool bottom_up; // rows are stored from the bottom of the image
+	bool rle;
+	size_t rle_left; // pixels left in the current packet, packets can span rows (TGA and QOI)
+	bool rle_raw; // current packet holds raw pixels
+	uint8_t rle_pixel[4]; // repeated pixel of the current packet
+	uint8_t* rgba_row; // area row converted to RGBA, to replace its colors by their luma
+	uint8_t* io_buffer; // block of the file, RLE TGA and QOI only
+	size_t io_size;
+	size_t io_pos;
+	// QOI
+	rgba_pixel qoi_index[64]; // previously seen pixels
+	rgba_pixel qoi_prev; // last decoded pixel
+};
+
+
+static bool _nyx_img_read_rows(img_row_reader* reader, bitmap** out_bm);
+static bool _nyx_img_probe(FILE* fp, const uint8_t* data, const size_t data_size, const uint8_t* header, img_info* out_info);
+static bool _nyx_img_probe_jpg(FILE* fp, const uint8_t* data, const size_t data_size, img_info* out_info);
+static img_row_reader* _nyx_img_row_reader_open(FILE* fp, const uint8_t* data, const size_t data_size, const img_read_options* options);
+static bool _nyx_img_png_open(img_row_reader* reader, const img_read_options* options);
+static void _nyx_img_png_read_memory(png_structp png_ptr, png_bytep data, png_size_t length);
+static bool _nyx_img_png_read_row(img_row_reader* reader, uint8_t* row);
+static void _nyx_img_png_store_row(img_row_reader* reader, uint8_t* src, uint8_t* dst);
+static void _nyx_img_png_close(img_row_reader* reader);
+static bool _nyx_img_tga_open(img_row_reader* reader, const img_read_options* options);
+static bool _nyx_img_tga_read_row(img_row_reader* reader, uint8_t* row);
+static void _nyx_img_tga_close(img_row_reader* reader);
+static bool _nyx_img_tga_decode_row(img_row_reader* reader, uint8_t* dst);
+static bool _nyx_img_tga_read_bytes(img_row_reader* reader, uint8_t* dst, const size_t num_bytes);
+static bool _nyx_img_tga_get_format(const uint8_t* header, pixel_format_t* out_format);
+static void _nyx_img_tga_store_row(img_row_reader* reader, const uint8_t* src, uint8_t* dst);
+static bool _nyx_img_qoi_open(img_row_reader* reader, const img_read_options* options);
+static bool _nyx_img_qoi_read_row(img_row_reader* reader, uint8_t* row);
+static void _nyx_img_qoi_close(img_row_reader* reader);
+static bool _nyx_img_qoi_decode_row(img_row_reader* reader, uint8_t* dst);
+static bool _nyx_img_qoi_refill(img_row_reader* reader, const uint8_t** in, size_t* avail);
+static bool _nyx_img_jpg_open(img_row_reader* reader, const img_read_options* options);
+static bool _nyx_img_jpg_read_row(img_row_reader* reader, uint8_t* row);
+static void _nyx_img_jpg_close(img_row_reader* reader);
+static void _nyx_img_jpg_pick_scale(struct jpeg_decompress_struct* cinfo, const size min_size);
+static bool _nyx_img_get_area(const img_read_options* options, const size img_size, rect* out_area);
+static void _nyx_img_store_rgba_row(uint8_t* src, uint8_t* dst, const pixel_format_t format, const size_t width, const bool to_luma);
 static bool _nyx_img_is_type(const uint8_t* header, const img_type_t type);
 
 
-bool nyx_img_read_file(const char* filepath, uint8_t** out_buffer, size_t* out_width, size_t* out_height, colorspace_t* out_colorspace)
+bool nyx_img_read_file(const char* filepath, const img_read_options* options, bitmap** out_bm)
+{
+	return _nyx_img_read_rows(nyx_img_row_reader_open(filepath, options), out_bm);
+}
+
+bool nyx_img_read_memory(const void* data, const size_t data_size, const img_read_options* options, bitmap** out_bm)
+{
+	return _nyx_img_read_rows(nyx_img_row_reader_open_memory(data, data_size, options), out_bm);
+}
+
+/*** Probe ***/
+bool nyx_img_probe_file(const char* filepath, img_info* out_info)
+{
+	if ((!filepath) || (!out_info))
+		return false;
+
+	FILE* fp = fopen(filepath, "rb");
+	if (!fp)
+	{
+		NYX_ERRLOG("[!] failed to open <%s>\n", filepath);
+		return false;
+	}
+	uint8_t header[NYX_IMG_HEADER_SIZE] = {0};
+	fread(header, 1, NYX_IMG_HEADER_SIZE, fp);
+	const bool ret = _nyx_img_probe(fp, NULL, 0, header, out_info);
+	fclose(fp);
+
+	return ret;
+}
+
+bool nyx_img_probe_memory(const void* data, const size_t data_size, img_info* out_info)
+{
+	if ((!data) || (0 == data_size) || (!out_info))
+		return false;
+
+	uint8_t header[NYX_IMG_HEADER_SIZE] = {0};
+	memcpy(header, data, NYX_MIN(data_size, sizeof(header)));
+	return _nyx_img_probe(NULL, (const uint8_t*)data, data_size, header, out_info);
+}
+
+/*** Row reader ***/
+img_row_reader* nyx_img_row_reader_open(const char* filepath, const img_read_options* options)
 {
 	if (!filepath)
 	{
 		NYX_ERRLOG("[!] filepath is NULL\n");
-		return false;
+		return NULL;
+	}
+
+	// map the file once, the decoders then read it like an image in memory without stdio copies
+	size_t map_size = 0;
+	const uint8_t* map = (const uint8_t*)nyx_file_map(filepath, true, &map_size);
+	if (map)
+	{
+		img_row_reader* reader = _nyx_img_row_reader_open(NULL, map, map_size, options);
+		if (!reader)
+		{
+			nyx_file_unmap(map, map_size);
+			return NULL;
+		}
+		reader->mapped = true;
+		return reader;
 	}
 
-	// open file and test for its type
+	// files which can't be mapped are read through stdio
 	FILE* fp = fopen(filepath, "rb");
 	if (!fp)
 	{
 		NYX_ERRLOG("[!] failed to open <%s>\n", filepath);
+		return NULL;
+	}
+
+	return _nyx_img_row_reader_open(fp, NULL, 0, options);
+}
+
+img_row_reader* nyx_img_row_reader_open_memory(const void* data, const size_t data_size, const img_read_options* options)
+{
+	if ((!data) || (0 == data_size))
+	{
+		NYX_ERRLOG("[!] no image data\n");
+		return NULL;
+	}
+
+	return _nyx_img_row_reader_open(NULL, (const uint8_t*)data, data_size, options);
+}
+
+void nyx_img_row_reader_close(img_row_reader* reader)
+{
+	if (!reader)
+		return;
+
+	if (reader->close_fptr)
+		reader->close_fptr(reader);
+	free(reader->row_buffer);
+	if (reader->fp)
+		fclose(reader->fp);
+	if (reader->mapped)
+		nyx_file_unmap(reader->data, reader->data_size);
+	free(reader);
+}
+
+bool nyx_img_row_reader_read_row(img_row_reader* reader, uint8_t* row)
+{
+	if ((!reader) || (!row) || (reader->y >= reader->height))
+		return false;
+
+	if (!reader->read_row_fptr(reader, row))
+		return false;
+	reader->y++;
+
+	return true;
+}
+
+size nyx_img_row_reader_get_size(const img_row_reader* reader)
+{
+	return (reader != NULL) ? (size){.w = reader->width, .h = reader->height} : (size){.w = 0, .h = 0};
+}
+
+pixel_format_t nyx_img_row_reader_get_format(const img_row_reader* reader)
+{
+	return (reader != NULL) ? reader->format : pixel_format_rgba32;
+}
+
+/*** Private ***/
+/**
+ * @brief Decode all the rows of a reader into a bitmap, then close it
+ * @param reader [in] : {OPTIONAL} reader, NULL if it couldn't be opened
+ * @param out_bm [out] : Decoded bitmap, to destroy with nyx_bm_destroy()
+ * @returns true if the image was successfully decoded
+ */
+static bool _nyx_img_read_rows(img_row_reader* reader, bitmap** out_bm)
+{
+	if (!reader)
+		return false;
+
+	bitmap* bm = nyx_bm_alloc_with_format(reader->width, reader->height, reader->format, NULL, NULL);
+	if (!bm)
+	{
+		NYX_ERRLOG("[!] failed to alloc bitmap (%zux%zu)\n", reader->width, reader->height);
+		nyx_img_row_reader_close(reader);
 		return false;
 	}
-	uint8_t header[18];
-	fread(header, 1, 18, fp);
-	// rewind fp
-	fseek(fp, 0, SEEK_SET);
 
-	bool (*load_img_fptr)(FILE*, uint8_t**, size_t*, size_t*, colorspace_t*);
+	// decoders write directly into the bitmap rows
+	uint8_t* buffer = (uint8_t*)bm->buffer;
+	for (size_t y = 0; y < bm->height; y++)
+	{
+		if (!nyx_img_row_reader_read_row(reader, buffer + (y * bm->stride)))
+		{
+			nyx_bm_destroy(bm);
+			nyx_img_row_reader_close(reader);
+			return false;
+		}
+	}
+	nyx_img_row_reader_close(reader);
+
+	*out_bm = bm;
+	return true;
+}
+
+/**
+ * @brief Detect the image type and start decoding, from a file or from memory
+ * @param fp [in] : {OPTIONAL} file, closed with the reader, NULL to decode data
+ * @param data [in] : {OPTIONAL} encoded image when fp is NULL
+ * @param data_size [in] : size of data in bytes
+ * @param options [in] : {OPTIONAL} Decoding options
+ * @returns the reader, NULL if the image can't be decoded
+ */
+static img_row_reader* _nyx_img_row_reader_open(FILE* fp, const uint8_t* data, const size_t data_size, const img_read_options* options)
+{
+	// test for the image type
+	uint8_t header[NYX_IMG_HEADER_SIZE] = {0};
+	if (fp)
+	{
+		fread(header, 1, NYX_IMG_HEADER_SIZE, fp);
+		// rewind fp
+		fseek(fp, 0, SEEK_SET);
+	}
+	else
+		memcpy(header, data, NYX_MIN(data_size, sizeof(header)));
+
+	bool (*open_fptr)(img_row_reader*, const img_read_options*);
 	if (_nyx_img_is_type(header, img_type_png))
 	{
 		// PNG
-		load_img_fptr = _nyx_img_read_png;
+		open_fptr = _nyx_img_png_open;
 	}
 	else if (_nyx_img_is_type(header, img_type_jpg))
 	{
 		// JPEG
-		load_img_fptr = _nyx_img_read_jpg;
+		open_fptr = _nyx_img_jpg_open;
+	}
+	else if (_nyx_img_is_type(header, img_type_qoi))
+	{
+		// QOI
+		open_fptr = _nyx_img_qoi_open;
+	}
+	else if (_nyx_img_is_type(header, img_type_tga))
+	{
+		// TGA, last since it has no signature
+		open_fptr = _nyx_img_tga_open;
 	}
 	else
 	{
 		// unsupported image type
-		NYX_ERRLOG("[!] unsupported image type <%s>\n", filepath);
-		fclose(fp);
+		NYX_ERRLOG("[!] unsupported image type\n");
+		if (fp)
+			fclose(fp);
+		return NULL;
+	}
+
+	img_row_reader* reader = (img_row_reader*)calloc(1, sizeof(img_row_reader));
+	if (!reader)
+	{
+		if (fp)
+			fclose(fp);
+		return NULL;
+	}
+	reader->fp = fp;
+	reader->data = data;
+	reader->data_size = data_size;
+
+	// read the header and set up the decoder, close cleans up whatever was done
+	if (!open_fptr(reader, options))
+	{
+		nyx_img_row_reader_close(reader);
+		return NULL;
+	}
+
+	return reader;
+}
+
+/**
+ * @brief Fill the properties of an image from its header
+ * @param fp [in] : {OPTIONAL} file, JPEG headers are read from it
+ * @param data [in] : {OPTIONAL} encoded image when fp is NULL
+ * @param data_size [in] : size of data in bytes
+ * @param header [in] : first NYX_IMG_HEADER_SIZE bytes of the image, zero padded
+ * @param out_info [out] : image properties
+ * @returns true if the header is valid
+ */
+static bool _nyx_img_probe(FILE* fp, const uint8_t* data, const size_t data_size, const uint8_t* header, img_info* out_info)
+{
+	if (_nyx_img_is_type(header, img_type_png))
+	{
+		// IHDR is always the first chunk : length, type, width, height, bit depth, color type, compression, filter, interlace
+		if (memcmp(header + 12, "IHDR", 4) != 0)
+			return false;
+		const uint8_t color_type = header[25];
+		*out_info = (img_info){
+			.type = img_type_png,
+			.size = {.w = ((size_t)header[16] << 24) | ((size_t)header[17] << 16) | ((size_t)header[18] << 8) | header[19],
+					 .h = ((size_t)header[20] << 24) | ((size_t)header[21] << 16) | ((size_t)header[22] << 8) | header[23]},
+			.colorspace = (color_type & PNG_COLOR_MASK_ALPHA) ? colorspace_rgba : (color_type & PNG_COLOR_MASK_COLOR) ? colorspace_rgb : colorspace_gray,
+			.bit_depth = header[24],
+			.interlaced = (header[28] != PNG_INTERLACE_NONE),
+		};
+		return ((out_info->size.w > 0) && (out_info->size.h > 0));
+	}
+	if (_nyx_img_is_type(header, img_type_jpg))
+		return _nyx_img_probe_jpg(fp, data, data_size, out_info);
+	if (_nyx_img_is_type(header, img_type_qoi))
+	{
+		// big endian width and height, 3 or 4 channels
+		*out_info = (img_info){
+			.type = img_type_qoi,
+			.size = {.w = ((size_t)header[4] << 24) | ((size_t)header[5] << 16) | ((size_t)header[6] << 8) | header[7],
+					 .h = ((size_t)header[8] << 24) | ((size_t)header[9] << 16) | ((size_t)header[10] << 8) | header[11]},
+			.colorspace = (4 == header[12]) ? colorspace_rgba : colorspace_rgb,
+			.bit_depth = 8,
+			.interlaced = false,
+		};
+		return ((out_info->size.w > 0) && (out_info->size.h > 0) && ((3 == header[12]) || (4 == header[12])));
+	}
+	if (_nyx_img_is_type(header, img_type_tga))
+	{
+		// only the TGA the reader decodes
+		pixel_format_t format;
+		if (!_nyx_img_tga_get_format(header, &format))
+			return false;
+		*out_info = (img_info){
+			.type = img_type_tga,
+			.size = {.w = (size_t)header[12] | ((size_t)header[13] << 8), .h = (size_t)header[14] | ((size_t)header[15] << 8)},
+			.colorspace = (pixel_format_bgra32 == format) ? colorspace_rgba : (pixel_format_bgr24 == format) ? colorspace_rgb : colorspace_gray,
+			.bit_depth = 8,
+			.interlaced = false,
+		};
+		return true;
+	}
+
+	return false;
+}
+
+/**
+ * @brief Read a JPEG header up to the first scan
+ * @param fp [in] : {OPTIONAL} file, read from its start
+ * @param data [in] : {OPTIONAL} encoded image when fp is NULL
+ * @param data_size [in] : size of data in bytes
+ * @param out_info [out] : image properties
+ * @returns true if the header is valid
+ */
+static bool _nyx_img_probe_jpg(FILE* fp, const uint8_t* data, const size_t data_size, img_info* out_info)
+{
+	struct jpeg_decompress_struct cinfo;
+	jpg_error_mgr jerr;
+	cinfo.err = nyx_jpg_std_error(&jerr);
+	if (setjmp(jerr.jmp))
+	{
+		jpeg_destroy_decompress(&cinfo);
 		return false;
 	}
 
-	// actually read file and get raw bytes
-	const bool ret = load_img_fptr(fp, out_buffer, out_width, out_height, out_colorspace);
+	jpeg_create_decompress(&cinfo);
+	if (fp)
+	{
+		fseek(fp, 0, SEEK_SET);
+		jpeg_stdio_src(&cinfo, fp);
+	}
+	else
+		jpeg_mem_src(&cinfo, data, (unsigned long)data_size);
+	jpeg_read_header(&cinfo, TRUE);
 
-	// close the file
-	fclose(fp);
+	// the reader outputs RGB for YCbCr and RGB images, it doesn't handle CMYK
+	*out_info = (img_info){
+		.type = img_type_jpg,
+		.size = {.w = cinfo.image_width, .h = cinfo.image_height},
+		.colorspace = (JCS_GRAYSCALE == cinfo.jpeg_color_space) ? colorspace_gray : ((JCS_RGB == cinfo.out_color_space) ? colorspace_rgb : colorspace_unknown),
+		.bit_depth = (uint8_t)cinfo.data_precision,
+		.interlaced = (cinfo.progressive_mode != 0),
+	};
+	jpeg_destroy_decompress(&cinfo);
 
-	return ret;
+	return true;
 }
 
-/*** Private ***/
-static bool _nyx_img_read_png(FILE* fp, uint8_t** out_data, size_t* out_width, size_t* out_height, colorspace_t* out_colorspace)
+static bool _nyx_img_png_open(img_row_reader* reader, const img_read_options* options)
 {
-	png_structp png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-	if (!png_ptr)
+	reader->close_fptr = _nyx_img_png_close;
+	reader->read_row_fptr = _nyx_img_png_read_row;
+	reader->png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	if (!reader->png_ptr)
 	{
 		NYX_ERRLOG("[!] png_create_read_struct()\n");
 		return false;
 	}
 
-	png_infop info_ptr = png_create_info_struct(png_ptr);
-	if (!info_ptr)
+	reader->info_ptr = png_create_info_struct(reader->png_ptr);
+	if (!reader->info_ptr)
 	{
 		NYX_ERRLOG("[!] png_create_info_struct()\n");
-		png_destroy_read_struct(&png_ptr, NULL, NULL);
 		return false;
 	}
 
+	png_structp png_ptr = reader->png_ptr;
+	png_infop info_ptr = reader->info_ptr;
 	if (setjmp(png_jmpbuf(png_ptr)))
 	{
 		// if we get here, we had a problem reading the file
-		NYX_ERRLOG("[!] png_read_png()\n");
-		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+		NYX_ERRLOG("[!] png_read_info()\n");
 		return false;
 	}
 
-    // setup output control if you are using standard C streams
-	png_init_io(png_ptr, fp);
+	// read from the file or from memory
+	if (reader->fp)
+		png_init_io(png_ptr, reader->fp);
+	else
+		png_set_read_fn(png_ptr, reader, _nyx_img_png_read_memory);
 
-    // read png
-	png_read_png(png_ptr, info_ptr, PNG_TRANSFORM_STRIP_16 | PNG_TRANSFORM_PACKING | PNG_TRANSFORM_EXPAND, NULL);
+	// read png header
+	png_read_info(png_ptr, info_ptr);
 
 	png_uint_32 width, height;
 	int bit_depth;
 	int color_space, interlace_type;
 	png_get_IHDR(png_ptr, info_ptr, &width, &height, &bit_depth, &color_space, &interlace_type, NULL, NULL);
-	*out_width = width;
-	*out_height = height;
 
-	// handle colorspace
-	if ((color_space != PNG_COLOR_TYPE_RGBA) && (color_space != PNG_COLOR_TYPE_RGB))
+	// area of the image to keep
+	rect area = (rect){.origin = {0, 0}, .size = {width, height}};
+	if (!_nyx_img_get_area(options, area.size, &area))
+		return false;
+
+	// let libpng output 8-bit RGBA whatever the source colorspace is, or 8-bit gray when a gray image is read as gray8
+	reader->format = (options) ? options->format : pixel_format_rgba32;
+	const bool gray = (0 == (color_space & PNG_COLOR_MASK_COLOR)) && (pixel_format_gray8 == reader->format);
+	reader->decoded_format = (gray) ? pixel_format_gray8 : pixel_format_rgba32;
+	png_set_strip_16(png_ptr);
+	png_set_packing(png_ptr);
+	if (PNG_COLOR_TYPE_PALETTE == color_space)
+		png_set_palette_to_rgb(png_ptr);
+	if ((PNG_COLOR_TYPE_GRAY == color_space) && (bit_depth < 8))
+		png_set_expand_gray_1_2_4_to_8(png_ptr);
+	if (gray)
 	{
-		NYX_DLOG("[!] unsupported colorspace <%d>\n", color_space);
-		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+		// gray8 has no alpha, as when converting
+		if (color_space & PNG_COLOR_MASK_ALPHA)
+			png_set_strip_alpha(png_ptr);
+	}
+	else
+	{
+		if (png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS))
+			png_set_tRNS_to_alpha(png_ptr);
+		if ((PNG_COLOR_TYPE_GRAY == color_space) || (PNG_COLOR_TYPE_GRAY_ALPHA == color_space))
+			png_set_gray_to_rgb(png_ptr);
+		png_set_filler(png_ptr, NYX_MAX_PIXEL_COMPONENT_VALUE, PNG_FILLER_AFTER);
+	}
+	const int num_passes = png_set_interlace_handling(png_ptr);
+	png_read_update_info(png_ptr, info_ptr);
+
+	reader->width = area.size.w;
+	reader->height = area.size.h;
+	reader->x_skip = area.origin.x;
+
+	// PNG has no luma plane to decode alone, the decoded pixels are converted
+	reader->to_luma = (options) && (options->grayscale) && (color_space & PNG_COLOR_MASK_COLOR);
+	const bool partial = ((area.size.w != width) || (area.size.h != height));
+	if (num_passes > 1)
+	{
+		// every pass of an interlaced image touches every row, so decode the whole image first
+		reader->full_bm = nyx_bm_alloc_with_format(width, height, reader->decoded_format, NULL, NULL);
+		if (!reader->full_bm)
+			png_error(png_ptr, "out of memory");
+		uint8_t* buffer = (uint8_t*)reader->full_bm->buffer;
+		for (int pass = 0; pass < num_passes; pass++)
+		{
+			for (size_t y = 0; y < height; y++)
+				png_read_row(png_ptr, buffer + (y * reader->full_bm->stride), NULL);
+		}
+		reader->y_origin = area.origin.y;
+		return true;
+	}
+
+	// decode straight into the destination rows, or through a single row
+	reader->direct = (!partial) && (reader->decoded_format == reader->format) && (!reader->to_luma);
+	if (!reader->direct)
+	{
+		reader->row_buffer = (uint8_t*)malloc(width * nyx_bytes_per_pixel_for_format(reader->decoded_format));
+		if (!reader->row_buffer)
+			png_error(png_ptr, "out of memory");
+	}
+	// rows above the area, the ones below it are never decoded
+	for (size_t y = 0; y < area.origin.y; y++)
+		png_read_row(png_ptr, reader->row_buffer, NULL);
+
+	return true;
+}
+
+static void _nyx_img_png_read_memory(png_structp png_ptr, png_bytep data, png_size_t length)
+{
+	img_row_reader* reader = (img_row_reader*)png_get_io_ptr(png_ptr);
+	if (length > (reader->data_size - reader->data_pos))
+		png_error(png_ptr, "read past the end of the data");
+	memcpy(data, reader->data + reader->data_pos, length);
+	reader->data_pos += length;
+}
+
+static bool _nyx_img_png_read_row(img_row_reader* reader, uint8_t* row)
+{
+	if (reader->full_bm)
+	{
+		uint8_t* src = (uint8_t*)reader->full_bm->buffer + ((reader->y_origin + reader->y) * reader->full_bm->stride) + (reader->x_skip * nyx_bytes_per_pixel_for_format(reader->decoded_format));
+		_nyx_img_png_store_row(reader, src, row);
+		return true;
+	}
+
+	if (setjmp(png_jmpbuf(reader->png_ptr)))
+	{
+		NYX_ERRLOG("[!] png_read_row()\n");
 		return false;
 	}
-	switch (color_space)
+	if (reader->direct)
 	{
-		case PNG_COLOR_TYPE_RGB:
-			*out_colorspace = colorspace_rgb;
-			break;
-		case PNG_COLOR_TYPE_RGBA:
-			*out_colorspace = colorspace_rgba;
-			break;
-		default:
-			*out_colorspace = colorspace_unknown;
-			break;
+		png_read_row(reader->png_ptr, row, NULL);
+		return true;
+	}
+	png_read_row(reader->png_ptr, reader->row_buffer, NULL);
+	_nyx_img_png_store_row(reader, reader->row_buffer + (reader->x_skip * nyx_bytes_per_pixel_for_format(reader->decoded_format)), row);
+
+	return true;
+}
+
+static void _nyx_img_png_store_row(img_row_reader* reader, uint8_t* src, uint8_t* dst)
+{
+	// only color images are replaced by their luma, they are decoded as RGBA
+	if (pixel_format_gray8 == reader->decoded_format)
+		nyx_px_convert_row(src, pixel_format_gray8, dst, reader->format, reader->width);
+	else
+		_nyx_img_store_rgba_row(src, dst, reader->format, reader->width, reader->to_luma);
+}
+
+static void _nyx_img_png_close(img_row_reader* reader)
+{
+	nyx_bm_destroy(reader->full_bm);
+	if (reader->png_ptr)
+		png_destroy_read_struct(&reader->png_ptr, (reader->info_ptr) ? &reader->info_ptr : NULL, NULL);
+}
+
+static bool _nyx_img_tga_open(img_row_reader* reader, const img_read_options* options)
+{
+	reader->close_fptr = _nyx_img_tga_close;
+	reader->read_row_fptr = _nyx_img_tga_read_row;
+
+	uint8_t header[NYX_TGA_HEADER_SIZE];
+	if (reader->fp)
+	{
+		if (fread(header, 1, NYX_TGA_HEADER_SIZE, reader->fp) != NYX_TGA_HEADER_SIZE)
+			return false;
+	}
+	else
+	{
+		if (reader->data_size < NYX_TGA_HEADER_SIZE)
+			return false;
+		memcpy(header, reader->data, NYX_TGA_HEADER_SIZE);
+	}
+
+	if (!_nyx_img_tga_get_format(header, &reader->decoded_format))
+	{
+		NYX_ERRLOG("[!] unsupported TGA (type %u, %u bits, descriptor 0x%02x)\n", header[2], header[16], header[17]);
+		return false;
+	}
+	reader->rle = (header[2] & 8) != 0;
+	reader->bottom_up = (0 == (header[17] & 0x20));
+	reader->img_size = (size){.w = (size_t)header[12] | ((size_t)header[13] << 8), .h = (size_t)header[14] | ((size_t)header[15] << 8)};
+	// image ID then the color map a true color image may still carry, its entries are stored in whole bytes
+	const size_t cmap_size = (header[1]) ? (((size_t)header[5] | ((size_t)header[6] << 8)) * ((header[7] + 7U) / 8U)) : 0;
+	reader->pixels_offset = NYX_TGA_HEADER_SIZE + header[0] + cmap_size;
+	if ((!reader->fp) && (reader->data_size < reader->pixels_offset))
+	{
+		NYX_ERRLOG("[!] truncated TGA\n");
+		return false;
 	}
 
-	// create buffer for the raw bytes
-	const png_size_t row_bytes = png_get_rowbytes(png_ptr, info_ptr);
-	*out_data = (uint8_t*)malloc(sizeof(uint8_t) * row_bytes * height);
-	png_bytepp row_pointers = png_get_rows(png_ptr, info_ptr);
-	for (size_t i = 0; i < height; i++)
-		memcpy(*out_data + (row_bytes * i), row_pointers[i], row_bytes);
+	// area of the image to keep
+	rect area = (rect){.origin = {0, 0}, .size = reader->img_size};
+	if (!_nyx_img_get_area(options, area.size, &area))
+		return false;
+	reader->width = area.size.w;
+	reader->height = area.size.h;
+	reader->format = (options) ? options->format : pixel_format_rgba32;
+	// converting to gray8 already gives the luma
+	reader->to_luma = (options) && (options->grayscale) && (reader->decoded_format != pixel_format_gray8) && (reader->format != pixel_format_gray8);
+	reader->x_skip = area.origin.x;
+	reader->y_origin = area.origin.y;
+	if (reader->to_luma)
+	{
+		reader->rgba_row = (uint8_t*)malloc(reader->width * 4);
+		if (!reader->rgba_row)
+			return false;
+	}
 
-    // cleanup
-	png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+	const size_t decoded_bpp = nyx_bytes_per_pixel_for_format(reader->decoded_format);
+	const size_t row_size = reader->img_size.w * decoded_bpp;
+	if (!reader->rle)
+	{
+		// every row is at a known offset, only the area is read
+		if ((!reader->fp) && (reader->data_size < reader->pixels_offset + (row_size * reader->img_size.h)))
+		{
+			NYX_ERRLOG("[!] truncated TGA\n");
+			return false;
+		}
+		reader->direct = (reader->format == reader->decoded_format) && (!reader->to_luma);
+		if (!reader->direct)
+		{
+			reader->row_buffer = (uint8_t*)malloc(reader->width * decoded_bpp);
+			if (!reader->row_buffer)
+				return false;
+		}
+		return true;
+	}
+
+	// RLE rows are decoded one after the other from the first stored one
+	reader->data_pos = reader->pixels_offset;
+	if (reader->fp)
+	{
+		if (fseek(reader->fp, (long)reader->pixels_offset, SEEK_SET) != 0)
+			return false;
+		reader->io_buffer = (uint8_t*)malloc(NYX_IMG_IO_BUFFER_SIZE);
+		if (!reader->io_buffer)
+			return false;
+	}
+	if (reader->bottom_up)
+	{
+		// the first stored row is the last one, so decode the whole image first
+		reader->full_bm = nyx_bm_alloc_with_format(reader->img_size.w, reader->img_size.h, reader->decoded_format, NULL, NULL);
+		if (!reader->full_bm)
+			return false;
+		for (size_t y = reader->img_size.h; y > 0; y--)
+		{
+			if (!_nyx_img_tga_decode_row(reader, (uint8_t*)reader->full_bm->buffer + ((y - 1) * reader->full_bm->stride)))
+				return false;
+		}
+		return true;
+	}
+	reader->direct = (reader->format == reader->decoded_format) && (!reader->to_luma) && (reader->width == reader->img_size.w);
+	reader->row_buffer = (uint8_t*)malloc(row_size);
+	if (!reader->row_buffer)
+		return false;
+	// rows above the area, the ones below it are never decoded
+	for (size_t y = 0; y < area.origin.y; y++)
+	{
+		if (!_nyx_img_tga_decode_row(reader, reader->row_buffer))
+			return false;
+	}
 
 	return true;
 }
 
-static bool _nyx_img_read_jpg(FILE* fp, uint8_t** out_data, size_t* out_width, size_t* out_height, colorspace_t* out_colorspace)
+static bool _nyx_img_tga_read_row(img_row_reader* reader, uint8_t* row)
 {
-	struct jpeg_decompress_struct cinfo;
-	struct jpeg_error_mgr jerr;
-	JSAMPROW row_pointer[1];
+	const size_t decoded_bpp = nyx_bytes_per_pixel_for_format(reader->decoded_format);
+	if (reader->full_bm)
+	{
+		const uint8_t* src = (const uint8_t*)reader->full_bm->buffer + ((reader->y_origin + reader->y) * reader->full_bm->stride) + (reader->x_skip * decoded_bpp);
+		_nyx_img_tga_store_row(reader, src, row);
+		return true;
+	}
 
-	cinfo.err = jpeg_std_error(&jerr);
+	if (reader->rle)
+	{
+		uint8_t* decoded_row = (reader->direct) ? row : reader->row_buffer;
+		if (!_nyx_img_tga_decode_row(reader, decoded_row))
+			return false;
+		if (!reader->direct)
+			_nyx_img_tga_store_row(reader, decoded_row + (reader->x_skip * decoded_bpp), row);
+		return true;
+	}
 
-	// decompress jpeg
-	jpeg_create_decompress(&cinfo);
-	jpeg_stdio_src(&cinfo, fp);
-	jpeg_read_header(&cinfo, TRUE);
-	jpeg_start_decompress(&cinfo);
+	// uncompressed, read the area part of the row straight from its offset
+	const size_t y = reader->y_origin + reader->y;
+	const size_t stored_y = (reader->bottom_up) ? (reader->img_size.h - 1 - y) : y;
+	const size_t offset = reader->pixels_offset + (((stored_y * reader->img_size.w) + reader->x_skip) * decoded_bpp);
+	const size_t num_bytes = reader->width * decoded_bpp;
+	uint8_t* decoded_row = (reader->direct) ? row : reader->row_buffer;
+	if (reader->fp)
+	{
+		if ((fseek(reader->fp, (long)offset, SEEK_SET) != 0) || (fread(decoded_row, 1, num_bytes, reader->fp) != num_bytes))
+		{
+			NYX_ERRLOG("[!] truncated TGA\n");
+			return false;
+		}
+	}
+	else
+		memcpy(decoded_row, reader->data + offset, num_bytes);
+	if (!reader->direct)
+		_nyx_img_tga_store_row(reader, decoded_row, row);
+
+	return true;
+}
+
+static void _nyx_img_tga_close(img_row_reader* reader)
+{
+	nyx_bm_destroy(reader->full_bm);
+	free(reader->rgba_row);
+	free(reader->io_buffer);
+}
+
+/**
+ * @brief Decode the next stored row of a RLE TGA
+ * @param reader [in] : reader
+ * @param dst [out] : decoded pixels, a whole row
+ * @returns false if the data is truncated
+ */
+static bool _nyx_img_tga_decode_row(img_row_reader* reader, uint8_t* dst)
+{
+	const size_t bpp = nyx_bytes_per_pixel_for_format(reader->decoded_format);
+	size_t x = 0;
+	while (x < reader->img_size.w)
+	{
+		if (0 == reader->rle_left)
+		{
+			// packet header : repeat flag and number of pixels - 1
+			uint8_t packet;
+			if (!_nyx_img_tga_read_bytes(reader, &packet, 1))
+				return false;
+			reader->rle_left = (size_t)(packet & 0x7F) + 1;
+			reader->rle_raw = (0 == (packet & 0x80));
+			if ((!reader->rle_raw) && (!_nyx_img_tga_read_bytes(reader, reader->rle_pixel, bpp)))
+				return false;
+		}
+		const size_t count = NYX_MIN(reader->rle_left, reader->img_size.w - x);
+		uint8_t* px = dst + (x * bpp);
+		if (reader->rle_raw)
+		{
+			if (!_nyx_img_tga_read_bytes(reader, px, count * bpp))
+				return false;
+		}
+		else
+		{
+			for (size_t i = 0; i < count; i++)
+				memcpy(px + (i * bpp), reader->rle_pixel, bpp);
+		}
+		x += count;
+		reader->rle_left -= count;
+	}
+	return true;
+}
+
+/**
+ * @brief Read the next bytes of a RLE TGA, through the block buffer for a file
+ * @param reader [in] : reader
+ * @param dst [out] : bytes
+ * @param num_bytes [in] : number of bytes to read
+ * @returns false if the data is truncated
+ */
+static bool _nyx_img_tga_read_bytes(img_row_reader* reader, uint8_t* dst, const size_t num_bytes)
+{
+	if (!reader->fp)
+	{
+		if (num_bytes > (reader->data_size - reader->data_pos))
+		{
+			NYX_ERRLOG("[!] truncated TGA\n");
+			return false;
+		}
+		memcpy(dst, reader->data + reader->data_pos, num_bytes);
+		reader->data_pos += num_bytes;
+		return true;
+	}
+
+	size_t left = num_bytes;
+	while (left > 0)
+	{
+		if (reader->io_pos == reader->io_size)
+		{
+			reader->io_size = fread(reader->io_buffer, 1, NYX_IMG_IO_BUFFER_SIZE, reader->fp);
+			reader->io_pos = 0;
+			if (0 == reader->io_size)
+			{
+				NYX_ERRLOG("[!] truncated TGA\n");
+				return false;
+			}
+		}
+		const size_t n = NYX_MIN(left, reader->io_size - reader->io_pos);
+		memcpy(dst, reader->io_buffer + reader->io_pos, n);
+		reader->io_pos += n;
+		dst += n;
+		left -= n;
+	}
+	return true;
+}
+
+/**
+ * @brief Store the area part of a decoded TGA row in a destination row
+ * @param reader [in] : reader
+ * @param src [in] : decoded pixels of the area
+ * @param dst [out] : destination row
+ */
+/**
+ * @brief Get the pixel format of a TGA from its header
+ * @param header [in] : TGA header
+ * @param out_format [out] : format of the stored pixels
+ * @returns false unless the image is 24 or 32-bit true color or 8-bit gray stored left to right, color mapped and 16-bit pixels aren't supported
+ */
+static bool _nyx_img_tga_get_format(const uint8_t* header, pixel_format_t* out_format)
+{
+	const uint8_t image_type = header[2] & 7;
+	const uint8_t bpp = header[16];
+	if (header[17] & 0x10)
+		return false;
+	if ((2 == image_type) && ((24 == bpp) || (32 == bpp)))
+		*out_format = (32 == bpp) ? pixel_format_bgra32 : pixel_format_bgr24;
+	else if ((3 == image_type) && (8 == bpp))
+		*out_format = pixel_format_gray8;
+	else
+		return false;
+
+	return true;
+}
+
+static void _nyx_img_tga_store_row(img_row_reader* reader, const uint8_t* src, uint8_t* dst)
+{
+	if (!reader->to_luma)
+	{
+		nyx_px_convert_row(src, reader->decoded_format, dst, reader->format, reader->width);
+		return;
+	}
+
+	// luma goes through RGBA to keep alpha
+	nyx_px_convert_row(src, reader->decoded_format, reader->rgba_row, pixel_format_rgba32, reader->width);
+	_nyx_img_store_rgba_row(reader->rgba_row, dst, reader->format, reader->width, true);
+}
+
+static bool _nyx_img_qoi_open(img_row_reader* reader, const img_read_options* options)
+{
+	reader->close_fptr = _nyx_img_qoi_close;
+	reader->read_row_fptr = _nyx_img_qoi_read_row;
+
+	uint8_t header[NYX_QOI_HEADER_SIZE];
+	if (reader->fp)
+	{
+		if (fread(header, 1, NYX_QOI_HEADER_SIZE, reader->fp) != NYX_QOI_HEADER_SIZE)
+			return false;
+	}
+	else
+	{
+		if (reader->data_size < NYX_QOI_HEADER_SIZE)
+			return false;
+		memcpy(header, reader->data, NYX_QOI_HEADER_SIZE);
+	}
+
+	// big endian width and height, 3 or 4 channels, the pixels are decoded as RGBA either way
+	reader->img_size = (size){.w = ((size_t)header[4] << 24) | ((size_t)header[5] << 16) | ((size_t)header[6] << 8) | header[7],
+							  .h = ((size_t)header[8] << 24) | ((size_t)header[9] << 16) | ((size_t)header[10] << 8) | header[11]};
+	if (((header[12] != 3) && (header[12] != 4)) || (header[13] > 1) || (0 == reader->img_size.w) || (0 == reader->img_size.h)
+		|| (reader->img_size.w > NYX_QOI_MAX_PIXELS / reader->img_size.h))
+	{
+		NYX_ERRLOG("[!] unsupported QOI (%zux%zu, %u channels)\n", reader->img_size.w, reader->img_size.h, header[12]);
+		return false;
+	}
+	reader->decoded_format = pixel_format_rgba32;
+	reader->qoi_prev = (rgba_pixel){.r = 0, .g = 0, .b = 0, .a = 255};
+
+	// area of the image to keep
+	rect area = (rect){.origin = {0, 0}, .size = reader->img_size};
+	if (!_nyx_img_get_area(options, area.size, &area))
+		return false;
+	reader->width = area.size.w;
+	reader->height = area.size.h;
+	reader->format = (options) ? options->format : pixel_format_rgba32;
+	reader->to_luma = (options) && (options->grayscale);
+	reader->x_skip = area.origin.x;
+	reader->direct = (reader->format == pixel_format_rgba32) && (!reader->to_luma) && (reader->width == reader->img_size.w);
+	reader->row_buffer = (uint8_t*)malloc(reader->img_size.w * 4);
+	if (!reader->row_buffer)
+		return false;
+
+	// chunks are decoded one after the other
+	reader->data_pos = NYX_QOI_HEADER_SIZE;
+	if (reader->fp)
+	{
+		reader->io_buffer = (uint8_t*)malloc(NYX_IMG_IO_BUFFER_SIZE);
+		if (!reader->io_buffer)
+			return false;
+	}
+	// rows above the area, the ones below it are never decoded
+	for (size_t y = 0; y < area.origin.y; y++)
+	{
+		if (!_nyx_img_qoi_decode_row(reader, reader->row_buffer))
+			return false;
+	}
+
+	return true;
+}
+
+static bool _nyx_img_qoi_read_row(img_row_reader* reader, uint8_t* row)
+{
+	uint8_t* decoded_row = (reader->direct) ? row : reader->row_buffer;
+	if (!_nyx_img_qoi_decode_row(reader, decoded_row))
+		return false;
+	if (!reader->direct)
+		_nyx_img_store_rgba_row(decoded_row + (reader->x_skip * 4), row, reader->format, reader->width, reader->to_luma);
+
+	return true;
+}
+
+static void _nyx_img_qoi_close(img_row_reader* reader)
+{
+	free(reader->io_buffer);
+}
+
+/**
+ * @brief Decode the next row of a QOI image, the pixel table, the last pixel and the pending run carry over to the next row
+ * @param reader [in] : reader
+ * @param dst [out] : decoded RGBA pixels, a whole row
+ * @returns false if the data is truncated
+ */
+static bool _nyx_img_qoi_decode_row(img_row_reader* reader, uint8_t* dst)
+{
+	const uint8_t* in;
+	size_t avail;
+	if (reader->fp)
+	{
+		in = reader->io_buffer + reader->io_pos;
+		avail = reader->io_size - reader->io_pos;
+	}
+	else
+	{
+		in = reader->data + reader->data_pos;
+		avail = reader->data_size - reader->data_pos;
+	}
+
+	rgba_pixel* index = reader->qoi_index;
+	rgba_pixel px = reader->qoi_prev;
+	bool ret = true;
+	size_t x = 0;
+	while (x < reader->img_size.w)
+	{
+		if (reader->rle_left > 0)
+		{
+			const size_t count = NYX_MIN(reader->rle_left, reader->img_size.w - x);
+			for (size_t i = 0; i < count; i++)
+				memcpy(dst + ((x + i) * 4), &px, 4);
+			x += count;
+			reader->rle_left -= count;
+			continue;
+		}
+
+		// a valid stream always has a whole chunk left, it ends with the end marker
+		if ((avail < NYX_QOI_MAX_CHUNK_SIZE) && (!_nyx_img_qoi_refill(reader, &in, &avail)))
+		{
+			NYX_ERRLOG("[!] truncated QOI\n");
+			ret = false;
+			break;
+		}
+		const uint8_t* chunk = in;
+		const uint8_t tag = chunk[0];
+		size_t chunk_size = 1;
+		if (NYX_QOI_OP_RGB == tag)
+		{
+			px.r = chunk[1];
+			px.g = chunk[2];
+			px.b = chunk[3];
+			chunk_size = 4;
+		}
+		else if (NYX_QOI_OP_RGBA == tag)
+		{
+			px = (rgba_pixel){.r = chunk[1], .g = chunk[2], .b = chunk[3], .a = chunk[4]};
+			chunk_size = 5;
+		}
+		else
+		{
+			switch (tag & NYX_QOI_MASK_2)
+			{
+				case NYX_QOI_OP_INDEX:
+					px = index[tag];
+					break;
+				case NYX_QOI_OP_DIFF:
+					px.r += (uint8_t)(((tag >> 4) & 3) - 2);
+					px.g += (uint8_t)(((tag >> 2) & 3) - 2);
+					px.b += (uint8_t)((tag & 3) - 2);
+					break;
+				case NYX_QOI_OP_LUMA:
+				{
+					const int dg = (tag & 0x3F) - 32;
+					px.r += (uint8_t)(dg - 8 + (chunk[1] >> 4));
+					px.g += (uint8_t)dg;
+					px.b += (uint8_t)(dg - 8 + (chunk[1] & 0x0F));
+					chunk_size = 2;
+					break;
+				}
+				default:
+					// run of the last pixel, including this one
+					reader->rle_left = (size_t)(tag & 0x3F) + 1;
+					break;
+			}
+		}
+		in += chunk_size;
+		avail -= chunk_size;
+		index[NYX_QOI_HASH(px)] = px;
+		if (reader->rle_left > 0)
+			continue;
+		memcpy(dst + (x * 4), &px, 4);
+		x++;
+	}
+
+	// keep the position in the data
+	reader->qoi_prev = px;
+	if (reader->fp)
+	{
+		reader->io_pos = (size_t)(in - reader->io_buffer);
+		reader->io_size = reader->io_pos + avail;
+	}
+	else
+		reader->data_pos = (size_t)(in - reader->data);
+
+	return ret;
+}
+
+/**
+ * @brief Move the unread bytes of the QOI block buffer to its start and read the next bytes of the file after them
+ * @param reader [in] : reader
+ * @param in [in,out] : next byte to decode
+ * @param avail [in,out] : bytes left after in
+ * @returns false if less than a whole chunk is left
+ */
+static bool _nyx_img_qoi_refill(img_row_reader* reader, const uint8_t** in, size_t* avail)
+{
+	if (!reader->fp)
+		return false;
+
+	memmove(reader->io_buffer, *in, *avail);
+	*avail += fread(reader->io_buffer + *avail, 1, NYX_IMG_IO_BUFFER_SIZE - *avail, reader->fp);
+	*in = reader->io_buffer;
+	return (*avail >= NYX_QOI_MAX_CHUNK_SIZE);
+}
+
+static bool _nyx_img_jpg_open(img_row_reader* reader, const img_read_options* options)
+{
+	struct jpeg_decompress_struct* cinfo = &reader->cinfo;
+	cinfo->err = nyx_jpg_std_error(&reader->jerr);
+	reader->close_fptr = _nyx_img_jpg_close;
+	reader->read_row_fptr = _nyx_img_jpg_read_row;
+	if (setjmp(reader->jerr.jmp))
+		return false;
+
+	// decompress jpeg, from the file or from memory
+	jpeg_create_decompress(cinfo);
+	if (reader->fp)
+		jpeg_stdio_src(cinfo, reader->fp);
+	else
+		jpeg_mem_src(cinfo, reader->data, (unsigned long)reader->data_size);
+	jpeg_read_header(cinfo, TRUE);
 
 	// handle colorspace
-	if (cinfo.out_color_space != JCS_RGB)
+	if ((cinfo->out_color_space != JCS_RGB) && (cinfo->out_color_space != JCS_GRAYSCALE))
 	{
-		NYX_DLOG("[!] unsupported colorspace <%d>\n", cinfo.out_color_space);
-		jpeg_destroy_decompress(&cinfo);
+		NYX_DLOG("[!] unsupported colorspace <%d>\n", cinfo->out_color_space);
 		return false;
 	}
+	const pixel_format_t format = (options) ? options->format : pixel_format_rgba32;
+	const pixel_format_t decoded_format = nyx_jpg_set_out_format(cinfo, format, (options) && (options->grayscale));
+	// downscale in the DCT domain when a smaller size is enough
+	if ((options) && ((options->min_size.w > 0) || (options->min_size.h > 0)))
+		_nyx_img_jpg_pick_scale(cinfo, options->min_size);
+	jpeg_start_decompress(cinfo);
+	reader->started = true;
+
+	// area of the (scaled) image to keep
+	rect area = (rect){.origin = {0, 0}, .size = {cinfo->output_width, cinfo->output_height}};
+	if (!_nyx_img_get_area(options, area.size, &area))
+		return false;
+	reader->width = area.size.w;
+	reader->height = area.size.h;
+	reader->format = format;
+	reader->decoded_format = decoded_format;
 
-	// allocate memory to hold the uncompressed image
-	*out_width = cinfo.output_width;
-	*out_height = cinfo.output_height;
-	*out_colorspace = (cinfo.out_color_components == 3) ? colorspace_rgb : ((cinfo.out_color_components == 4) ? colorspace_rgba : colorspace_unknown);
-	const size_t size = cinfo.output_width * cinfo.output_height * (size_t)cinfo.num_components;
-	*out_data = (uint8_t*)malloc(sizeof(uint8_t) * size);
-	// read the jpeg into the raw buffer
-	row_pointer[0] = (uint8_t*)malloc(cinfo.output_width * (size_t)cinfo.num_components);
-	// read one scan line at a time
-	size_t location = 0;
-	const size_t stride = cinfo.image_width * (size_t)cinfo.num_components;
-	while (cinfo.output_scanline < cinfo.image_height)
+	// only decode the iMCU columns and rows covering the area
+	reader->x_skip = area.origin.x;
+#ifdef LIBJPEG_TURBO_VERSION
+	if (area.size.w < cinfo->output_width)
 	{
-		jpeg_read_scanlines(&cinfo, row_pointer, 1);
-		memcpy((*out_data) + location, row_pointer[0], stride);
-		location += stride;
+		// keep one more column on each side, fancy upsampling needs the neighbouring chroma samples
+		const size_t x_begin = (area.origin.x > 0) ? (area.origin.x - 1) : 0;
+		const size_t x_end = NYX_MIN(NYX_RECT_GET_MAX_X(area) + 1, (size_t)cinfo->output_width);
+		JDIMENSION xoffset = (JDIMENSION)x_begin, crop_width = (JDIMENSION)(x_end - x_begin);
+		jpeg_crop_scanline(cinfo, &xoffset, &crop_width);
+		reader->x_skip = area.origin.x - xoffset;
 	}
+	if (area.origin.y > 0)
+		(void)jpeg_skip_scanlines(cinfo, (JDIMENSION)area.origin.y);
+#endif
 
-	// cleanup
-	jpeg_finish_decompress(&cinfo);
-	jpeg_destroy_decompress(&cinfo);
-	free(row_pointer[0]);
+	// decode straight into the destination row (or at its end, to convert it in place) unless
+	// the area isn't aligned on iMCU columns or the decoded pixels are larger
+	const size_t decoded_bpp = nyx_bytes_per_pixel_for_format(decoded_format);
+	const size_t bpp = nyx_bytes_per_pixel_for_format(format);
+	reader->direct = (cinfo->output_width == reader->width) && (decoded_bpp <= bpp);
+	if ((!reader->direct) || (cinfo->output_scanline < area.origin.y))
+	{
+		reader->row_buffer = (uint8_t*)malloc((size_t)cinfo->output_width * (size_t)cinfo->output_components);
+		if (!reader->row_buffer)
+		{
+			NYX_ERRLOG("[!] failed to alloc row buffer\n");
+			return false;
+		}
+	}
+	// rows above the area which couldn't be skipped
+	while (cinfo->output_scanline < area.origin.y)
+		(void)jpeg_read_scanlines(cinfo, (JSAMPROW[1]){reader->row_buffer}, 1);
+
+	return true;
+}
+
+static bool _nyx_img_jpg_read_row(img_row_reader* reader, uint8_t* row)
+{
+	const size_t decoded_bpp = nyx_bytes_per_pixel_for_format(reader->decoded_format);
+	const size_t bpp = nyx_bytes_per_pixel_for_format(reader->format);
+	uint8_t* decoded_row = (reader->direct) ? (row + (reader->width * (bpp - decoded_bpp))) : reader->row_buffer;
+	if (setjmp(reader->jerr.jmp))
+		return false;
+	if (jpeg_read_scanlines(&reader->cinfo, (JSAMPROW[1]){decoded_row}, 1) != 1)
+		return false;
+	nyx_px_convert_row(decoded_row + (reader->x_skip * decoded_bpp), reader->decoded_format, row, reader->format, reader->width);
+
+	return true;
+}
+
+static void _nyx_img_jpg_close(img_row_reader* reader)
+{
+	// the scanlines below the area are never decoded
+	struct jpeg_decompress_struct* cinfo = &reader->cinfo;
+	if (0 == setjmp(reader->jerr.jmp))
+	{
+		if ((reader->started) && (cinfo->output_scanline >= cinfo->output_height))
+			jpeg_finish_decompress(cinfo);
+		else
+			jpeg_abort_decompress(cinfo);
+	}
+	jpeg_destroy_decompress(cinfo);
+}
 
+/**
+ * @brief Store a decoded RGBA row in a destination row
+ * @param src [in] : decoded RGBA pixels, modified when to_luma is set
+ * @param dst [out] : destination row
+ * @param format [in] : pixel format of dst
+ * @param width [in] : number of pixels
+ * @param to_luma [in] : replace the colors by their luma
+ */
+static void _nyx_img_store_rgba_row(uint8_t* src, uint8_t* dst, const pixel_format_t format, const size_t width, const bool to_luma)
+{
+	if (to_luma)
+		nyx_px_rgba_to_luma_row(src, src, width);
+	nyx_px_convert_row(src, pixel_format_rgba32, dst, format, width);
+}
+
+/**
+ * @brief Get the area of the decoded image to keep
+ * @param options [in] : {OPTIONAL} Decoding options
+ * @param img_size [in] : Size of the decoded image
+ * @param out_area [out] : Area to keep, the whole image if there is no region of interest
+ * @returns false if the region of interest doesn't fit in the image
+ */
+static bool _nyx_img_get_area(const img_read_options* options, const size img_size, rect* out_area)
+{
+	*out_area = (rect){.origin = {0, 0}, .size = img_size};
+	if ((!options) || (0 == options->roi.size.w) || (0 == options->roi.size.h))
+		return true;
+
+	if ((NYX_RECT_GET_MAX_X(options->roi) > img_size.w) || (NYX_RECT_GET_MAX_Y(options->roi) > img_size.h))
+	{
+		NYX_ERRLOG("[!] region of interest is outside of the image (%zux%zu)\n", img_size.w, img_size.h);
+		return false;
+	}
+	*out_area = options->roi;
 	return true;
 }
 
+/**
+ * @brief Select the smallest DCT scaling (M/8) whose output is still at least min_size
+ * @param cinfo [in] : JPEG decompressor, header must have been read
+ * @param min_size [in] : Minimum output size
+ */
+static void _nyx_img_jpg_pick_scale(struct jpeg_decompress_struct* cinfo, const size min_size)
+{
+	cinfo->scale_denom = 8;
+	for (unsigned int num = 1; num <= 8; num++)
+	{
+		// libjpeg rounds unsupported ratios up, so check the actual output dimensions
+		cinfo->scale_num = num;
+		jpeg_calc_output_dimensions(cinfo);
+		if ((cinfo->output_width >= min_size.w) && (cinfo->output_height >= min_size.h))
+			break;
+	}
+	NYX_DLOG("[+] jpeg DCT scaling %u/%u : %ux%u -> %ux%u\n", cinfo->scale_num, cinfo->scale_denom, cinfo->image_width, cinfo->image_height, cinfo->output_width, cinfo->output_height);
+}
+
 /**
  * @brief Verify if a file corresponds to the given type by looking its header
  * @param header [in] : Image header
@@ -198,9 +1256,21 @@ static bool _nyx_img_is_type(const uint8_t* header, const img_type_t type)
 		case img_type_jpg:
 			ret = ((header[0] == 0xFF) && (header[1] == 0xD8));
 			break;
+		case img_type_qoi:
+			ret = (0 == memcmp(header, "qoif", 4));
+			break;
 		case img_type_tga:
-			ret = false;
+		{
+			// no signature, check that every field of the header has a sensible value
+			const uint8_t image_type = header[2] & ~8; // RLE flag
+			const uint8_t bpp = header[16];
+			const bool color_mapped = (1 == image_type);
+			// a true color image may carry a color map it doesn't use
+			ret = ((color_mapped) ? (1 == header[1]) : (header[1] <= 1)) && ((1 == image_type) || (2 == image_type) || (3 == image_type)) && ((header[2] & ~0x0B) == 0)
+				&& ((8 == bpp) || (15 == bpp) || (16 == bpp) || (24 == bpp) || (32 == bpp)) && (0 == (header[17] & 0xC0))
+				&& ((header[12] | header[13]) != 0) && ((header[14] | header[15]) != 0);
 			break;
+		}
 		default:
 			ret = false;
 			break;
@@ -4,16 +4,112 @@
 #include "bitmap.h"
 
 
+/* Decoding options */
+typedef struct _nyx_img_read_options_struct
+{
+	size min_size; // decode at the smallest size which is at least min_size (JPEG DCT scaling), {0, 0} for full size
+	rect roi; // only decode this region, in the coordinates of the (scaled) image, empty size for the whole image
+	bool grayscale; // decode luma only, JPEG skip chroma upsampling and color conversion (BT.601 luma)
+	pixel_format_t format; // pixel format of the bitmap, gray8 implies grayscale
+} img_read_options;
+
+/* Image properties, read from its header */
+typedef struct _nyx_img_info_struct
+{
+	img_type_t type;
+	size size; // full size of the image
+	colorspace_t colorspace; // gray, rgb or rgba, as decoded (gray + alpha is rgba), unknown for colorspaces the reader doesn't support
+	uint8_t bit_depth; // bits per component
+	bool interlaced; // PNG Adam7 or progressive JPEG
+} img_info;
+
 /**
- * @brief Attempt to read and load an image file
+ * @brief Attempt to read an image file and decode it into a bitmap, pixels are decoded straight into the bitmap buffer
  * @param filepath [in] : Path of the file
- * @param out_buffer [out] : Raw image bytes
- * @param out_width [out] : Image width
- * @param out_height [out] : Image height
- * @param out_colorspace [out] : Image colorspace
+ * @param options [in] : {OPTIONAL} Decoding options, NULL for defaults
+ * @param out_bm [out] : Decoded bitmap, to destroy with nyx_bm_destroy()
  * @returns true if the file was successfully read
  */
-bool nyx_img_read_file(const char* filepath, uint8_t** out_buffer, size_t* out_width, size_t* out_height, colorspace_t* out_colorspace);
+bool nyx_img_read_file(const char* filepath, const img_read_options* options, bitmap** out_bm);
+
+/**
+ * @brief Attempt to decode an image held in memory into a bitmap
+ * @param data [in] : encoded image
+ * @param data_size [in] : size of data in bytes
+ * @param options [in] : {OPTIONAL} Decoding options, NULL for defaults
+ * @param out_bm [out] : Decoded bitmap, to destroy with nyx_bm_destroy()
+ * @returns true if the image was successfully decoded
+ */
+bool nyx_img_read_memory(const void* data, const size_t data_size, const img_read_options* options, bitmap** out_bm);
+
+/*** Probe ***/
+
+/**
+ * @brief Read the properties of an image file from its header only, no pixel is decoded (PNG IHDR, JPEG markers up to the first scan, TGA or QOI header)
+ * @param filepath [in] : Path of the file
+ * @param out_info [out] : image properties, PNG tRNS transparency isn't reported
+ * @returns true if the file is a supported image with a valid header
+ */
+bool nyx_img_probe_file(const char* filepath, img_info* out_info);
+
+/**
+ * @brief Same as nyx_img_probe_file() for an image held in memory
+ * @param data [in] : encoded image, only its header is needed
+ * @param data_size [in] : size of data in bytes
+ * @param out_info [out] : image properties
+ * @returns true if the data starts with a supported image header
+ */
+bool nyx_img_probe_memory(const void* data, const size_t data_size, img_info* out_info);
+
+/*** Row reader ***/
+
+/* Image decoder delivering one row at a time, from top to bottom */
+typedef struct _nyx_img_row_reader_struct img_row_reader;
+
+/**
+ * @brief Open an image file and start decoding it, only a few rows are kept in memory (the whole image for interlaced PNG)
+ * @param filepath [in] : Path of the file
+ * @param options [in] : {OPTIONAL} Decoding options, NULL for defaults
+ * @returns the reader, NULL if the file can't be decoded
+ */
+img_row_reader* nyx_img_row_reader_open(const char* filepath, const img_read_options* options);
+
+/**
+ * @brief Start decoding an image held in memory, only a few rows are kept in memory (the whole image for interlaced PNG)
+ * @param data [in] : encoded image, must stay valid until the reader is closed
+ * @param data_size [in] : size of data in bytes
+ * @param options [in] : {OPTIONAL} Decoding options, NULL for defaults
+ * @returns the reader, NULL if the image can't be decoded
+ */
+img_row_reader* nyx_img_row_reader_open_memory(const void* data, const size_t data_size, const img_read_options* options);
+
+/**
+ * @brief Stop decoding and close the file, the rows which were not read are never decoded
+ * @param reader [in] : reader to close
+ */
+void nyx_img_row_reader_close(img_row_reader* reader);
+
+/**
+ * @brief Decode the next row
+ * @param reader [in] : reader
+ * @param row [out] : decoded pixels, width * bytes per pixel of the reader format
+ * @returns true if all OK, false if the image is corrupted or all rows were already read
+ */
+bool nyx_img_row_reader_read_row(img_row_reader* reader, uint8_t* row);
+
+/**
+ * @brief Get the size of the decoded image, after scaling and cropping
+ * @param reader [in] : reader
+ * @returns the size of the image
+ */
+size nyx_img_row_reader_get_size(const img_row_reader* reader);
+
+/**
+ * @brief Get the pixel format of the decoded rows
+ * @param reader [in] : reader
+ * @returns the pixel format
+ */
+pixel_format_t nyx_img_row_reader_get_format(const img_row_reader* reader);
 
 
 #endif /* __NYX_IMGREADER_H__ */
@@ -0,0 +1,460 @@
+#include "img_reader_parallel.h"
+#include "pixel_convert.h"
+#include <stdlib.h>
+#include <string.h>
+#include "img_jpg.h"
+#include <jerror.h>
+#include "misc/utils.h"
+
+
+/* Smallest number of MCU rows of a strip, the context rows decoded around it stay negligible */
+#define NYX_JPG_STRIP_MIN_MCU_ROWS 8
+/* Strips per worker, evens out strips decoding at different speeds */
+#define NYX_JPG_STRIPS_PER_WORKER 2
+
+/* Bytes fed to the decoder of a strip */
+typedef struct _nyx_jpg_piece_struct
+{
+	const uint8_t* bytes;
+	size_t size;
+} jpg_piece;
+
+/* Source manager feeding pieces one after the other, the entropy-coded data is never copied */
+typedef struct _nyx_jpg_piece_src_struct
+{
+	struct jpeg_source_mgr pub;
+	const jpg_piece* pieces;
+	size_t num_pieces;
+	size_t next; // next piece to feed
+} jpg_piece_src;
+
+/* Markers of a single scan baseline JPEG with a restart interval */
+typedef struct _nyx_jpg_layout_struct
+{
+	const uint8_t* data;
+	size_t sof; // offset of the frame header marker
+	size_t scan_begin; // first byte of the entropy-coded data
+	size_t width;
+	size_t height;
+	size_t mcu_height; // rows of pixels of a MCU row
+	size_t mcu_rows;
+	size_t mcus_per_row;
+	size_t restart_interval; // MCUs between two restart markers
+	size_t num_intervals;
+	size_t* intervals; // num_intervals + 1 offsets, interval i is coded from intervals[i] to intervals[i + 1] - 2
+	bool vertical_upsampling; // chroma is subsampled vertically, fancy upsampling reads the rows around
+} jpg_layout;
+
+/* Parallel JPEG decoding job */
+typedef struct _nyx_jpg_decode_job_struct
+{
+	const jpg_layout* layout;
+	bitmap* bm;
+	bool grayscale;
+	size_t block_rows; // MCU rows between two possible strip boundaries, a whole number of restart intervals
+	size_t num_blocks;
+	size_t strip_blocks; // blocks of a strip
+	size_t context_blocks; // blocks decoded above and below a strip and dropped
+	bool* ok; // per strip
+} jpg_decode_job;
+
+
+static bool _nyx_img_jpg_read_parallel(worker_pool* pool, const uint8_t* data, const size_t data_size, const img_read_options* options, bitmap** out_bm, bool* out_done);
+static bool _nyx_jpg_parse_layout(const uint8_t* data, const size_t data_size, jpg_layout* layout);
+static bool _nyx_jpg_find_intervals(jpg_layout* layout, const size_t data_size);
+static void _nyx_jpg_decode_strip_task(void* ctx, const size_t task, const size_t worker);
+static void _nyx_jpg_piece_src_init(j_decompress_ptr cinfo);
+static boolean _nyx_jpg_piece_src_fill(j_decompress_ptr cinfo);
+static void _nyx_jpg_piece_src_skip(j_decompress_ptr cinfo, long num_bytes);
+static void _nyx_jpg_piece_src_term(j_decompress_ptr cinfo);
+static size_t _nyx_gcd(size_t a, size_t b);
+
+
+bool nyx_img_read_file_parallel(worker_pool* pool, const char* filepath, const img_read_options* options, bitmap** out_bm)
+{
+	// Sanity checks
+	if ((!pool) || (!filepath) || (!out_bm))
+		return false;
+
+	// the strips need the whole encoded image, they read different parts of the mapping at the same time
+	size_t data_size = 0;
+	const void* data = nyx_file_map(filepath, false, &data_size);
+	if (!data)
+		return nyx_img_read_file(filepath, options, out_bm);
+
+	const bool ret = nyx_img_read_memory_parallel(pool, data, data_size, options, out_bm);
+	nyx_file_unmap(data, data_size);
+
+	return ret;
+}
+
+bool nyx_img_read_memory_parallel(worker_pool* pool, const void* data, const size_t data_size, const img_read_options* options, bitmap** out_bm)
+{
+	// Sanity checks
+	if ((!pool) || (!data) || (!out_bm))
+		return false;
+
+	bool done = false;
+	const bool ret = _nyx_img_jpg_read_parallel(pool, (const uint8_t*)data, data_size, options, out_bm, &done);
+	if (done)
+		return ret;
+
+	return nyx_img_read_memory(data, data_size, options, out_bm);
+}
+
+/*** Private ***/
+/**
+ * @brief Decode a baseline JPEG with restart markers, strips of MCU rows are fed to their own decoder as standalone JPEGs:
+ * the headers with the strip height, the intervals of the strip with their restart markers renumbered, then EOI
+ * @param pool [in] : workers
+ * @param data [in] : encoded image
+ * @param data_size [in] : size of data in bytes
+ * @param options [in] : {OPTIONAL} Decoding options
+ * @param out_bm [out] : Decoded bitmap
+ * @param out_done [out] : false if the image can't be split, it must then be decoded serially
+ * @returns true if the image was successfully decoded
+ */
+static bool _nyx_img_jpg_read_parallel(worker_pool* pool, const uint8_t* data, const size_t data_size, const img_read_options* options, bitmap** out_bm, bool* out_done)
+{
+	// DCT scaling and areas are left to the row reader
+	if ((options) && ((options->min_size.w > 0) || (options->min_size.h > 0) || ((options->roi.size.w > 0) && (options->roi.size.h > 0))))
+		return false;
+	const size_t num_workers = nyx_worker_pool_get_num_workers(pool);
+	if (num_workers < 2)
+		return false;
+
+	jpg_layout layout;
+	if (!_nyx_jpg_parse_layout(data, data_size, &layout))
+		return false;
+
+	// strips begin on a MCU row which begins a restart interval
+	jpg_decode_job job = (jpg_decode_job){.layout = &layout, .grayscale = (options) && (options->grayscale)};
+	job.block_rows = layout.restart_interval / _nyx_gcd(layout.restart_interval, layout.mcus_per_row);
+	job.num_blocks = (layout.mcu_rows + job.block_rows - 1) / job.block_rows;
+	job.context_blocks = (layout.vertical_upsampling) ? 1 : 0;
+	const size_t min_blocks = (NYX_JPG_STRIP_MIN_MCU_ROWS + job.block_rows - 1) / job.block_rows;
+	const size_t target_strips = num_workers * NYX_JPG_STRIPS_PER_WORKER;
+	job.strip_blocks = NYX_MAX((job.num_blocks + target_strips - 1) / target_strips, min_blocks);
+	const size_t num_strips = (job.num_blocks + job.strip_blocks - 1) / job.strip_blocks;
+	if (num_strips < 2)
+	{
+		free(layout.intervals);
+		return false;
+	}
+
+	*out_done = true;
+	const pixel_format_t format = (options) ? options->format : pixel_format_rgba32;
+	job.bm = nyx_bm_alloc_with_format(layout.width, layout.height, format, NULL, NULL);
+	job.ok = (bool*)calloc(num_strips, sizeof(bool));
+	bool ret = (job.bm) && (job.ok);
+	if (ret)
+	{
+		(void)nyx_worker_pool_run(pool, num_strips, _nyx_jpg_decode_strip_task, &job);
+		for (size_t i = 0; (i < num_strips) && (ret); i++)
+			ret = job.ok[i];
+	}
+	else
+		NYX_ERRLOG("[!] failed to alloc bitmap (%zux%zu)\n", layout.width, layout.height);
+
+	free(job.ok);
+	free(layout.intervals);
+	if (!ret)
+	{
+		nyx_bm_destroy(job.bm);
+		return false;
+	}
+
+	*out_bm = job.bm;
+	return true;
+}
+
+/**
+ * @brief Walk the markers up to the scan, then find the restart markers
+ * @param data [in] : encoded image
+ * @param data_size [in] : size of data in bytes
+ * @param layout [out] : markers, its intervals are to free
+ * @returns false unless the image is a baseline or extended sequential JPEG, with one interleaved scan, 1 or 3 components, a restart interval and consistent restart markers
+ */
+static bool _nyx_jpg_parse_layout(const uint8_t* data, const size_t data_size, jpg_layout* layout)
+{
+	*layout = (jpg_layout){.data = data};
+	if ((data_size < 4) || (data[0] != 0xFF) || (data[1] != 0xD8))
+		return false;
+
+	bool has_sof = false;
+	size_t num_components = 0;
+	size_t pos = 2; // SOI
+	while (pos + 4 <= data_size)
+	{
+		if (data[pos] != 0xFF)
+			return false;
+		const uint8_t marker = data[pos + 1];
+		if (0xFF == marker)
+		{
+			// fill byte
+			pos++;
+			continue;
+		}
+		const size_t length = ((size_t)data[pos + 2] << 8) | data[pos + 3];
+		if ((length < 2) || (pos + 2 + length > data_size))
+			return false;
+		const uint8_t* segment = data + pos + 4;
+
+		if ((0xC0 == marker) || (0xC1 == marker))
+		{
+			// frame header, 8-bit Huffman sequential
+			if ((length < 8) || (segment[0] != 8))
+				return false;
+			layout->sof = pos;
+			layout->height = ((size_t)segment[1] << 8) | segment[2];
+			layout->width = ((size_t)segment[3] << 8) | segment[4];
+			num_components = segment[5];
+			if (((num_components != 1) && (num_components != 3)) || (length < 8 + (3 * num_components)) || (0 == layout->width) || (0 == layout->height))
+				return false;
+
+			size_t max_h = 1, max_v = 1;
+			for (size_t c = 0; c < num_components; c++)
+			{
+				max_h = NYX_MAX(max_h, (size_t)(segment[7 + (3 * c)] >> 4));
+				max_v = NYX_MAX(max_v, (size_t)(segment[7 + (3 * c)] & 0x0F));
+			}
+			for (size_t c = 0; c < num_components; c++)
+				layout->vertical_upsampling |= ((size_t)(segment[7 + (3 * c)] & 0x0F) != max_v);
+			// a single component scan isn't interleaved, its MCU is one block
+			const size_t mcu_width = (num_components > 1) ? (8 * max_h) : 8;
+			layout->mcu_height = (num_components > 1) ? (8 * max_v) : 8;
+			layout->mcus_per_row = (layout->width + mcu_width - 1) / mcu_width;
+			layout->mcu_rows = (layout->height + layout->mcu_height - 1) / layout->mcu_height;
+			has_sof = true;
+		}
+		else if (((marker >= 0xC2) && (marker <= 0xCF)) && (marker != 0xC4) && (marker != 0xC8) && (marker != 0xCC))
+		{
+			// progressive, lossless, arithmetic or hierarchical
+			return false;
+		}
+		else if (0xDD == marker)
+		{
+			// restart interval
+			if (length < 4)
+				return false;
+			layout->restart_interval = ((size_t)segment[0] << 8) | segment[1];
+		}
+		else if (0xDA == marker)
+		{
+			// the scan must hold every component
+			if ((!has_sof) || (0 == layout->restart_interval) || (length < 3) || (segment[0] != num_components))
+				return false;
+			layout->scan_begin = pos + 2 + length;
+			return _nyx_jpg_find_intervals(layout, data_size);
+		}
+		pos += 2 + length;
+	}
+	return false;
+}
+
+/**
+ * @brief Find the restart markers of the scan
+ * @param layout [in,out] : markers, the scan was found
+ * @param data_size [in] : size of the image in bytes
+ * @returns false if the restart markers don't match the restart interval or if the scan isn't followed by EOI
+ */
+static bool _nyx_jpg_find_intervals(jpg_layout* layout, const size_t data_size)
+{
+	const uint8_t* data = layout->data;
+	const size_t num_mcus = layout->mcus_per_row * layout->mcu_rows;
+	layout->num_intervals = (num_mcus + layout->restart_interval - 1) / layout->restart_interval;
+	layout->intervals = (size_t*)malloc((layout->num_intervals + 1) * sizeof(size_t));
+	if (!layout->intervals)
+		return false;
+	layout->intervals[0] = layout->scan_begin;
+
+	size_t count = 1;
+	size_t pos = layout->scan_begin;
+	while (pos < data_size)
+	{
+		const uint8_t* ff = (const uint8_t*)memchr(data + pos, 0xFF, data_size - pos);
+		if ((!ff) || ((size_t)(ff - data) + 1 >= data_size))
+			break;
+		pos = (size_t)(ff - data);
+		const uint8_t marker = data[pos + 1];
+		if (0x00 == marker)
+		{
+			// stuffed byte
+			pos += 2;
+		}
+		else if (0xFF == marker)
+		{
+			// fill byte
+			pos++;
+		}
+		else if ((marker >= 0xD0) && (marker <= 0xD7))
+		{
+			if ((count >= layout->num_intervals) || (marker != (0xD0 + ((count - 1) & 7))))
+				break;
+			pos += 2;
+			layout->intervals[count++] = pos;
+		}
+		else
+		{
+			// end of the scan, a second scan or a DNL marker can't be split
+			if ((0xD9 != marker) || (count != layout->num_intervals))
+				break;
+			layout->intervals[count] = pos + 2;
+			return true;
+		}
+	}
+	free(layout->intervals);
+	layout->intervals = NULL;
+	return false;
+}
+
+static void _nyx_jpg_decode_strip_task(void* ctx, const size_t task, const size_t worker)
+{
+#pragma unused(worker)
+	static const uint8_t markers[9][2] = {{0xFF, 0xD0}, {0xFF, 0xD1}, {0xFF, 0xD2}, {0xFF, 0xD3}, {0xFF, 0xD4}, {0xFF, 0xD5}, {0xFF, 0xD6}, {0xFF, 0xD7}, {0xFF, 0xD9}};
+	const jpg_decode_job* job = (const jpg_decode_job*)ctx;
+	const jpg_layout* layout = job->layout;
+	bitmap* bm = job->bm;
+
+	// rows of the strip, and rows decoded with the context blocks around
+	const size_t block_height = job->block_rows * layout->mcu_height;
+	const size_t b_begin = task * job->strip_blocks;
+	const size_t b_end = NYX_MIN(b_begin + job->strip_blocks, job->num_blocks);
+	const size_t d_begin = (b_begin > job->context_blocks) ? (b_begin - job->context_blocks) : 0;
+	const size_t d_end = NYX_MIN(b_end + job->context_blocks, job->num_blocks);
+	const size_t y_begin = b_begin * block_height;
+	const size_t y_end = NYX_MIN(b_end * block_height, layout->height);
+	const size_t decoded_y = d_begin * block_height;
+	const size_t decoded_height = NYX_MIN(d_end * block_height, layout->height) - decoded_y;
+	const size_t mcus_per_block = job->block_rows * layout->mcus_per_row;
+	const size_t i_begin = (d_begin * mcus_per_block) / layout->restart_interval;
+	const size_t i_end = NYX_MIN(((d_end * mcus_per_block) + layout->restart_interval - 1) / layout->restart_interval, layout->num_intervals);
+
+	// headers with the height of the strip, then the intervals separated by restart markers numbered from 0
+	const size_t num_pieces = (2 * (i_end - i_begin)) + 1;
+	uint8_t* header = (uint8_t*)malloc(layout->scan_begin);
+	jpg_piece* pieces = (jpg_piece*)malloc(num_pieces * sizeof(jpg_piece));
+	uint8_t* scratch = (uint8_t*)malloc(layout->width * 4);
+	if ((!header) || (!pieces) || (!scratch))
+	{
+		free(header);
+		free(pieces);
+		free(scratch);
+		return;
+	}
+	memcpy(header, layout->data, layout->scan_begin);
+	header[layout->sof + 5] = (uint8_t)(decoded_height >> 8);
+	header[layout->sof + 6] = (uint8_t)(decoded_height & 0xFF);
+	size_t n = 0;
+	pieces[n++] = (jpg_piece){.bytes = header, .size = layout->scan_begin};
+	for (size_t i = i_begin; i < i_end; i++)
+	{
+		pieces[n++] = (jpg_piece){.bytes = layout->data + layout->intervals[i], .size = layout->intervals[i + 1] - 2 - layout->intervals[i]};
+		pieces[n++] = (jpg_piece){.bytes = markers[(i + 1 < i_end) ? ((i - i_begin) & 7) : 8], .size = 2};
+	}
+
+	struct jpeg_decompress_struct cinfo;
+	jpg_error_mgr jerr;
+	jpg_piece_src src = (jpg_piece_src){.pieces = pieces, .num_pieces = num_pieces, .next = 0};
+	src.pub.init_source = _nyx_jpg_piece_src_init;
+	src.pub.fill_input_buffer = _nyx_jpg_piece_src_fill;
+	src.pub.skip_input_data = _nyx_jpg_piece_src_skip;
+	src.pub.resync_to_restart = jpeg_resync_to_restart;
+	src.pub.term_source = _nyx_jpg_piece_src_term;
+	cinfo.err = nyx_jpg_std_error(&jerr);
+	if (setjmp(jerr.jmp))
+	{
+		jpeg_destroy_decompress(&cinfo);
+		free(header);
+		free(pieces);
+		free(scratch);
+		return;
+	}
+	jpeg_create_decompress(&cinfo);
+	cinfo.src = &src.pub;
+	jpeg_read_header(&cinfo, TRUE);
+	if ((cinfo.out_color_space != JCS_RGB) && (cinfo.out_color_space != JCS_GRAYSCALE))
+		longjmp(jerr.jmp, 1);
+	const pixel_format_t decoded_format = nyx_jpg_set_out_format(&cinfo, bm->format, job->grayscale);
+	jpeg_start_decompress(&cinfo);
+
+	// decode straight into the destination rows, at their end to convert them in place, the context rows are dropped
+	const size_t decoded_bpp = nyx_bytes_per_pixel_for_format(decoded_format);
+	const size_t bpp = nyx_bytes_per_pixel_for_format(bm->format);
+	const bool direct = (decoded_bpp <= bpp);
+	while (cinfo.output_scanline < cinfo.output_height)
+	{
+		const size_t y = decoded_y + cinfo.output_scanline;
+		if ((y < y_begin) || (y >= y_end))
+		{
+			(void)jpeg_read_scanlines(&cinfo, (JSAMPROW[1]){scratch}, 1);
+			continue;
+		}
+		uint8_t* row = (uint8_t*)bm->buffer + (y * bm->stride);
+		uint8_t* decoded_row = (direct) ? (row + (bm->width * (bpp - decoded_bpp))) : scratch;
+		(void)jpeg_read_scanlines(&cinfo, (JSAMPROW[1]){decoded_row}, 1);
+		nyx_px_convert_row(decoded_row, decoded_format, row, bm->format, bm->width);
+	}
+	jpeg_finish_decompress(&cinfo);
+	jpeg_destroy_decompress(&cinfo);
+	free(header);
+	free(pieces);
+	free(scratch);
+	job->ok[task] = true;
+}
+
+static void _nyx_jpg_piece_src_init(j_decompress_ptr cinfo)
+{
+#pragma unused(cinfo)
+}
+
+static boolean _nyx_jpg_piece_src_fill(j_decompress_ptr cinfo)
+{
+	static const JOCTET eoi[2] = {0xFF, 0xD9};
+	jpg_piece_src* src = (jpg_piece_src*)cinfo->src;
+	if (src->next < src->num_pieces)
+	{
+		src->pub.next_input_byte = src->pieces[src->next].bytes;
+		src->pub.bytes_in_buffer = src->pieces[src->next].size;
+		src->next++;
+	}
+	else
+	{
+		// truncated, like jpeg_mem_src insert an EOI
+		WARNMS(cinfo, JWRN_JPEG_EOF);
+		src->pub.next_input_byte = eoi;
+		src->pub.bytes_in_buffer = 2;
+	}
+	return TRUE;
+}
+
+static void _nyx_jpg_piece_src_skip(j_decompress_ptr cinfo, long num_bytes)
+{
+	struct jpeg_source_mgr* src = cinfo->src;
+	while (num_bytes > (long)src->bytes_in_buffer)
+	{
+		num_bytes -= (long)src->bytes_in_buffer;
+		(void)src->fill_input_buffer(cinfo);
+	}
+	if (num_bytes > 0)
+	{
+		src->next_input_byte += (size_t)num_bytes;
+		src->bytes_in_buffer -= (size_t)num_bytes;
+	}
+}
+
+static void _nyx_jpg_piece_src_term(j_decompress_ptr cinfo)
+{
+#pragma unused(cinfo)
+}
+
+static size_t _nyx_gcd(size_t a, size_t b)
+{
+	while (b != 0)
+	{
+		const size_t r = a % b;
+		a = b;
+		b = r;
+	}
+	return a;
+}
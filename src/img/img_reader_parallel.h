@@ -0,0 +1,32 @@
+#ifndef __NYX_IMGREADERPARALLEL_H__
+#define __NYX_IMGREADERPARALLEL_H__
+
+#include "img_reader.h"
+#include "misc/worker_pool.h"
+
+
+/**
+ * @brief Attempt to read an image file and decode it into a bitmap, decoded by a pool of workers
+ * Baseline JPEGs with restart markers are split in strips of MCU rows decoded independently, the bitmap is identical to nyx_img_read_file()
+ * Other images, JPEGs without restart interval, or with a region of interest or a minimum size, are decoded by nyx_img_read_file()
+ * @param pool [in] : workers
+ * @param filepath [in] : Path of the file
+ * @param options [in] : {OPTIONAL} Decoding options, NULL for defaults
+ * @param out_bm [out] : Decoded bitmap, to destroy with nyx_bm_destroy()
+ * @returns true if the file was successfully read
+ */
+bool nyx_img_read_file_parallel(worker_pool* pool, const char* filepath, const img_read_options* options, bitmap** out_bm);
+
+/**
+ * @brief Attempt to decode an image held in memory into a bitmap, decoded by a pool of workers
+ * @param pool [in] : workers
+ * @param data [in] : encoded image
+ * @param data_size [in] : size of data in bytes
+ * @param options [in] : {OPTIONAL} Decoding options, NULL for defaults
+ * @param out_bm [out] : Decoded bitmap, to destroy with nyx_bm_destroy()
+ * @returns true if the image was successfully decoded
+ */
+bool nyx_img_read_memory_parallel(worker_pool* pool, const void* data, const size_t data_size, const img_read_options* options, bitmap** out_bm);
+
+
+#endif /* __NYX_IMGREADERPARALLEL_H__ */
@@ -1,253 +1,774 @@
 #include "img_writer.h"
+#include "pixel_convert.h"
 #include <stdlib.h>
+#include <string.h>
 #include <png.h>
-#include <jpeglib.h>
+#include <zlib.h>
+#include "img_jpg.h"
+#include <jerror.h>
+#include "img_qoi.h"
 
 
-static bool _nyx_img_write_tga(const char* filepath, const bitmap* bm, const colorspace_t output_colorspace);
-static bool _nyx_img_write_png(const char* filepath, const bitmap* bm, const colorspace_t output_colorspace);
-static bool _nyx_img_write_jpg(const char* filepath, const bitmap* bm);
+/* Smallest allocation of a growable buffer */
+#define NYX_IMG_BUFFER_MIN_CAPACITY ((size_t)64 * 1024)
+/* stdio buffer of the written files, rows are gathered into large writes */
+#define NYX_IMG_FILE_BUFFER_SIZE ((size_t)256 * 1024)
+/* Most pixels in a TGA RLE packet */
+#define NYX_TGA_MAX_PACKET_PIXELS 128
+/* Largest width or height of a TGA */
+#define NYX_TGA_MAX_DIMENSION 65535
 
+/* Row-major pixels to write, whatever the bitmap layout */
+typedef struct _nyx_img_row_source_struct
+{
+	const void* bm;
+	size_t width;
+	size_t height;
+	pixel_format_t format;
+	const uint8_t* (*get_row_fptr)(const void* bm, const size_t y, uint8_t* scratch); // returns the row y, scratch can hold a row
+} img_row_source;
 
-bool nyx_img_write_bitmap_to_file(const char* filepath, const bitmap* bm, const img_type_t type, const colorspace_t output_colorspace)
+/* Row encoder */
+struct _nyx_img_row_writer_struct
 {
-	bool ret = false;
+	FILE* fp; // NULL when encoding in memory
+	img_buffer* buffer; // receives the encoded image in memory
+	size_t width;
+	size_t height;
+	pixel_format_t format; // pixel format of the given rows
+	pixel_format_t file_format; // pixel format of the encoded rows
+	size_t y; // next row to write
+	uint8_t* row; // given row converted to file_format
+	uint8_t* packed_row; // encoded row, when it isn't written as is
+	bool (*write_row_fptr)(img_row_writer* writer, const uint8_t* row);
+	bool (*finish_fptr)(img_row_writer* writer, const bool complete); // returns false if the file couldn't be finished
+	// TGA
+	bool rle;
+	// QOI
+	rgba_pixel qoi_index[64]; // previously seen pixels
+	rgba_pixel qoi_prev; // last encoded pixel
+	size_t qoi_run; // pixels equal to qoi_prev not encoded yet, runs span rows
+	// PNG
+	png_structp png_ptr;
+	png_infop info_ptr;
+	// JPEG
+	struct jpeg_compress_struct cinfo;
+	jpg_error_mgr jerr;
+	struct jpeg_destination_mgr jdest; // writes into buffer
+};
+
+
+static bool _nyx_img_write_rows(img_row_writer* writer, const img_row_source* rows);
+static img_row_writer* _nyx_img_row_writer_open(const char* filepath, img_buffer* buffer, const size img_size, const pixel_format_t format, const img_type_t type, const colorspace_t output_colorspace, const img_write_options* options);
+static bool _nyx_img_write_bytes(img_row_writer* writer, const void* bytes, const size_t num_bytes);
+static const uint8_t* _nyx_img_get_bitmap_row(const void* bm, const size_t y, uint8_t* scratch);
+static const uint8_t* _nyx_img_get_tiled_bitmap_row(const void* tbm, const size_t y, uint8_t* scratch);
+static bool _nyx_img_tga_open(img_row_writer* writer, const colorspace_t output_colorspace, const img_write_options* options);
+static bool _nyx_img_tga_write_row(img_row_writer* writer, const uint8_t* row);
+static size_t _nyx_img_tga_pack_row(const uint8_t* row, const size_t width, const size_t bpp, uint8_t* dst);
+static inline bool _nyx_img_tga_same_pixel(const uint8_t* a, const uint8_t* b, const size_t bpp);
+static bool _nyx_img_qoi_open(img_row_writer* writer, const colorspace_t output_colorspace, const img_write_options* options);
+static bool _nyx_img_qoi_write_row(img_row_writer* writer, const uint8_t* row);
+static bool _nyx_img_qoi_finish(img_row_writer* writer, const bool complete);
+static size_t _nyx_img_qoi_encode_row(img_row_writer* writer, const uint8_t* row, uint8_t* dst);
+static bool _nyx_img_png_open(img_row_writer* writer, const colorspace_t output_colorspace, const img_write_options* options);
+static bool _nyx_img_png_write_row(img_row_writer* writer, const uint8_t* row);
+static void _nyx_img_png_set_compression(png_structp png_ptr, const img_write_options* options);
+static bool _nyx_img_png_finish(img_row_writer* writer, const bool complete);
+static void _nyx_img_png_write_memory(png_structp png_ptr, png_bytep data, png_size_t length);
+static void _nyx_img_png_flush_memory(png_structp png_ptr);
+static bool _nyx_img_jpg_open(img_row_writer* writer, const colorspace_t output_colorspace, const img_write_options* options);
+static bool _nyx_img_jpg_write_row(img_row_writer* writer, const uint8_t* row);
+static bool _nyx_img_jpg_finish(img_row_writer* writer, const bool complete);
+static void _nyx_img_jpg_init_destination(j_compress_ptr cinfo);
+static boolean _nyx_img_jpg_empty_output_buffer(j_compress_ptr cinfo);
+static void _nyx_img_jpg_term_destination(j_compress_ptr cinfo);
 
+
+bool nyx_img_write_bitmap_to_file(const char* filepath, const bitmap* bm, const img_type_t type, const colorspace_t output_colorspace, const img_write_options* options)
+{
 	// Sanity checks
 	if ((!filepath) || (!bm))
-		return ret;
+		return false;
+
+	const img_row_source rows = (img_row_source){.bm = bm, .width = bm->width, .height = bm->height, .format = bm->format, .get_row_fptr = _nyx_img_get_bitmap_row};
+	const size img_size = (size){.w = rows.width, .h = rows.height};
+	return _nyx_img_write_rows(nyx_img_row_writer_open(filepath, img_size, rows.format, type, output_colorspace, options), &rows);
+}
+
+bool nyx_img_write_tiled_bitmap_to_file(const char* filepath, const tiled_bitmap* tbm, const img_type_t type, const colorspace_t output_colorspace, const img_write_options* options)
+{
+	// Sanity checks
+	if ((!filepath) || (!tbm))
+		return false;
+
+	const img_row_source rows = (img_row_source){.bm = tbm, .width = tbm->width, .height = tbm->height, .format = tbm->format, .get_row_fptr = _nyx_img_get_tiled_bitmap_row};
+	const size img_size = (size){.w = rows.width, .h = rows.height};
+	return _nyx_img_write_rows(nyx_img_row_writer_open(filepath, img_size, rows.format, type, output_colorspace, options), &rows);
+}
+
+bool nyx_img_write_to_memory(const bitmap* bm, const img_type_t type, const colorspace_t output_colorspace, const img_write_options* options, img_buffer* out_buffer)
+{
+	// Sanity checks
+	if ((!bm) || (!out_buffer))
+		return false;
+
+	const img_row_source rows = (img_row_source){.bm = bm, .width = bm->width, .height = bm->height, .format = bm->format, .get_row_fptr = _nyx_img_get_bitmap_row};
+	const size img_size = (size){.w = rows.width, .h = rows.height};
+	return _nyx_img_write_rows(nyx_img_row_writer_open_memory(out_buffer, img_size, rows.format, type, output_colorspace, options), &rows);
+}
+
+/*** Memory buffer ***/
+void nyx_img_buffer_init(img_buffer* buffer)
+{
+	if (buffer)
+		*buffer = (img_buffer){.data = NULL, .size = 0, .capacity = 0};
+}
+
+void nyx_img_buffer_free(img_buffer* buffer)
+{
+	if (buffer)
+	{
+		free(buffer->data);
+		nyx_img_buffer_init(buffer);
+	}
+}
+
+bool nyx_img_buffer_reserve(img_buffer* buffer, const size_t capacity)
+{
+	if (!buffer)
+		return false;
+
+	if (capacity <= buffer->capacity)
+		return true;
+
+	// at least double, appending many small chunks stays linear
+	const size_t new_capacity = NYX_MAX(capacity, NYX_MAX(buffer->capacity * 2, NYX_IMG_BUFFER_MIN_CAPACITY));
+	uint8_t* data = (uint8_t*)realloc(buffer->data, new_capacity);
+	if (!data)
+	{
+		NYX_ERRLOG("[!] failed to grow buffer to %zu bytes\n", new_capacity);
+		return false;
+	}
+	buffer->data = data;
+	buffer->capacity = new_capacity;
+
+	return true;
+}
+
+bool nyx_img_buffer_append(img_buffer* buffer, const void* bytes, const size_t num_bytes)
+{
+	if ((!buffer) || (!nyx_img_buffer_reserve(buffer, buffer->size + num_bytes)))
+		return false;
+
+	memcpy(buffer->data + buffer->size, bytes, num_bytes);
+	buffer->size += num_bytes;
+
+	return true;
+}
+
+/*** Row writer ***/
+img_row_writer* nyx_img_row_writer_open(const char* filepath, const size img_size, const pixel_format_t format, const img_type_t type, const colorspace_t output_colorspace, const img_write_options* options)
+{
+	if (!filepath)
+		return NULL;
+
+	return _nyx_img_row_writer_open(filepath, NULL, img_size, format, type, output_colorspace, options);
+}
+
+img_row_writer* nyx_img_row_writer_open_memory(img_buffer* buffer, const size img_size, const pixel_format_t format, const img_type_t type, const colorspace_t output_colorspace, const img_write_options* options)
+{
+	if (!buffer)
+		return NULL;
+
+	buffer->size = 0;
+	return _nyx_img_row_writer_open(NULL, buffer, img_size, format, type, output_colorspace, options);
+}
+
+bool nyx_img_row_writer_write_row(img_row_writer* writer, const uint8_t* row)
+{
+	if ((!writer) || (!row) || (writer->y >= writer->height))
+		return false;
+
+	// transparency is replaced by white when alpha is dropped
+	if (writer->format != writer->file_format)
+	{
+		nyx_px_convert_row_opaque(row, writer->format, writer->row, writer->file_format, writer->width);
+		row = writer->row;
+	}
+	if (!writer->write_row_fptr(writer, row))
+		return false;
+	writer->y++;
+
+	return true;
+}
+
+bool nyx_img_row_writer_close(img_row_writer* writer)
+{
+	if (!writer)
+		return false;
+
+	// a file missing rows is left truncated
+	bool ret = (writer->y == writer->height);
+	if ((writer->finish_fptr) && (!writer->finish_fptr(writer, ret)))
+		ret = false;
+	if ((writer->fp) && (fclose(writer->fp) != 0))
+		ret = false;
+	free(writer->packed_row);
+	free(writer->row);
+	free(writer);
+
+	return ret;
+}
+
+/*** Private ***/
+/**
+ * @brief Write all the rows of a source, then close the writer
+ * @param writer [in] : {OPTIONAL} writer, NULL if it couldn't be opened
+ * @param rows [in] : rows to write
+ * @returns true if the image was successfully written
+ */
+static bool _nyx_img_write_rows(img_row_writer* writer, const img_row_source* rows)
+{
+	if (!writer)
+		return false;
+
+	uint8_t* scratch = (uint8_t*)malloc(rows->width * nyx_bytes_per_pixel_for_format(rows->format));
+	bool ret = (scratch != NULL);
+	for (size_t y = 0; (y < rows->height) && (ret); y++)
+		ret = nyx_img_row_writer_write_row(writer, rows->get_row_fptr(rows->bm, y, scratch));
+	free(scratch);
+
+	return nyx_img_row_writer_close(writer) && ret;
+}
+
+/**
+ * @brief Set up a row writer, to a file or to memory
+ * @param filepath [in] : {OPTIONAL} Path to save the file to, NULL to encode in buffer
+ * @param buffer [in] : {OPTIONAL} receives the encoded image when filepath is NULL
+ * @param img_size [in] : size of the image
+ * @param format [in] : pixel format of the given rows
+ * @param type [in] : image type
+ * @param output_colorspace [in] : colorspace to save the image
+ * @param options [in] : {OPTIONAL} Encoding options
+ * @returns the writer, NULL if something failed
+ */
+static img_row_writer* _nyx_img_row_writer_open(const char* filepath, img_buffer* buffer, const size img_size, const pixel_format_t format, const img_type_t type, const colorspace_t output_colorspace, const img_write_options* options)
+{
+	// Sanity checks
+	if (0 == nyx_bytes_per_pixel_for_format(format))
+		return NULL;
 
 	// Unsupported colorspace
-	if ((output_colorspace != colorspace_rgba) && (output_colorspace != colorspace_rgb))
-		return ret;
+	if ((output_colorspace != colorspace_rgba) && (output_colorspace != colorspace_rgb) && (output_colorspace != colorspace_gray))
+		return NULL;
 
+	bool (*open_fptr)(img_row_writer*, const colorspace_t, const img_write_options*);
 	switch (type)
 	{
 		case img_type_tga:
-			ret = _nyx_img_write_tga(filepath, bm, output_colorspace);
+			open_fptr = _nyx_img_tga_open;
 			break;
 		case img_type_png:
-			ret = _nyx_img_write_png(filepath, bm, output_colorspace);
+			open_fptr = _nyx_img_png_open;
 			break;
 		case img_type_jpg:
-			ret = _nyx_img_write_jpg(filepath, bm);
+			open_fptr = _nyx_img_jpg_open;
 			break;
-		default:
-			ret = false;
+		case img_type_qoi:
+			open_fptr = _nyx_img_qoi_open;
 			break;
+		default:
+			return NULL;
 	}
-	return ret;
+
+	img_row_writer* writer = (img_row_writer*)calloc(1, sizeof(img_row_writer));
+	if (!writer)
+		return NULL;
+	writer->width = img_size.w;
+	writer->height = img_size.h;
+	writer->format = format;
+	writer->buffer = buffer;
+	if (filepath)
+	{
+		writer->fp = fopen(filepath, "wb");
+		if (!writer->fp)
+		{
+			NYX_ERRLOG("[!] failed to create <%s>\n", filepath);
+			free(writer);
+			return NULL;
+		}
+		(void)setvbuf(writer->fp, NULL, _IOFBF, NYX_IMG_FILE_BUFFER_SIZE);
+	}
+
+	// write the header and set up the encoder, close cleans up whatever was done
+	if (!open_fptr(writer, output_colorspace, options))
+	{
+		(void)nyx_img_row_writer_close(writer);
+		return NULL;
+	}
+	writer->row = (uint8_t*)malloc(writer->width * nyx_bytes_per_pixel_for_format(writer->file_format));
+	if (!writer->row)
+	{
+		(void)nyx_img_row_writer_close(writer);
+		return NULL;
+	}
+
+	return writer;
 }
 
-/*** Private ***/
-static bool _nyx_img_write_tga(const char* filepath, const bitmap* bm, const colorspace_t output_colorspace)
+static bool _nyx_img_write_bytes(img_row_writer* writer, const void* bytes, const size_t num_bytes)
+{
+	if (writer->fp)
+		return (fwrite(bytes, sizeof(uint8_t), num_bytes, writer->fp) == num_bytes);
+	return nyx_img_buffer_append(writer->buffer, bytes, num_bytes);
+}
+
+static const uint8_t* _nyx_img_get_bitmap_row(const void* bm, const size_t y, uint8_t* scratch)
+{
+#pragma unused(scratch)
+	const bitmap* linear_bm = (const bitmap*)bm;
+	return (const uint8_t*)linear_bm->buffer + (y * linear_bm->stride);
+}
+
+static const uint8_t* _nyx_img_get_tiled_bitmap_row(const void* tbm, const size_t y, uint8_t* scratch)
+{
+	nyx_tbm_get_row((const tiled_bitmap*)tbm, y, scratch);
+	return scratch;
+}
+
+static bool _nyx_img_tga_open(img_row_writer* writer, const colorspace_t output_colorspace, const img_write_options* options)
 {
-	bool ret = false;
-	FILE* fp = fopen(filepath, "wb");
-	if (!fp)
-		return ret;
+	writer->write_row_fptr = _nyx_img_tga_write_row;
+
+	// the header holds 16-bit dimensions
+	if ((writer->width > NYX_TGA_MAX_DIMENSION) || (writer->height > NYX_TGA_MAX_DIMENSION))
+	{
+		NYX_ERRLOG("[!] image too large for TGA (%zux%zu)\n", writer->width, writer->height);
+		return false;
+	}
+
+	// TGA stores BGR(A) or gray pixels
+	writer->file_format = (colorspace_rgba == output_colorspace) ? pixel_format_bgra32 : (colorspace_rgb == output_colorspace) ? pixel_format_bgr24 : pixel_format_gray8;
+	writer->rle = (options) && (options->tga_rle);
+	if (writer->rle)
+	{
+		// worst case, a packet header for every pixel
+		const size_t bpp = nyx_bytes_per_pixel_for_format(writer->file_format);
+		writer->packed_row = (uint8_t*)malloc(writer->width * (bpp + 1));
+		if (!writer->packed_row)
+			return false;
+	}
 
-	// TGA Header
+	// TGA Header, top-down rows so they can be written as they come
 	uint8_t header[18] = {0};
-	header[2] = 2; // RGB
-	header[12] = bm->width & 0xFF;
-	header[13] = (bm->width >> 8) & 0xFF;
-	header[14] = bm->height & 0xFF;
-	header[15] = (bm->height >> 8) & 0xFF;
+	header[2] = ((pixel_format_gray8 == writer->file_format) ? 3 : 2) | ((writer->rle) ? 8 : 0); // Gray / RGB, RLE
+	header[12] = writer->width & 0xFF;
+	header[13] = (writer->width >> 8) & 0xFF;
+	header[14] = writer->height & 0xFF;
+	header[15] = (writer->height >> 8) & 0xFF;
 	header[16] = 8 * (uint8_t)nyx_num_components_for_colorspace(output_colorspace); // bits per pixel
-	fwrite(header, sizeof(uint8_t), 18, fp);
-	
-	if (colorspace_rgba == output_colorspace)
+	header[17] = 0x20 | ((colorspace_rgba == output_colorspace) ? 8 : 0); // top-left origin, alpha bits
+	return _nyx_img_write_bytes(writer, header, 18);
+}
+
+static bool _nyx_img_tga_write_row(img_row_writer* writer, const uint8_t* row)
+{
+	const size_t bpp = nyx_bytes_per_pixel_for_format(writer->file_format);
+	if (writer->rle)
+		return _nyx_img_write_bytes(writer, writer->packed_row, _nyx_img_tga_pack_row(row, writer->width, bpp, writer->packed_row));
+	return _nyx_img_write_bytes(writer, row, writer->width * bpp);
+}
+
+/**
+ * @brief Run-length encode a row of TGA pixels, runs of 2 identical pixels or more become RLE packets, the others raw packets
+ * @param row [in] : pixels
+ * @param width [in] : number of pixels
+ * @param bpp [in] : bytes per pixel
+ * @param dst [out] : packets, at least width * (bpp + 1) bytes, every packet holds at least one pixel
+ * @returns number of bytes written in dst
+ */
+static size_t _nyx_img_tga_pack_row(const uint8_t* row, const size_t width, const size_t bpp, uint8_t* dst)
+{
+	uint8_t* const dst_start = dst;
+	size_t x = 0;
+	while (x < width)
 	{
-		// same colorspace
-		const rgba_pixel* pixels = (rgba_pixel*)bm->buffer;
-		for (int y = (int)bm->height - 1; y >= 0; y--)
+		// length of the run starting at x
+		const uint8_t* px = row + (x * bpp);
+		size_t run = 1;
+		while ((x + run < width) && (run < NYX_TGA_MAX_PACKET_PIXELS) && (_nyx_img_tga_same_pixel(px, px + (run * bpp), bpp)))
+			run++;
+		if (run > 1)
 		{
-			for (size_t x = 0; x < bm->width; x++)
-			{
-				const rgba_pixel pixel = pixels[((size_t)y * bm->width) + x];
-				fwrite((uint8_t[4]){pixel.b, pixel.g, pixel.r, pixel.a}, sizeof(uint8_t), 4, fp);
-			}
+			*dst++ = (uint8_t)(0x80 | (run - 1));
+			memcpy(dst, px, bpp);
+			dst += bpp;
+			x += run;
+			continue;
 		}
-		ret = true;
-	}
-	else if (colorspace_rgb == output_colorspace)
-	{
-		// bitmap is RGBA and we want RGB24
-		const rgba_pixel* pixels = (rgba_pixel*)bm->buffer;
-		for (int y = (int)bm->height - 1; y >= 0; y--)
+
+		// raw packet up to the next run
+		size_t count = 1;
+		while ((x + count < width) && (count < NYX_TGA_MAX_PACKET_PIXELS))
 		{
-			for (size_t x = 0; x < bm->width; x++)
-			{
-				const rgba_pixel pixel = pixels[((size_t)y * bm->width) + x];
-				if (NYX_MIN_PIXEL_COMPONENT_VALUE == pixel.a)
-				{
-					// replace the transparency by white
-					fwrite((uint8_t[3]){NYX_MAX_PIXEL_COMPONENT_VALUE, NYX_MAX_PIXEL_COMPONENT_VALUE, NYX_MAX_PIXEL_COMPONENT_VALUE}, sizeof(uint8_t), 3, fp);
-				}
-				else
-				{
-					fwrite((uint8_t[3]){pixel.b, pixel.g, pixel.r}, sizeof(uint8_t), 3, fp);
-				}
-			}
+			const uint8_t* next = px + (count * bpp);
+			if ((x + count + 1 < width) && (_nyx_img_tga_same_pixel(next, next + bpp, bpp)))
+				break;
+			count++;
 		}
-		ret = true;
+		*dst++ = (uint8_t)(count - 1);
+		memcpy(dst, px, count * bpp);
+		dst += count * bpp;
+		x += count;
 	}
+	return (size_t)(dst - dst_start);
+}
 
-	// cleanup
-	fclose(fp);
-
-	return ret;
+static inline bool _nyx_img_tga_same_pixel(const uint8_t* a, const uint8_t* b, const size_t bpp)
+{
+	switch (bpp)
+	{
+		case 4:
+			return (0 == memcmp(a, b, 4));
+		case 3:
+			return (0 == memcmp(a, b, 3));
+		default:
+			return (*a == *b);
+	}
 }
 
-static bool _nyx_img_write_png(const char* filepath, const bitmap* bm, const colorspace_t output_colorspace)
+static bool _nyx_img_qoi_open(img_row_writer* writer, const colorspace_t output_colorspace, const img_write_options* options)
 {
-	FILE* fp = fopen(filepath, "wb");
-	if (!fp)
-		return false;
+#pragma unused(options)
+	writer->write_row_fptr = _nyx_img_qoi_write_row;
+	writer->finish_fptr = _nyx_img_qoi_finish;
 
-	png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-	if (!png_ptr)
+	// QOI stores RGB(A) pixels, gray rows are expanded while encoding
+	writer->file_format = (colorspace_rgba == output_colorspace) ? pixel_format_rgba32 : (colorspace_rgb == output_colorspace) ? pixel_format_rgb24 : pixel_format_gray8;
+	if ((0 == writer->width) || (0 == writer->height) || (writer->width > NYX_QOI_MAX_PIXELS / writer->height))
 	{
-		fclose(fp);
+		NYX_ERRLOG("[!] unsupported QOI size (%zux%zu)\n", writer->width, writer->height);
 		return false;
 	}
+	// worst case, a run left by the previous row then RGBA chunks
+	writer->packed_row = (uint8_t*)malloc((writer->width * NYX_QOI_MAX_CHUNK_SIZE) + 1);
+	if (!writer->packed_row)
+		return false;
+	writer->qoi_prev = (rgba_pixel){.r = 0, .g = 0, .b = 0, .a = 255};
 
-	png_infop info_ptr = png_create_info_struct(png_ptr);
-	if (!info_ptr)
+	// QOI Header : magic, big endian width and height, channels, sRGB colorspace
+	uint8_t header[NYX_QOI_HEADER_SIZE] = {'q', 'o', 'i', 'f'};
+	for (size_t i = 0; i < 4; i++)
 	{
-		png_destroy_write_struct(&png_ptr, NULL);
-		fclose(fp);
-		return false;
+		header[4 + i] = (uint8_t)(writer->width >> (24 - (8 * i)));
+		header[8 + i] = (uint8_t)(writer->height >> (24 - (8 * i)));
 	}
+	header[12] = (colorspace_rgba == output_colorspace) ? 4 : 3;
+	header[13] = 0;
+	return _nyx_img_write_bytes(writer, header, NYX_QOI_HEADER_SIZE);
+}
 
-	// error handling
-	if (setjmp(png_jmpbuf(png_ptr)))
-	{
-		png_destroy_write_struct(&png_ptr, &info_ptr);
-		fclose(fp);
+static bool _nyx_img_qoi_write_row(img_row_writer* writer, const uint8_t* row)
+{
+	return _nyx_img_write_bytes(writer, writer->packed_row, _nyx_img_qoi_encode_row(writer, row, writer->packed_row));
+}
+
+static bool _nyx_img_qoi_finish(img_row_writer* writer, const bool complete)
+{
+	if (!complete)
 		return false;
-	}
 
-	// set image attributes
-	const png_byte bit_depth = 8;
-	const png_byte color_type = (colorspace_rgba == output_colorspace) ? PNG_COLOR_TYPE_RGBA : PNG_COLOR_TYPE_RGB;
-	png_set_IHDR(png_ptr, info_ptr, (png_uint_32)bm->width, (png_uint_32)bm->height, bit_depth, color_type, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+	// the last run, then the end marker
+	static const uint8_t end_marker[NYX_QOI_END_MARKER_SIZE] = {0, 0, 0, 0, 0, 0, 0, 1};
+	if (writer->qoi_run > 0)
+	{
+		const uint8_t run = (uint8_t)(NYX_QOI_OP_RUN | (writer->qoi_run - 1));
+		if (!_nyx_img_write_bytes(writer, &run, 1))
+			return false;
+	}
+	return _nyx_img_write_bytes(writer, end_marker, NYX_QOI_END_MARKER_SIZE);
+}
 
-	const size_t pixel_size = nyx_num_components_for_colorspace(output_colorspace);
-	png_byte** row_pointers = NULL;
-	if (colorspace_rgba == output_colorspace)
+/**
+ * @brief Encode a row of pixels into QOI chunks, the pixel table, the last pixel and the pending run carry over to the next row
+ * @param writer [in] : writer, its file format is rgba32, rgb24 or gray8
+ * @param row [in] : pixels in the file format
+ * @param dst [out] : chunks, at least width * NYX_QOI_MAX_CHUNK_SIZE + 1 bytes
+ * @returns number of bytes written in dst
+ */
+static size_t _nyx_img_qoi_encode_row(img_row_writer* writer, const uint8_t* row, uint8_t* dst)
+{
+	uint8_t* const dst_start = dst;
+	const size_t bpp = nyx_bytes_per_pixel_for_format(writer->file_format);
+	rgba_pixel* index = writer->qoi_index;
+	rgba_pixel prev = writer->qoi_prev;
+	size_t run = writer->qoi_run;
+	for (size_t x = 0; x < writer->width; x++)
 	{
-		// same colorspace
-		const rgba_pixel* pixels = (rgba_pixel*)bm->buffer;
-		row_pointers = png_malloc(png_ptr, bm->height * sizeof(png_byte*));
-		for (size_t y = 0; y < bm->height; ++y)
+		const uint8_t* src = row + (x * bpp);
+		rgba_pixel px;
+		if (4 == bpp)
+			px = (rgba_pixel){.r = src[0], .g = src[1], .b = src[2], .a = src[3]};
+		else if (3 == bpp)
+			px = (rgba_pixel){.r = src[0], .g = src[1], .b = src[2], .a = 255};
+		else
+			px = (rgba_pixel){.r = src[0], .g = src[0], .b = src[0], .a = 255};
+
+		if (0 == memcmp(&px, &prev, sizeof(rgba_pixel)))
 		{
-			png_byte* row = png_malloc(png_ptr, sizeof (uint8_t) * bm->width * pixel_size);
-			row_pointers[y] = row;
-			for (size_t x = 0; x < bm->width; ++x)
+			if (++run == NYX_QOI_MAX_RUN)
 			{
-				const rgba_pixel pixel = pixels[((size_t)y * bm->width) + x];
-				*row++ = pixel.r;
-				*row++ = pixel.g;
-				*row++ = pixel.b;
-				*row++ = pixel.a;
+				*dst++ = (uint8_t)(NYX_QOI_OP_RUN | (run - 1));
+				run = 0;
 			}
+			continue;
 		}
-	}
-	else
-	{
-		// bitmap is RGBA and we want RGB24
-		const rgba_pixel* pixels = (rgba_pixel*)bm->buffer;
-		row_pointers = png_malloc(png_ptr, bm->height * sizeof(png_byte*));
-		for (size_t y = 0; y < bm->height; ++y)
+		if (run > 0)
 		{
-			png_byte* row = png_malloc(png_ptr, sizeof (uint8_t) * bm->width * pixel_size);
-			row_pointers[y] = row;
-			for (size_t x = 0; x < bm->width; ++x)
+			*dst++ = (uint8_t)(NYX_QOI_OP_RUN | (run - 1));
+			run = 0;
+		}
+
+		const size_t slot = NYX_QOI_HASH(px);
+		if (0 == memcmp(&index[slot], &px, sizeof(rgba_pixel)))
+			*dst++ = (uint8_t)(NYX_QOI_OP_INDEX | slot);
+		else if (px.a == prev.a)
+		{
+			// small differences with the previous pixel, wrapping around
+			index[slot] = px;
+			const int dr = (int8_t)(px.r - prev.r);
+			const int dg = (int8_t)(px.g - prev.g);
+			const int db = (int8_t)(px.b - prev.b);
+			const int dr_dg = dr - dg;
+			const int db_dg = db - dg;
+			if ((dr >= -2) && (dr <= 1) && (dg >= -2) && (dg <= 1) && (db >= -2) && (db <= 1))
+				*dst++ = (uint8_t)(NYX_QOI_OP_DIFF | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2));
+			else if ((dg >= -32) && (dg <= 31) && (dr_dg >= -8) && (dr_dg <= 7) && (db_dg >= -8) && (db_dg <= 7))
 			{
-				const rgba_pixel pixel = pixels[((size_t)y * bm->width) + x];
-				if (NYX_MIN_PIXEL_COMPONENT_VALUE == pixel.a)
-				{
-					// replace the transparency by white
-					*row++ = NYX_MAX_PIXEL_COMPONENT_VALUE;
-					*row++ = NYX_MAX_PIXEL_COMPONENT_VALUE;
-					*row++ = NYX_MAX_PIXEL_COMPONENT_VALUE;
-				}
-				else
-				{
-					*row++ = pixel.r;
-					*row++ = pixel.g;
-					*row++ = pixel.b;
-				}
+				*dst++ = (uint8_t)(NYX_QOI_OP_LUMA | (dg + 32));
+				*dst++ = (uint8_t)(((dr_dg + 8) << 4) | (db_dg + 8));
 			}
+			else
+			{
+				*dst++ = NYX_QOI_OP_RGB;
+				*dst++ = px.r;
+				*dst++ = px.g;
+				*dst++ = px.b;
+			}
+		}
+		else
+		{
+			index[slot] = px;
+			*dst++ = NYX_QOI_OP_RGBA;
+			*dst++ = px.r;
+			*dst++ = px.g;
+			*dst++ = px.b;
+			*dst++ = px.a;
 		}
+		prev = px;
 	}
+	writer->qoi_prev = prev;
+	writer->qoi_run = run;
+	return (size_t)(dst - dst_start);
+}
 
-	// write image data
-	png_init_io(png_ptr, fp);
-	png_set_rows(png_ptr, info_ptr, row_pointers);
-	png_write_png(png_ptr, info_ptr, PNG_TRANSFORM_IDENTITY, NULL);
+static bool _nyx_img_png_open(img_row_writer* writer, const colorspace_t output_colorspace, const img_write_options* options)
+{
+	writer->write_row_fptr = _nyx_img_png_write_row;
+	writer->finish_fptr = _nyx_img_png_finish;
+	writer->file_format = (colorspace_rgba == output_colorspace) ? pixel_format_rgba32 : (colorspace_rgb == output_colorspace) ? pixel_format_rgb24 : pixel_format_gray8;
 
-	// cleanup
-	for (size_t y = 0; y < bm->height; y++)
-		png_free(png_ptr, row_pointers[y]);
-	png_free(png_ptr, row_pointers);
+	writer->png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	if (!writer->png_ptr)
+		return false;
+
+	writer->info_ptr = png_create_info_struct(writer->png_ptr);
+	if (!writer->info_ptr)
+		return false;
+
+	// error handling
+	if (setjmp(png_jmpbuf(writer->png_ptr)))
+		return false;
+
+	// set image attributes
+	const png_byte bit_depth = 8;
+	const png_byte color_type = (colorspace_rgba == output_colorspace) ? PNG_COLOR_TYPE_RGBA : (colorspace_rgb == output_colorspace) ? PNG_COLOR_TYPE_RGB : PNG_COLOR_TYPE_GRAY;
+	if (writer->fp)
+		png_init_io(writer->png_ptr, writer->fp);
+	else
+		png_set_write_fn(writer->png_ptr, writer, _nyx_img_png_write_memory, _nyx_img_png_flush_memory);
+	png_set_IHDR(writer->png_ptr, writer->info_ptr, (png_uint_32)writer->width, (png_uint_32)writer->height, bit_depth, color_type, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+	if (options)
+		_nyx_img_png_set_compression(writer->png_ptr, options);
+	png_write_info(writer->png_ptr, writer->info_ptr);
 
 	return true;
 }
 
-static bool _nyx_img_write_jpg(const char* filepath, const bitmap* bm)
+/**
+ * @brief Apply the zlib level, strategy and row filters of the options
+ * @param png_ptr [in] : PNG encoder, before the header is written
+ * @param options [in] : Encoding options
+ */
+static void _nyx_img_png_set_compression(png_structp png_ptr, const img_write_options* options)
 {
-	struct jpeg_compress_struct cinfo;
-	struct jpeg_error_mgr jerr;
+	if (options->png_compression_level != 0)
+		png_set_compression_level(png_ptr, (options->png_compression_level < 0) ? Z_NO_COMPRESSION : NYX_MIN(options->png_compression_level, Z_BEST_COMPRESSION));
 
-	FILE* fp = fopen(filepath, "wb");
-	if (!fp)
+	switch (options->png_strategy)
+	{
+		case png_strategy_filtered:
+			png_set_compression_strategy(png_ptr, Z_FILTERED);
+			break;
+		case png_strategy_huffman_only:
+			png_set_compression_strategy(png_ptr, Z_HUFFMAN_ONLY);
+			break;
+		case png_strategy_rle:
+			png_set_compression_strategy(png_ptr, Z_RLE);
+			break;
+		case png_strategy_fixed:
+			png_set_compression_strategy(png_ptr, Z_FIXED);
+			break;
+		case png_strategy_default:
+		default:
+			break;
+	}
+
+	if (options->png_filters != png_filter_default)
+	{
+		int filters = 0;
+		if (options->png_filters & png_filter_none)
+			filters |= PNG_FILTER_NONE;
+		if (options->png_filters & png_filter_sub)
+			filters |= PNG_FILTER_SUB;
+		if (options->png_filters & png_filter_up)
+			filters |= PNG_FILTER_UP;
+		if (options->png_filters & png_filter_avg)
+			filters |= PNG_FILTER_AVG;
+		if (options->png_filters & png_filter_paeth)
+			filters |= PNG_FILTER_PAETH;
+		png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, (filters != 0) ? filters : PNG_FILTER_NONE);
+	}
+}
+
+static bool _nyx_img_png_write_row(img_row_writer* writer, const uint8_t* row)
+{
+	if (setjmp(png_jmpbuf(writer->png_ptr)))
 		return false;
 
-	cinfo.err = jpeg_std_error(&jerr);
-	jpeg_create_compress(&cinfo);
-	jpeg_stdio_dest(&cinfo, fp);
+	png_write_row(writer->png_ptr, row);
+	return true;
+}
 
-	// set parameters for compression
-	cinfo.image_width = (JDIMENSION)bm->width;
-	cinfo.image_height = (JDIMENSION)bm->height;
-	cinfo.input_components = 3;
-	cinfo.in_color_space = JCS_RGB;
-	jpeg_set_defaults(&cinfo);
-	jpeg_set_quality(&cinfo, 100, TRUE);
-	jpeg_start_compress(&cinfo, TRUE);
-
-	// need to convert from RGBA to RGB24
-	uint8_t* buffer = bm->buffer;
-	const size_t stride = bm->stride;
-	while (cinfo.next_scanline < cinfo.image_height)
-	{
-		rgba_pixel* rgba_row = (rgba_pixel*)(&buffer[cinfo.next_scanline * stride]);
-		rgb_pixel* rgb_row = (rgb_pixel*)malloc(sizeof(rgb_pixel) * cinfo.image_width);
-		for (size_t i = 0; i < cinfo.image_width; i++)
-		{
-			if (NYX_MIN_PIXEL_COMPONENT_VALUE == rgba_row[i].a)
-			{
-				// replace the transparency by white
-				rgb_row[i].r = rgb_row[i].g = rgb_row[i].b = NYX_MAX_PIXEL_COMPONENT_VALUE;
-			}
-			else
-			{
-				rgb_row[i].r = rgba_row[i].r;
-				rgb_row[i].g = rgba_row[i].g;
-				rgb_row[i].b = rgba_row[i].b;
-			}
-		}
-		(void)jpeg_write_scanlines(&cinfo, (JSAMPROW[1]){(JSAMPROW)rgb_row}, 1);
-		free(rgb_row);
+static bool _nyx_img_png_finish(img_row_writer* writer, const bool complete)
+{
+	bool ret = complete;
+	if ((writer->png_ptr) && (complete))
+	{
+		if (setjmp(png_jmpbuf(writer->png_ptr)))
+			ret = false;
+		else
+			png_write_end(writer->png_ptr, NULL);
 	}
 
 	// cleanup
-	jpeg_finish_compress(&cinfo);
-	jpeg_destroy_compress(&cinfo);
-	fclose(fp);
+	if (writer->png_ptr)
+		png_destroy_write_struct(&writer->png_ptr, (writer->info_ptr) ? &writer->info_ptr : NULL);
+	return ret;
+}
+
+static void _nyx_img_png_write_memory(png_structp png_ptr, png_bytep data, png_size_t length)
+{
+	img_row_writer* writer = (img_row_writer*)png_get_io_ptr(png_ptr);
+	if (!nyx_img_buffer_append(writer->buffer, data, length))
+		png_error(png_ptr, "out of memory");
+}
+
+static void _nyx_img_png_flush_memory(png_structp png_ptr)
+{
+#pragma unused(png_ptr)
+}
+
+static bool _nyx_img_jpg_open(img_row_writer* writer, const colorspace_t output_colorspace, const img_write_options* options)
+{
+	struct jpeg_compress_struct* cinfo = &writer->cinfo;
+	cinfo->err = nyx_jpg_std_error(&writer->jerr);
+	writer->write_row_fptr = _nyx_img_jpg_write_row;
+	writer->finish_fptr = _nyx_img_jpg_finish;
+	if (setjmp(writer->jerr.jmp))
+		return false;
+
+	// compress to the file, or straight into the buffer
+	jpeg_create_compress(cinfo);
+	if (writer->fp)
+		jpeg_stdio_dest(cinfo, writer->fp);
+	else
+	{
+		writer->jdest.init_destination = _nyx_img_jpg_init_destination;
+		writer->jdest.empty_output_buffer = _nyx_img_jpg_empty_output_buffer;
+		writer->jdest.term_destination = _nyx_img_jpg_term_destination;
+		cinfo->dest = &writer->jdest;
+		cinfo->client_data = writer;
+	}
+
+	// JPEG has no alpha, the rows are given as they are when libjpeg can skip it
+	writer->file_format = nyx_jpg_get_scanline_format(writer->format, (colorspace_gray == output_colorspace));
+
+	// set parameters for compression
+	cinfo->image_width = (JDIMENSION)writer->width;
+	cinfo->image_height = (JDIMENSION)writer->height;
+	nyx_jpg_set_compress_params(cinfo, writer->file_format, options);
+	jpeg_start_compress(cinfo, TRUE);
 
 	return true;
 }
+
+static bool _nyx_img_jpg_write_row(img_row_writer* writer, const uint8_t* row)
+{
+	if (setjmp(writer->jerr.jmp))
+		return false;
+
+	// libjpeg doesn't modify the scanlines it is given, a row given as is is never writer->row
+	const uint8_t* scanline = nyx_jpg_get_opaque_scanline(row, writer->file_format, writer->row, writer->width);
+	return (jpeg_write_scanlines(&writer->cinfo, (JSAMPROW[1]){(JSAMPROW)scanline}, 1) == 1);
+}
+
+static bool _nyx_img_jpg_finish(img_row_writer* writer, const bool complete)
+{
+	bool ret = complete;
+	if (setjmp(writer->jerr.jmp))
+		ret = false;
+	else if (complete)
+		jpeg_finish_compress(&writer->cinfo);
+	else
+		jpeg_abort_compress(&writer->cinfo);
+	jpeg_destroy_compress(&writer->cinfo);
+	return ret;
+}
+
+static void _nyx_img_jpg_init_destination(j_compress_ptr cinfo)
+{
+	// libjpeg fills the free space of the buffer
+	img_row_writer* writer = (img_row_writer*)cinfo->client_data;
+	img_buffer* buffer = writer->buffer;
+	if (!nyx_img_buffer_reserve(buffer, buffer->size + 1))
+		ERREXIT(cinfo, JERR_OUT_OF_MEMORY);
+	cinfo->dest->next_output_byte = buffer->data + buffer->size;
+	cinfo->dest->free_in_buffer = buffer->capacity - buffer->size;
+}
+
+static boolean _nyx_img_jpg_empty_output_buffer(j_compress_ptr cinfo)
+{
+	// the free space is full, grow the buffer and carry on after it
+	img_row_writer* writer = (img_row_writer*)cinfo->client_data;
+	writer->buffer->size = writer->buffer->capacity;
+	_nyx_img_jpg_init_destination(cinfo);
+	return TRUE;
+}
+
+static void _nyx_img_jpg_term_destination(j_compress_ptr cinfo)
+{
+	img_row_writer* writer = (img_row_writer*)cinfo->client_data;
+	writer->buffer->size = writer->buffer->capacity - cinfo->dest->free_in_buffer;
+}
@@ -2,17 +2,173 @@
 #define __NYX_IMGWRITER_H__
 
 #include "bitmap.h"
+#include "tiled_bitmap.h"
 
 
+/* Growable buffer receiving encoded images, its memory is kept from one image to the next */
+typedef struct _nyx_img_buffer_struct
+{
+	uint8_t* data;
+	size_t size; // bytes of the encoded image
+	size_t capacity; // bytes allocated
+} img_buffer;
+
+/* zlib strategy of the PNG encoder */
+typedef enum _nyx_png_strategy_t {
+	png_strategy_default = 0, // libpng choice, filtered when rows are filtered
+	png_strategy_filtered,
+	png_strategy_huffman_only,
+	png_strategy_rle,
+	png_strategy_fixed,
+} png_strategy_t;
+
+/* PNG row filters the encoder picks from for each row, can be combined */
+typedef enum _nyx_png_filter_t {
+	png_filter_default = 0, // libpng choice, all of them for color images
+	png_filter_none = 1 << 0,
+	png_filter_sub = 1 << 1,
+	png_filter_up = 1 << 2,
+	png_filter_avg = 1 << 3,
+	png_filter_paeth = 1 << 4,
+} png_filter_t;
+
+/* Chroma subsampling of the JPEG encoder */
+typedef enum _nyx_jpg_subsampling_t {
+	jpg_subsampling_default = 0, // libjpeg choice, 4:2:0
+	jpg_subsampling_444,
+	jpg_subsampling_422,
+	jpg_subsampling_420,
+} jpg_subsampling_t;
+
+/* DCT of the JPEG encoder */
+typedef enum _nyx_jpg_dct_t {
+	jpg_dct_default = 0, // libjpeg choice, accurate integer
+	jpg_dct_islow, // accurate integer
+	jpg_dct_ifast, // faster, less accurate integer
+	jpg_dct_float,
+} jpg_dct_t;
+
+/* Encoding options, zeroed options are the defaults */
+typedef struct _nyx_img_write_options_struct
+{
+	bool tga_rle; // TGA run-length encoding, each packet stays within a row
+	int png_compression_level; // zlib level from 1 (fastest) to 9 (smallest), 0 for the libpng default, -1 to store the rows uncompressed
+	png_strategy_t png_strategy;
+	unsigned int png_filters; // png_filter_t flags, level 1 with png_filter_none | png_filter_sub is several times faster for intermediate files
+	int jpg_quality; // 1 to 100, 0 for 100
+	jpg_subsampling_t jpg_subsampling;
+	jpg_dct_t jpg_dct;
+	bool jpg_optimize_coding; // Huffman tables computed for the image, smaller but needs a second pass
+	bool jpg_progressive; // progressive scans, implies optimized Huffman tables
+} img_write_options;
+
 /**
  * @brief Save a bitmap object to a given path with a given type
  * @param filepath [in] : Path to save the file to
  * @param bm [in] : Bitmap
  * @param type [in] : image type to save to (currently only TGA/PNG supported)
- * @param output_colorspace [in] : colorspace to save the image (RGB, RGBA)
+ * @param output_colorspace [in] : colorspace to save the image (RGB, RGBA, gray), JPEG ignores alpha
+ * @param options [in] : {OPTIONAL} Encoding options, NULL for defaults
+ * @returns true if the bitmap was successfully written
+ */
+bool nyx_img_write_bitmap_to_file(const char* filepath, const bitmap* bm, const img_type_t type, const colorspace_t output_colorspace, const img_write_options* options);
+
+/**
+ * @brief Save a tiled bitmap object to a given path with a given type, rows are gathered one at a time
+ * @param filepath [in] : Path to save the file to
+ * @param tbm [in] : Tiled bitmap
+ * @param type [in] : image type to save to
+ * @param output_colorspace [in] : colorspace to save the image (RGB, RGBA, gray), JPEG ignores alpha
+ * @param options [in] : {OPTIONAL} Encoding options, NULL for defaults
  * @returns true if the bitmap was successfully written
  */
-bool nyx_img_write_bitmap_to_file(const char* filepath, const bitmap* bm, const img_type_t type, const colorspace_t output_colorspace);
+bool nyx_img_write_tiled_bitmap_to_file(const char* filepath, const tiled_bitmap* tbm, const img_type_t type, const colorspace_t output_colorspace, const img_write_options* options);
+
+/**
+ * @brief Encode a bitmap object in memory with a given type
+ * @param bm [in] : Bitmap
+ * @param type [in] : image type to encode to
+ * @param output_colorspace [in] : colorspace to save the image (RGB, RGBA, gray), JPEG ignores alpha
+ * @param options [in] : {OPTIONAL} Encoding options, NULL for defaults
+ * @param out_buffer [out] : receives the encoded image, its previous content is replaced and its memory reused
+ * @returns true if the bitmap was successfully encoded
+ */
+bool nyx_img_write_to_memory(const bitmap* bm, const img_type_t type, const colorspace_t output_colorspace, const img_write_options* options, img_buffer* out_buffer);
+
+/*** Memory buffer ***/
+
+/**
+ * @brief Initialize an empty buffer
+ * @param buffer [in] : buffer
+ */
+void nyx_img_buffer_init(img_buffer* buffer);
+
+/**
+ * @brief Free the memory of a buffer, it is left empty and can be used again
+ * @param buffer [in] : buffer
+ */
+void nyx_img_buffer_free(img_buffer* buffer);
+
+/**
+ * @brief Make sure a buffer can hold a number of bytes, it grows geometrically
+ * @param buffer [in] : buffer
+ * @param capacity [in] : number of bytes
+ * @returns true if all OK, false if memory alloc failed (the buffer is unchanged)
+ */
+bool nyx_img_buffer_reserve(img_buffer* buffer, const size_t capacity);
+
+/**
+ * @brief Append bytes at the end of a buffer
+ * @param buffer [in] : buffer
+ * @param bytes [in] : bytes to append
+ * @param num_bytes [in] : number of bytes
+ * @returns true if all OK, false if memory alloc failed
+ */
+bool nyx_img_buffer_append(img_buffer* buffer, const void* bytes, const size_t num_bytes);
+
+/*** Row writer ***/
+
+/* Image encoder fed one row at a time, from top to bottom */
+typedef struct _nyx_img_row_writer_struct img_row_writer;
+
+/**
+ * @brief Create an image file and start encoding it, only one row is kept in memory
+ * @param filepath [in] : Path to save the file to
+ * @param img_size [in] : size of the image
+ * @param format [in] : pixel format of the rows given to nyx_img_row_writer_write_row()
+ * @param type [in] : image type to save to
+ * @param output_colorspace [in] : colorspace to save the image (RGB, RGBA, gray), JPEG ignores alpha
+ * @param options [in] : {OPTIONAL} Encoding options, NULL for defaults
+ * @returns the writer, NULL if the file can't be created
+ */
+img_row_writer* nyx_img_row_writer_open(const char* filepath, const size img_size, const pixel_format_t format, const img_type_t type, const colorspace_t output_colorspace, const img_write_options* options);
+
+/**
+ * @brief Start encoding an image in memory, only one row is kept besides the encoded bytes
+ * @param buffer [in] : receives the encoded image, its previous content is replaced, must stay valid until the writer is closed
+ * @param img_size [in] : size of the image
+ * @param format [in] : pixel format of the rows given to nyx_img_row_writer_write_row()
+ * @param type [in] : image type to encode to
+ * @param output_colorspace [in] : colorspace to save the image (RGB, RGBA, gray), JPEG ignores alpha
+ * @param options [in] : {OPTIONAL} Encoding options, NULL for defaults
+ * @returns the writer, NULL if the encoder can't be set up
+ */
+img_row_writer* nyx_img_row_writer_open_memory(img_buffer* buffer, const size img_size, const pixel_format_t format, const img_type_t type, const colorspace_t output_colorspace, const img_write_options* options);
+
+/**
+ * @brief Encode the next row, transparency is replaced by white when alpha is dropped
+ * @param writer [in] : writer
+ * @param row [in] : pixels, width * bytes per pixel of the writer format
+ * @returns true if all OK
+ */
+bool nyx_img_row_writer_write_row(img_row_writer* writer, const uint8_t* row);
+
+/**
+ * @brief Finish the image and close the file, if any
+ * @param writer [in] : writer to close
+ * @returns true if all the rows were written and the file is complete
+ */
+bool nyx_img_row_writer_close(img_row_writer* writer);
 
 
 #endif /* __NYX_IMGWRITER_H__ */
@@ -0,0 +1,691 @@
+#include "img_writer_parallel.h"
+#include "pixel_convert.h"
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#include "img_jpg.h"
+
+
+/* Filtered bytes deflated by a task, the dictionary overlap with the previous block stays negligible */
+#define NYX_PNG_BLOCK_SIZE ((size_t)256 * 1024)
+/* Deflate window, the end of the previous block primes the dictionary of the next one */
+#define NYX_PNG_DICT_SIZE ((size_t)32 * 1024)
+/* Number of PNG filter types */
+#define NYX_PNG_NUM_FILTERS 5
+/* MCU rows of a JPEG strip, a multiple of 8 so the restart markers inside a strip already have their final numbers */
+#define NYX_JPG_STRIP_MCU_ROWS 16
+/* Largest JPEG dimension */
+#define NYX_JPG_MAX_DIMENSION 65535
+
+/* Where the encoded bytes go */
+typedef struct _nyx_img_output_struct
+{
+	FILE* fp; // NULL when encoding in memory
+	img_buffer* buffer;
+} img_output;
+
+/* Block of rows of a parallel PNG, filtered and deflated by one task */
+typedef struct _nyx_png_block_struct
+{
+	img_buffer data; // deflated bytes, the first block starts with the zlib header
+	uLong adler; // adler32 of the filtered bytes
+	size_t length; // number of filtered bytes
+	bool ok;
+} png_block;
+
+/* Strip of MCU rows of a parallel JPEG, encoded as a standalone JPEG by one task */
+typedef struct _nyx_jpg_strip_struct
+{
+	unsigned char* jpeg; // encoded strip, to free
+	unsigned long jpeg_size;
+	size_t scan_begin; // first byte of the entropy-coded data
+	size_t sof; // offset of the frame header marker
+	bool ok;
+} jpg_strip;
+
+/* Parallel JPEG encoding job */
+typedef struct _nyx_jpg_job_struct
+{
+	const bitmap* bm;
+	pixel_format_t file_format; // pixel format of the scanlines
+	const img_write_options* options;
+	size_t strip_height; // rows of a strip
+	jpg_strip* strips;
+} jpg_job;
+
+/* Parallel PNG encoding job */
+typedef struct _nyx_png_job_struct
+{
+	const bitmap* bm;
+	pixel_format_t file_format;
+	size_t bpp; // bytes per pixel of file_format
+	size_t line_size; // bytes of a row of file_format pixels
+	size_t rows_per_block;
+	size_t dict_rows; // rows before a block covering the deflate window
+	int level;
+	int strategy;
+	unsigned int filters; // png_filter_t flags, at least one
+	png_block* blocks;
+} png_job;
+
+
+static bool _nyx_img_has_parallel_encoder(const img_type_t type, const img_write_options* options);
+static bool _nyx_img_write_parallel(worker_pool* pool, img_output* output, const bitmap* bm, const img_type_t type, const colorspace_t output_colorspace, const img_write_options* options);
+static bool _nyx_img_output_write(img_output* output, const void* bytes, const size_t num_bytes);
+static bool _nyx_img_jpg_write_parallel(worker_pool* pool, img_output* output, const bitmap* bm, const colorspace_t output_colorspace, const img_write_options* options);
+static void _nyx_jpg_strip_task(void* ctx, const size_t task, const size_t worker);
+static size_t _nyx_jpg_get_mcu_height(const pixel_format_t scanline_format, const img_write_options* options);
+static bool _nyx_jpg_find_scan(jpg_strip* strip);
+static bool _nyx_img_png_write_parallel(worker_pool* pool, img_output* output, const bitmap* bm, const colorspace_t output_colorspace, const img_write_options* options);
+static void _nyx_png_block_task(void* ctx, const size_t task, const size_t worker);
+static bool _nyx_png_deflate_block(const png_job* job, png_block* block, const uint8_t* dict, const size_t dict_size, const uint8_t* src, const size_t src_size, const bool first, const bool last);
+static void _nyx_png_filter_row(const png_job* job, const uint8_t* row, const uint8_t* prev, uint8_t* dst, uint8_t* scratch);
+static size_t _nyx_png_apply_filter_type(const uint8_t type, const uint8_t* row, const uint8_t* prev, const size_t line_size, const size_t bpp, uint8_t* dst);
+static inline size_t _nyx_png_apply_filter(const uint8_t type, const uint8_t* row, const uint8_t* prev, const size_t line_size, const size_t bpp, uint8_t* dst);
+static bool _nyx_png_write_chunk(img_output* output, const char* type, const uint8_t* data, const size_t size);
+static void _nyx_png_store_u32(uint8_t* dst, const uint32_t value);
+static uint16_t _nyx_png_zlib_header(const int level, const int strategy);
+
+
+bool nyx_img_write_bitmap_to_file_parallel(worker_pool* pool, const char* filepath, const bitmap* bm, const img_type_t type, const colorspace_t output_colorspace, const img_write_options* options)
+{
+	// Sanity checks
+	if ((!pool) || (!filepath) || (!bm))
+		return false;
+
+	if (!_nyx_img_has_parallel_encoder(type, options))
+		return nyx_img_write_bitmap_to_file(filepath, bm, type, output_colorspace, options);
+
+	img_output output = (img_output){.fp = fopen(filepath, "wb"), .buffer = NULL};
+	if (!output.fp)
+	{
+		NYX_ERRLOG("[!] failed to create <%s>\n", filepath);
+		return false;
+	}
+	bool ret = _nyx_img_write_parallel(pool, &output, bm, type, output_colorspace, options);
+	if (fclose(output.fp) != 0)
+		ret = false;
+
+	return ret;
+}
+
+bool nyx_img_write_to_memory_parallel(worker_pool* pool, const bitmap* bm, const img_type_t type, const colorspace_t output_colorspace, const img_write_options* options, img_buffer* out_buffer)
+{
+	// Sanity checks
+	if ((!pool) || (!bm) || (!out_buffer))
+		return false;
+
+	if (!_nyx_img_has_parallel_encoder(type, options))
+		return nyx_img_write_to_memory(bm, type, output_colorspace, options, out_buffer);
+
+	out_buffer->size = 0;
+	img_output output = (img_output){.fp = NULL, .buffer = out_buffer};
+	return _nyx_img_write_parallel(pool, &output, bm, type, output_colorspace, options);
+}
+
+/*** Private ***/
+/**
+ * @brief Check if an image can be encoded in parallel
+ * @param type [in] : image type
+ * @param options [in] : {OPTIONAL} Encoding options
+ * @returns false for TGA, and for progressive or optimized JPEG whose scans and Huffman tables cover the whole image
+ */
+static bool _nyx_img_has_parallel_encoder(const img_type_t type, const img_write_options* options)
+{
+	switch (type)
+	{
+		case img_type_png:
+			return true;
+		case img_type_jpg:
+			return (!options) || ((!options->jpg_progressive) && (!options->jpg_optimize_coding));
+		default:
+			return false;
+	}
+}
+
+static bool _nyx_img_write_parallel(worker_pool* pool, img_output* output, const bitmap* bm, const img_type_t type, const colorspace_t output_colorspace, const img_write_options* options)
+{
+	if (img_type_jpg == type)
+		return _nyx_img_jpg_write_parallel(pool, output, bm, output_colorspace, options);
+	return _nyx_img_png_write_parallel(pool, output, bm, output_colorspace, options);
+}
+
+static bool _nyx_img_output_write(img_output* output, const void* bytes, const size_t num_bytes)
+{
+	if (output->fp)
+		return (fwrite(bytes, sizeof(uint8_t), num_bytes, output->fp) == num_bytes);
+	return nyx_img_buffer_append(output->buffer, bytes, num_bytes);
+}
+
+/**
+ * @brief Encode a baseline JPEG, strips of MCU rows are encoded as standalone JPEGs with a restart marker every MCU row,
+ * then their entropy-coded data is stitched after the headers of the first one, separated by restart markers
+ * @param pool [in] : workers
+ * @param output [in] : where to write the JPEG
+ * @param bm [in] : Bitmap
+ * @param output_colorspace [in] : colorspace to save the image, alpha is ignored
+ * @param options [in] : {OPTIONAL} Encoding options, baseline with the standard Huffman tables
+ * @returns true if the image was successfully written
+ */
+static bool _nyx_img_jpg_write_parallel(worker_pool* pool, img_output* output, const bitmap* bm, const colorspace_t output_colorspace, const img_write_options* options)
+{
+	if ((0 == bm->width) || (0 == bm->height) || (bm->width > NYX_JPG_MAX_DIMENSION) || (bm->height > NYX_JPG_MAX_DIMENSION))
+		return false;
+	if ((output_colorspace != colorspace_rgba) && (output_colorspace != colorspace_rgb) && (output_colorspace != colorspace_gray))
+		return false;
+
+	const pixel_format_t file_format = nyx_jpg_get_scanline_format(bm->format, (colorspace_gray == output_colorspace));
+	const size_t mcu_height = _nyx_jpg_get_mcu_height(file_format, options);
+	if (0 == mcu_height)
+		return false;
+	jpg_job job = (jpg_job){.bm = bm, .file_format = file_format, .options = options, .strip_height = mcu_height * NYX_JPG_STRIP_MCU_ROWS};
+	const size_t num_strips = (bm->height + job.strip_height - 1) / job.strip_height;
+	job.strips = (jpg_strip*)calloc(num_strips, sizeof(jpg_strip));
+	if (!job.strips)
+		return false;
+	(void)nyx_worker_pool_run(pool, num_strips, _nyx_jpg_strip_task, &job);
+
+	bool ret = true;
+	for (size_t i = 0; (i < num_strips) && (ret); i++)
+		ret = (job.strips[i].ok) && (_nyx_jpg_find_scan(&job.strips[i]));
+
+	// headers of the first strip with the full image height, its scan, then the other scans
+	if (ret)
+	{
+		jpg_strip* first = &job.strips[0];
+		first->jpeg[first->sof + 5] = (uint8_t)(bm->height >> 8);
+		first->jpeg[first->sof + 6] = (uint8_t)(bm->height & 0xFF);
+		ret = _nyx_img_output_write(output, first->jpeg, first->jpeg_size - 2);
+	}
+	for (size_t i = 1; (i < num_strips) && (ret); i++)
+	{
+		// restart markers count MCU rows modulo 8, the previous strip ended right before the one starting this strip
+		const uint8_t marker[2] = {0xFF, (uint8_t)(0xD0 + (((i * NYX_JPG_STRIP_MCU_ROWS) - 1) & 7))};
+		const jpg_strip* strip = &job.strips[i];
+		ret = _nyx_img_output_write(output, marker, sizeof(marker)) && _nyx_img_output_write(output, strip->jpeg + strip->scan_begin, strip->jpeg_size - 2 - strip->scan_begin);
+	}
+	if (ret)
+	{
+		static const uint8_t eoi[2] = {0xFF, 0xD9};
+		ret = _nyx_img_output_write(output, eoi, sizeof(eoi));
+	}
+
+	for (size_t i = 0; i < num_strips; i++)
+		free(job.strips[i].jpeg);
+	free(job.strips);
+
+	return ret;
+}
+
+/**
+ * @brief Encode a strip of rows as a standalone JPEG with a restart interval of one MCU row
+ * @param ctx [in] : jpg_job
+ * @param task [in] : strip index
+ * @param worker [in] : worker index
+ */
+static void _nyx_jpg_strip_task(void* ctx, const size_t task, const size_t worker)
+{
+#pragma unused(worker)
+	const jpg_job* job = (const jpg_job*)ctx;
+	jpg_strip* strip = &job->strips[task];
+	const bitmap* bm = job->bm;
+	const size_t y_begin = task * job->strip_height;
+	const size_t y_end = NYX_MIN(y_begin + job->strip_height, bm->height);
+	uint8_t* row = (uint8_t*)malloc(bm->width * nyx_bytes_per_pixel_for_format(job->file_format));
+	if (!row)
+		return;
+
+	struct jpeg_compress_struct cinfo;
+	jpg_error_mgr jerr;
+	cinfo.err = nyx_jpg_std_error(&jerr);
+	if (setjmp(jerr.jmp))
+	{
+		jpeg_destroy_compress(&cinfo);
+		free(row);
+		return;
+	}
+	jpeg_create_compress(&cinfo);
+	jpeg_mem_dest(&cinfo, &strip->jpeg, &strip->jpeg_size);
+	cinfo.image_width = (JDIMENSION)bm->width;
+	cinfo.image_height = (JDIMENSION)(y_end - y_begin);
+	nyx_jpg_set_compress_params(&cinfo, job->file_format, job->options);
+	cinfo.restart_in_rows = 1;
+	jpeg_start_compress(&cinfo, TRUE);
+	for (size_t y = y_begin; y < y_end; y++)
+	{
+		const uint8_t* src = (const uint8_t*)bm->buffer + (y * bm->stride);
+		const uint8_t* scanline = row;
+		if (bm->format != job->file_format)
+			nyx_px_convert_row_opaque(src, bm->format, row, job->file_format, bm->width);
+		else
+			scanline = nyx_jpg_get_opaque_scanline(src, job->file_format, row, bm->width);
+		(void)jpeg_write_scanlines(&cinfo, (JSAMPROW[1]){(JSAMPROW)scanline}, 1);
+	}
+	jpeg_finish_compress(&cinfo);
+	jpeg_destroy_compress(&cinfo);
+	free(row);
+	strip->ok = true;
+}
+
+/**
+ * @brief Get the height of an MCU row with the compression parameters
+ * @param scanline_format [in] : pixel format of the scanlines
+ * @param options [in] : {OPTIONAL} Encoding options
+ * @returns the number of rows of an MCU, 0 if libjpeg failed
+ */
+static size_t _nyx_jpg_get_mcu_height(const pixel_format_t scanline_format, const img_write_options* options)
+{
+	struct jpeg_compress_struct cinfo;
+	jpg_error_mgr jerr;
+	cinfo.err = nyx_jpg_std_error(&jerr);
+	if (setjmp(jerr.jmp))
+	{
+		jpeg_destroy_compress(&cinfo);
+		return 0;
+	}
+	jpeg_create_compress(&cinfo);
+	cinfo.image_width = cinfo.image_height = 1;
+	nyx_jpg_set_compress_params(&cinfo, scanline_format, options);
+	int max_v_samp_factor = 1;
+	for (int i = 0; i < cinfo.num_components; i++)
+		max_v_samp_factor = NYX_MAX(max_v_samp_factor, cinfo.comp_info[i].v_samp_factor);
+	jpeg_destroy_compress(&cinfo);
+
+	return (size_t)max_v_samp_factor * DCTSIZE;
+}
+
+/**
+ * @brief Walk the markers of an encoded strip up to its scan
+ * @param strip [in] : strip, receives the offsets of its frame header and entropy-coded data
+ * @returns false if the strip isn't a single scan JPEG ended by EOI
+ */
+static bool _nyx_jpg_find_scan(jpg_strip* strip)
+{
+	const uint8_t* data = strip->jpeg;
+	const size_t size = (size_t)strip->jpeg_size;
+	if ((size < 4) || (data[size - 2] != 0xFF) || (data[size - 1] != 0xD9))
+		return false;
+
+	bool has_sof = false;
+	size_t pos = 2; // SOI
+	while (pos + 4 <= size)
+	{
+		if (data[pos] != 0xFF)
+			return false;
+		const uint8_t marker = data[pos + 1];
+		const size_t length = ((size_t)data[pos + 2] << 8) | data[pos + 3];
+		if ((marker >= 0xC0) && (marker <= 0xC2))
+		{
+			strip->sof = pos;
+			has_sof = true;
+		}
+		else if (0xDA == marker)
+		{
+			strip->scan_begin = pos + 2 + length;
+			return (has_sof) && (strip->scan_begin <= size - 2);
+		}
+		pos += 2 + length;
+	}
+	return false;
+}
+
+/**
+ * @brief Encode a PNG, blocks of rows are filtered and deflated by the workers then written in order as IDAT chunks
+ * @param pool [in] : workers
+ * @param output [in] : where to write the PNG
+ * @param bm [in] : Bitmap
+ * @param output_colorspace [in] : colorspace to save the image
+ * @param options [in] : {OPTIONAL} Encoding options
+ * @returns true if the image was successfully written
+ */
+static bool _nyx_img_png_write_parallel(worker_pool* pool, img_output* output, const bitmap* bm, const colorspace_t output_colorspace, const img_write_options* options)
+{
+	if ((0 == bm->width) || (0 == bm->height) || (bm->width > 0x7FFFFFFF) || (bm->height > 0x7FFFFFFF))
+		return false;
+
+	png_job job = (png_job){.bm = bm};
+	uint8_t color_type;
+	switch (output_colorspace)
+	{
+		case colorspace_rgba:
+			job.file_format = pixel_format_rgba32;
+			color_type = 6;
+			break;
+		case colorspace_rgb:
+			job.file_format = pixel_format_rgb24;
+			color_type = 2;
+			break;
+		case colorspace_gray:
+			job.file_format = pixel_format_gray8;
+			color_type = 0;
+			break;
+		default:
+			return false;
+	}
+	job.bpp = nyx_bytes_per_pixel_for_format(job.file_format);
+	job.line_size = bm->width * job.bpp;
+	const size_t row_size = job.line_size + 1; // filter type byte
+	job.rows_per_block = NYX_MAX(1, NYX_PNG_BLOCK_SIZE / row_size);
+	job.dict_rows = (NYX_PNG_DICT_SIZE + row_size - 1) / row_size;
+
+	// same settings as the serial writer, libpng filters 8-bit rows with all the filters and then prefers Z_FILTERED
+	const int level = (options) ? options->png_compression_level : 0;
+	job.level = (0 == level) ? Z_DEFAULT_COMPRESSION : (level < 0) ? Z_NO_COMPRESSION : NYX_MIN(level, Z_BEST_COMPRESSION);
+	job.filters = ((options) && (options->png_filters != png_filter_default)) ? options->png_filters : (png_filter_none | png_filter_sub | png_filter_up | png_filter_avg | png_filter_paeth);
+	if (0 == (job.filters & (png_filter_none | png_filter_sub | png_filter_up | png_filter_avg | png_filter_paeth)))
+		job.filters = png_filter_none;
+	switch ((options) ? options->png_strategy : png_strategy_default)
+	{
+		case png_strategy_filtered:
+			job.strategy = Z_FILTERED;
+			break;
+		case png_strategy_huffman_only:
+			job.strategy = Z_HUFFMAN_ONLY;
+			break;
+		case png_strategy_rle:
+			job.strategy = Z_RLE;
+			break;
+		case png_strategy_fixed:
+			job.strategy = Z_FIXED;
+			break;
+		case png_strategy_default:
+		default:
+			job.strategy = (png_filter_none == job.filters) ? Z_DEFAULT_STRATEGY : Z_FILTERED;
+			break;
+	}
+
+	const size_t num_blocks = (bm->height + job.rows_per_block - 1) / job.rows_per_block;
+	job.blocks = (png_block*)calloc(num_blocks, sizeof(png_block));
+	if (!job.blocks)
+		return false;
+	(void)nyx_worker_pool_run(pool, num_blocks, _nyx_png_block_task, &job);
+
+	// single zlib stream, the adler32 of the blocks are combined in order
+	bool ret = true;
+	uLong adler = adler32(0L, Z_NULL, 0);
+	for (size_t i = 0; (i < num_blocks) && (ret); i++)
+	{
+		ret = job.blocks[i].ok;
+		adler = adler32_combine(adler, job.blocks[i].adler, (z_off_t)job.blocks[i].length);
+	}
+	if (ret)
+	{
+		uint8_t trailer[4];
+		_nyx_png_store_u32(trailer, (uint32_t)adler);
+		ret = nyx_img_buffer_append(&job.blocks[num_blocks - 1].data, trailer, sizeof(trailer));
+	}
+
+	// signature, header, one IDAT per block, end
+	if (ret)
+	{
+		static const uint8_t signature[8] = {137, 'P', 'N', 'G', '\r', '\n', 26, '\n'};
+		uint8_t ihdr[13] = {0};
+		_nyx_png_store_u32(ihdr, (uint32_t)bm->width);
+		_nyx_png_store_u32(ihdr + 4, (uint32_t)bm->height);
+		ihdr[8] = 8; // bit depth
+		ihdr[9] = color_type; // compression, filter and interlace methods are 0
+		ret = _nyx_img_output_write(output, signature, sizeof(signature)) && _nyx_png_write_chunk(output, "IHDR", ihdr, sizeof(ihdr));
+	}
+	for (size_t i = 0; (i < num_blocks) && (ret); i++)
+		ret = _nyx_png_write_chunk(output, "IDAT", job.blocks[i].data.data, job.blocks[i].data.size);
+	if (ret)
+		ret = _nyx_png_write_chunk(output, "IEND", NULL, 0);
+
+	for (size_t i = 0; i < num_blocks; i++)
+		nyx_img_buffer_free(&job.blocks[i].data);
+	free(job.blocks);
+
+	return ret;
+}
+
+/**
+ * @brief Filter and deflate a block of rows, the rows covering the deflate window before it are filtered again as its dictionary
+ * @param ctx [in] : png_job
+ * @param task [in] : block index
+ * @param worker [in] : worker index
+ */
+static void _nyx_png_block_task(void* ctx, const size_t task, const size_t worker)
+{
+#pragma unused(worker)
+	const png_job* job = (const png_job*)ctx;
+	png_block* block = &job->blocks[task];
+	const bitmap* bm = job->bm;
+	const size_t row_size = job->line_size + 1;
+	const size_t y_begin = task * job->rows_per_block;
+	const size_t y_end = NYX_MIN(y_begin + job->rows_per_block, bm->height);
+	const size_t y_dict = (y_begin > job->dict_rows) ? (y_begin - job->dict_rows) : 0;
+
+	// filtered rows, previous and current rows in the file format, candidate filtered row
+	uint8_t* filtered = (uint8_t*)malloc((y_end - y_dict) * row_size);
+	uint8_t* rows = (uint8_t*)malloc((2 * job->line_size) + row_size);
+	if ((!filtered) || (!rows))
+	{
+		free(rows);
+		free(filtered);
+		return;
+	}
+	uint8_t* prev = rows;
+	uint8_t* cur = rows + job->line_size;
+	uint8_t* scratch = rows + (2 * job->line_size);
+	if (y_dict > 0)
+		nyx_px_convert_row_opaque((const uint8_t*)bm->buffer + ((y_dict - 1) * bm->stride), bm->format, prev, job->file_format, bm->width);
+	else
+		memset(prev, 0, job->line_size);
+	for (size_t y = y_dict; y < y_end; y++)
+	{
+		nyx_px_convert_row_opaque((const uint8_t*)bm->buffer + (y * bm->stride), bm->format, cur, job->file_format, bm->width);
+		_nyx_png_filter_row(job, cur, prev, filtered + ((y - y_dict) * row_size), scratch);
+		uint8_t* tmp = prev;
+		prev = cur;
+		cur = tmp;
+	}
+	free(rows);
+
+	const size_t dict_size = (y_begin - y_dict) * row_size;
+	const size_t src_size = (y_end - y_begin) * row_size;
+	block->ok = _nyx_png_deflate_block(job, block, filtered, dict_size, filtered + dict_size, src_size, (0 == task), (y_end == bm->height));
+	free(filtered);
+}
+
+/**
+ * @brief Deflate the filtered rows of a block as a part of a zlib stream, ended by a sync flush so the next block starts on a byte boundary
+ * @param job [in] : job
+ * @param block [in] : block, receives the deflated bytes and the adler32 of src
+ * @param dict [in] : filtered rows before the block
+ * @param dict_size [in] : size of dict in bytes, the last 32KB prime the compressor
+ * @param src [in] : filtered rows of the block
+ * @param src_size [in] : size of src in bytes
+ * @param first [in] : first block, starts with the zlib header
+ * @param last [in] : last block, finishes the deflate stream
+ * @returns true if all OK
+ */
+static bool _nyx_png_deflate_block(const png_job* job, png_block* block, const uint8_t* dict, const size_t dict_size, const uint8_t* src, const size_t src_size, const bool first, const bool last)
+{
+	z_stream strm;
+	memset(&strm, 0, sizeof(strm));
+	if (deflateInit2(&strm, job->level, Z_DEFLATED, -MAX_WBITS, 8, job->strategy) != Z_OK)
+		return false;
+
+	bool ret = true;
+	if (dict_size > 0)
+	{
+		const size_t size = NYX_MIN(dict_size, NYX_PNG_DICT_SIZE);
+		ret = (deflateSetDictionary(&strm, dict + dict_size - size, (uInt)size) == Z_OK);
+	}
+	if ((ret) && (first))
+	{
+		const uint16_t header = _nyx_png_zlib_header(job->level, job->strategy);
+		const uint8_t bytes[2] = {(uint8_t)(header >> 8), (uint8_t)(header & 0xFF)};
+		ret = nyx_img_buffer_append(&block->data, bytes, sizeof(bytes));
+	}
+	block->adler = adler32(adler32(0L, Z_NULL, 0), src, (uInt)src_size);
+	block->length = src_size;
+
+	// the bound leaves room for the flush markers, the loop only goes on if it was too tight
+	strm.next_in = (Bytef*)src;
+	strm.avail_in = (uInt)src_size;
+	const int flush = (last) ? Z_FINISH : Z_SYNC_FLUSH;
+	size_t reserve = deflateBound(&strm, (uLong)src_size) + 16;
+	int status = Z_OK;
+	while (ret)
+	{
+		ret = nyx_img_buffer_reserve(&block->data, block->data.size + reserve);
+		if (!ret)
+			break;
+		strm.next_out = block->data.data + block->data.size;
+		strm.avail_out = (uInt)(block->data.capacity - block->data.size);
+		status = deflate(&strm, flush);
+		block->data.size = block->data.capacity - strm.avail_out;
+		if ((status != Z_OK) && (status != Z_STREAM_END) && (status != Z_BUF_ERROR))
+			ret = false;
+		else if ((last) ? (Z_STREAM_END == status) : (strm.avail_out > 0))
+			break;
+		reserve = block->data.capacity;
+	}
+	deflateEnd(&strm);
+
+	return ret;
+}
+
+/**
+ * @brief Filter a row with each allowed filter type and keep the one with the smallest sum of absolute differences, like libpng does
+ * @param job [in] : job
+ * @param row [in] : row, in the file format
+ * @param prev [in] : previous row, zeroed for the first one
+ * @param dst [out] : filtered row, filter type byte first
+ * @param scratch [in] : a filtered row worth of memory
+ */
+static void _nyx_png_filter_row(const png_job* job, const uint8_t* row, const uint8_t* prev, uint8_t* dst, uint8_t* scratch)
+{
+	static const unsigned int filters[NYX_PNG_NUM_FILTERS] = {png_filter_none, png_filter_sub, png_filter_up, png_filter_avg, png_filter_paeth};
+	size_t best_sum = SIZE_MAX;
+	uint8_t* best = dst;
+	uint8_t* candidate = dst;
+	for (uint8_t type = 0; type < NYX_PNG_NUM_FILTERS; type++)
+	{
+		if (0 == (job->filters & filters[type]))
+			continue;
+		const size_t sum = _nyx_png_apply_filter_type(type, row, prev, job->line_size, job->bpp, candidate);
+		if (sum < best_sum)
+		{
+			best_sum = sum;
+			best = candidate;
+			candidate = (candidate == dst) ? scratch : dst;
+		}
+	}
+	if (best != dst)
+		memcpy(dst, best, job->line_size + 1);
+}
+
+static size_t _nyx_png_apply_filter_type(const uint8_t type, const uint8_t* row, const uint8_t* prev, const size_t line_size, const size_t bpp, uint8_t* dst)
+{
+	// types are constants once inlined, so each one gets its own loop
+	switch (type)
+	{
+		case 0:
+			return _nyx_png_apply_filter(0, row, prev, line_size, bpp, dst);
+		case 1:
+			return _nyx_png_apply_filter(1, row, prev, line_size, bpp, dst);
+		case 2:
+			return _nyx_png_apply_filter(2, row, prev, line_size, bpp, dst);
+		case 3:
+			return _nyx_png_apply_filter(3, row, prev, line_size, bpp, dst);
+		default:
+			return _nyx_png_apply_filter(4, row, prev, line_size, bpp, dst);
+	}
+}
+
+/**
+ * @brief Apply a PNG filter to a row
+ * @param type [in] : filter type, 0 none, 1 sub, 2 up, 3 average, 4 Paeth
+ * @param row [in] : row
+ * @param prev [in] : previous row
+ * @param line_size [in] : bytes of the row
+ * @param bpp [in] : bytes per pixel
+ * @param dst [out] : filtered row, filter type byte first
+ * @returns the sum of the filtered bytes as signed absolute values
+ */
+static inline size_t _nyx_png_apply_filter(const uint8_t type, const uint8_t* row, const uint8_t* prev, const size_t line_size, const size_t bpp, uint8_t* dst)
+{
+	*dst++ = type;
+	size_t sum = 0;
+	for (size_t i = 0; i < line_size; i++)
+	{
+		const int a = (i >= bpp) ? row[i - bpp] : 0;
+		const int b = prev[i];
+		int predictor;
+		switch (type)
+		{
+			case 1:
+				predictor = a;
+				break;
+			case 2:
+				predictor = b;
+				break;
+			case 3:
+				predictor = (a + b) >> 1;
+				break;
+			case 4:
+			{
+				const int c = (i >= bpp) ? prev[i - bpp] : 0;
+				const int pa = abs(b - c);
+				const int pb = abs(a - c);
+				const int pc = abs(a + b - (2 * c));
+				predictor = ((pa <= pb) && (pa <= pc)) ? a : (pb <= pc) ? b : c;
+				break;
+			}
+			default:
+				predictor = 0;
+				break;
+		}
+		const uint8_t value = (uint8_t)(row[i] - predictor);
+		dst[i] = value;
+		sum += (value < 128) ? value : (256 - value);
+	}
+	return sum;
+}
+
+static bool _nyx_png_write_chunk(img_output* output, const char* type, const uint8_t* data, const size_t size)
+{
+	uint8_t header[8];
+	_nyx_png_store_u32(header, (uint32_t)size);
+	memcpy(header + 4, type, 4);
+	uLong crc = crc32(0L, header + 4, 4);
+	if (size > 0)
+		crc = crc32(crc, data, (uInt)size);
+	uint8_t trailer[4];
+	_nyx_png_store_u32(trailer, (uint32_t)crc);
+
+	return _nyx_img_output_write(output, header, sizeof(header)) && ((0 == size) || (_nyx_img_output_write(output, data, size))) && _nyx_img_output_write(output, trailer, sizeof(trailer));
+}
+
+static void _nyx_png_store_u32(uint8_t* dst, const uint32_t value)
+{
+	// PNG is big endian
+	dst[0] = (uint8_t)(value >> 24);
+	dst[1] = (uint8_t)(value >> 16);
+	dst[2] = (uint8_t)(value >> 8);
+	dst[3] = (uint8_t)value;
+}
+
+/**
+ * @brief Get the zlib stream header deflate would write for a level and a strategy
+ * @param level [in] : zlib level
+ * @param strategy [in] : zlib strategy
+ * @returns the 2 header bytes, big endian
+ */
+static uint16_t _nyx_png_zlib_header(const int level, const int strategy)
+{
+	// deflate with a 32KB window, then the compression level hint
+	const int actual_level = (Z_DEFAULT_COMPRESSION == level) ? 6 : level;
+	uint16_t level_flags = 3;
+	if ((strategy >= Z_HUFFMAN_ONLY) || (actual_level < 2))
+		level_flags = 0;
+	else if (actual_level < 6)
+		level_flags = 1;
+	else if (6 == actual_level)
+		level_flags = 2;
+	uint16_t header = (uint16_t)((0x78 << 8) | (level_flags << 6));
+	header += 31 - (header % 31);
+	return header;
+}
@@ -0,0 +1,36 @@
+#ifndef __NYX_IMGWRITERPARALLEL_H__
+#define __NYX_IMGWRITERPARALLEL_H__
+
+#include "img_writer.h"
+#include "misc/worker_pool.h"
+
+
+/**
+ * @brief Save a bitmap object to a given path with a given type, encoded by a pool of workers
+ * PNG rows are filtered and deflated in independent blocks, the output is a standard single zlib stream
+ * JPEG strips of MCU rows are encoded independently and joined by restart markers, the output is a standard baseline JPEG
+ * TGA, progressive and optimized JPEG, whose tables cover the whole image, are written by nyx_img_write_bitmap_to_file()
+ * @param pool [in] : workers
+ * @param filepath [in] : Path to save the file to
+ * @param bm [in] : Bitmap
+ * @param type [in] : image type to save to
+ * @param output_colorspace [in] : colorspace to save the image (RGB, RGBA, gray), JPEG ignores alpha
+ * @param options [in] : {OPTIONAL} Encoding options, NULL for defaults
+ * @returns true if the bitmap was successfully written
+ */
+bool nyx_img_write_bitmap_to_file_parallel(worker_pool* pool, const char* filepath, const bitmap* bm, const img_type_t type, const colorspace_t output_colorspace, const img_write_options* options);
+
+/**
+ * @brief Encode a bitmap object in memory with a given type, encoded by a pool of workers
+ * @param pool [in] : workers
+ * @param bm [in] : Bitmap
+ * @param type [in] : image type to encode to
+ * @param output_colorspace [in] : colorspace to save the image (RGB, RGBA, gray), JPEG ignores alpha
+ * @param options [in] : {OPTIONAL} Encoding options, NULL for defaults
+ * @param out_buffer [out] : receives the encoded image, its previous content is replaced and its memory reused
+ * @returns true if the bitmap was successfully encoded
+ */
+bool nyx_img_write_to_memory_parallel(worker_pool* pool, const bitmap* bm, const img_type_t type, const colorspace_t output_colorspace, const img_write_options* options, img_buffer* out_buffer);
+
+
+#endif /* __NYX_IMGWRITERPARALLEL_H__ */
@@ -0,0 +1,199 @@
+#include "pixel_convert.h"
+#include <string.h>
+
+
+/* Bytes 1 and 3 of a 32-bit pixel loaded from memory, green and alpha for RGBA / BGRA */
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#define NYX_PX_GA_MASK 0x00FF00FFu
+#else
+#define NYX_PX_GA_MASK 0xFF00FF00u
+#endif
+
+
+static inline rgba_pixel _nyx_px_load(const uint8_t* src, const pixel_format_t format);
+static inline void _nyx_px_store(uint8_t* dst, const pixel_format_t format, const rgba_pixel pixel);
+static inline void _nyx_px_convert(const uint8_t* src, const pixel_format_t src_format, uint8_t* dst, const pixel_format_t dst_format, const size_t width, const bool opaque);
+static inline void _nyx_px_convert_from(const uint8_t* src, const pixel_format_t src_format, uint8_t* dst, const pixel_format_t dst_format, const size_t width, const bool opaque);
+static void _nyx_px_swap_red_blue(const uint8_t* src, uint8_t* dst, const size_t width);
+static void _nyx_px_convert_dispatch(const uint8_t* src, const pixel_format_t src_format, uint8_t* dst, const pixel_format_t dst_format, const size_t width, const bool opaque);
+
+
+void nyx_px_rgba_to_luma_row(const uint8_t* src, uint8_t* dst, const size_t width)
+{
+	for (size_t x = 0; x < width; x++)
+	{
+		const uint8_t lum = NYX_PX_LUMA(src[0], src[1], src[2]);
+		const uint8_t a = src[3];
+		dst[0] = dst[1] = dst[2] = lum;
+		dst[3] = a;
+		src += 4;
+		dst += 4;
+	}
+}
+
+void nyx_px_planes_to_luma_row(const uint8_t* r, const uint8_t* g, const uint8_t* b, uint8_t* dst, const size_t width)
+{
+	for (size_t x = 0; x < width; x++)
+		dst[x] = NYX_PX_LUMA(r[x], g[x], b[x]);
+}
+
+void nyx_px_convert_row(const uint8_t* src, const pixel_format_t src_format, uint8_t* dst, const pixel_format_t dst_format, const size_t width)
+{
+	_nyx_px_convert_dispatch(src, src_format, dst, dst_format, width, false);
+}
+
+void nyx_px_convert_row_opaque(const uint8_t* src, const pixel_format_t src_format, uint8_t* dst, const pixel_format_t dst_format, const size_t width)
+{
+	_nyx_px_convert_dispatch(src, src_format, dst, dst_format, width, (nyx_format_has_alpha(src_format) && !nyx_format_has_alpha(dst_format)));
+}
+
+/*** Private ***/
+static inline rgba_pixel _nyx_px_load(const uint8_t* src, const pixel_format_t format)
+{
+	rgba_pixel pixel;
+	switch (format)
+	{
+		case pixel_format_bgra32:
+			pixel = (rgba_pixel){.r = src[2], .g = src[1], .b = src[0], .a = src[3]};
+			break;
+		case pixel_format_rgb24:
+			pixel = (rgba_pixel){.r = src[0], .g = src[1], .b = src[2], .a = NYX_MAX_PIXEL_COMPONENT_VALUE};
+			break;
+		case pixel_format_bgr24:
+			pixel = (rgba_pixel){.r = src[2], .g = src[1], .b = src[0], .a = NYX_MAX_PIXEL_COMPONENT_VALUE};
+			break;
+		case pixel_format_gray8:
+			pixel = (rgba_pixel){.r = src[0], .g = src[0], .b = src[0], .a = NYX_MAX_PIXEL_COMPONENT_VALUE};
+			break;
+		case pixel_format_rgba32:
+		default:
+			pixel = (rgba_pixel){.r = src[0], .g = src[1], .b = src[2], .a = src[3]};
+			break;
+	}
+	return pixel;
+}
+
+static inline void _nyx_px_store(uint8_t* dst, const pixel_format_t format, const rgba_pixel pixel)
+{
+	switch (format)
+	{
+		case pixel_format_bgra32:
+			dst[0] = pixel.b, dst[1] = pixel.g, dst[2] = pixel.r, dst[3] = pixel.a;
+			break;
+		case pixel_format_rgb24:
+			dst[0] = pixel.r, dst[1] = pixel.g, dst[2] = pixel.b;
+			break;
+		case pixel_format_bgr24:
+			dst[0] = pixel.b, dst[1] = pixel.g, dst[2] = pixel.r;
+			break;
+		case pixel_format_gray8:
+			dst[0] = NYX_PX_LUMA(pixel.r, pixel.g, pixel.b);
+			break;
+		case pixel_format_rgba32:
+		default:
+			dst[0] = pixel.r, dst[1] = pixel.g, dst[2] = pixel.b, dst[3] = pixel.a;
+			break;
+	}
+}
+
+static inline void _nyx_px_convert(const uint8_t* src, const pixel_format_t src_format, uint8_t* dst, const pixel_format_t dst_format, const size_t width, const bool opaque)
+{
+	// formats are constants once inlined, so each pair gets its own loop
+	const size_t src_bpp = nyx_bytes_per_pixel_for_format(src_format);
+	const size_t dst_bpp = nyx_bytes_per_pixel_for_format(dst_format);
+	for (size_t x = 0; x < width; x++)
+	{
+		rgba_pixel pixel = _nyx_px_load(src, src_format);
+		if (opaque)
+		{
+			// replace the transparency by white, without a branch so the loop stays vectorizable
+			const uint8_t white = (uint8_t)-(NYX_MIN_PIXEL_COMPONENT_VALUE == pixel.a);
+			pixel.r |= white;
+			pixel.g |= white;
+			pixel.b |= white;
+		}
+		_nyx_px_store(dst, dst_format, pixel);
+		src += src_bpp;
+		dst += dst_bpp;
+	}
+}
+
+static inline void _nyx_px_convert_from(const uint8_t* src, const pixel_format_t src_format, uint8_t* dst, const pixel_format_t dst_format, const size_t width, const bool opaque)
+{
+	switch (dst_format)
+	{
+		case pixel_format_rgba32:
+			_nyx_px_convert(src, src_format, dst, pixel_format_rgba32, width, opaque);
+			break;
+		case pixel_format_bgra32:
+			_nyx_px_convert(src, src_format, dst, pixel_format_bgra32, width, opaque);
+			break;
+		case pixel_format_rgb24:
+			_nyx_px_convert(src, src_format, dst, pixel_format_rgb24, width, opaque);
+			break;
+		case pixel_format_bgr24:
+			_nyx_px_convert(src, src_format, dst, pixel_format_bgr24, width, opaque);
+			break;
+		case pixel_format_gray8:
+			_nyx_px_convert(src, src_format, dst, pixel_format_gray8, width, opaque);
+			break;
+		default:
+			break;
+	}
+}
+
+static void _nyx_px_convert_dispatch(const uint8_t* src, const pixel_format_t src_format, uint8_t* dst, const pixel_format_t dst_format, const size_t width, const bool opaque)
+{
+	if ((src_format == dst_format) && (!opaque))
+	{
+		if (src != dst)
+			memmove(dst, src, width * nyx_bytes_per_pixel_for_format(src_format));
+		return;
+	}
+
+	// RGBA <-> BGRA is a single swap, done on whole pixels
+	if (((pixel_format_rgba32 == src_format) && (pixel_format_bgra32 == dst_format)) || ((pixel_format_bgra32 == src_format) && (pixel_format_rgba32 == dst_format)))
+	{
+		_nyx_px_swap_red_blue(src, dst, width);
+		return;
+	}
+
+	switch (src_format)
+	{
+		case pixel_format_rgba32:
+			_nyx_px_convert_from(src, pixel_format_rgba32, dst, dst_format, width, opaque);
+			break;
+		case pixel_format_bgra32:
+			_nyx_px_convert_from(src, pixel_format_bgra32, dst, dst_format, width, opaque);
+			break;
+		case pixel_format_rgb24:
+			_nyx_px_convert_from(src, pixel_format_rgb24, dst, dst_format, width, false);
+			break;
+		case pixel_format_bgr24:
+			_nyx_px_convert_from(src, pixel_format_bgr24, dst, dst_format, width, false);
+			break;
+		case pixel_format_gray8:
+			_nyx_px_convert_from(src, pixel_format_gray8, dst, dst_format, width, false);
+			break;
+		default:
+			break;
+	}
+}
+
+/**
+ * @brief Swap the first and third bytes of 32-bit pixels, 4 bytes at a time
+ * @param src [in] : RGBA32 or BGRA32 row, can be dst
+ * @param dst [out] : destination row
+ * @param width [in] : number of pixels
+ */
+static void _nyx_px_swap_red_blue(const uint8_t* src, uint8_t* dst, const size_t width)
+{
+	for (size_t x = 0; x < width; x++)
+	{
+		uint32_t pixel;
+		memcpy(&pixel, src + (x * 4), sizeof(pixel));
+		const uint32_t rb = pixel & ~NYX_PX_GA_MASK;
+		pixel = (pixel & NYX_PX_GA_MASK) | (rb << 16) | (rb >> 16);
+		memcpy(dst + (x * 4), &pixel, sizeof(pixel));
+	}
+}
@@ -0,0 +1,50 @@
+#ifndef __NYX_PIXELCONVERT_H__
+#define __NYX_PIXELCONVERT_H__
+
+#include "misc/global.h"
+
+
+/* Luma of a pixel with the Rec. 709 weights in 1/256 (54, 183, 19), rounded to the nearest,
+ * they sum to 256 so gray pixels keep their value, every CPU gray conversion and filter uses it */
+#define NYX_PX_LUMA(r, g, b) ((uint8_t)(((54 * (uint32_t)(r)) + (183 * (uint32_t)(g)) + (19 * (uint32_t)(b)) + 128) >> 8))
+
+/**
+ * @brief Replace the color of a row of RGBA32 pixels by its luma (NYX_PX_LUMA()), alpha is kept
+ * @param src [in] : RGBA32 row
+ * @param dst [out] : RGBA32 row, can be src
+ * @param width [in] : number of pixels
+ */
+void nyx_px_rgba_to_luma_row(const uint8_t* src, uint8_t* dst, const size_t width);
+
+/**
+ * @brief Compute the luma (NYX_PX_LUMA()) of a row of pixels stored as red, green and blue planes
+ * @param r [in] : red plane row
+ * @param g [in] : green plane row
+ * @param b [in] : blue plane row
+ * @param dst [out] : gray row
+ * @param width [in] : number of pixels
+ */
+void nyx_px_planes_to_luma_row(const uint8_t* r, const uint8_t* g, const uint8_t* b, uint8_t* dst, const size_t width);
+
+/**
+ * @brief Convert a row of pixels from a pixel format to another, color to gray uses NYX_PX_LUMA(), gray pixels keep their value
+ * @param src [in] : source row, can be dst, or end at the same address as dst when expanding
+ * @param src_format [in] : pixel format of src
+ * @param dst [out] : destination row
+ * @param dst_format [in] : pixel format of dst
+ * @param width [in] : number of pixels
+ */
+void nyx_px_convert_row(const uint8_t* src, const pixel_format_t src_format, uint8_t* dst, const pixel_format_t dst_format, const size_t width);
+
+/**
+ * @brief Same as nyx_px_convert_row(), but fully transparent pixels become white when dst_format has no alpha channel
+ * @param src [in] : source row, can be dst, or end at the same address as dst when expanding
+ * @param src_format [in] : pixel format of src
+ * @param dst [out] : destination row
+ * @param dst_format [in] : pixel format of dst
+ * @param width [in] : number of pixels
+ */
+void nyx_px_convert_row_opaque(const uint8_t* src, const pixel_format_t src_format, uint8_t* dst, const pixel_format_t dst_format, const size_t width);
+
+
+#endif /* __NYX_PIXELCONVERT_H__ */
@@ -0,0 +1,208 @@
+#include "planar_bitmap.h"
+#include "pixel_convert.h"
+#include <stdlib.h>
+#include <string.h>
+
+
+static inline void _nyx_pbm_split_row(const uint8_t* src, const size_t bpp, const size_t r_off, const size_t b_off, uint8_t* r, uint8_t* g, uint8_t* b, uint8_t* a, const size_t width);
+static inline void _nyx_pbm_merge_row(const uint8_t* r, const uint8_t* g, const uint8_t* b, const uint8_t* a, uint8_t* dst, const size_t bpp, const size_t r_off, const size_t b_off, const size_t width);
+
+
+/*** Planar bitmap memory management ***/
+planar_bitmap* nyx_pbm_alloc(const size_t width, const size_t height, const bm_allocator* allocator)
+{
+	// alloc bitmap
+	planar_bitmap* pbm = (planar_bitmap*)malloc(sizeof(planar_bitmap));
+	if (!pbm)
+		return NULL;
+
+	// pad the rows so every row of every plane starts on an aligned address
+	if (!allocator)
+		allocator = nyx_bm_allocator_get_current();
+	const size_t stride = (width + (NYX_BM_MEM_ALIGN - 1)) & ~(size_t)(NYX_BM_MEM_ALIGN - 1);
+	const size_t plane_size = stride * height;
+	pbm->buffer = allocator->alloc_fptr(allocator->ctx, plane_size * NYX_NUM_PLANES);
+	if (!pbm->buffer)
+	{
+		free(pbm);
+		return NULL;
+	}
+
+	for (size_t i = 0; i < NYX_NUM_PLANES; i++)
+		pbm->planes[i] = (uint8_t*)pbm->buffer + (i * plane_size);
+	pbm->width = width;
+	pbm->height = height;
+	pbm->stride = stride;
+	pbm->allocator = allocator;
+
+	return pbm;
+}
+
+void nyx_pbm_destroy(planar_bitmap* pbm)
+{
+	if (pbm)
+	{
+		pbm->allocator->free_fptr(pbm->allocator->ctx, pbm->buffer, pbm->stride * pbm->height * NYX_NUM_PLANES);
+		free(pbm);
+	}
+}
+
+planar_bitmap* nyx_pbm_create_from_bitmap(const bitmap* bm)
+{
+	if (!bm)
+		return NULL;
+
+	planar_bitmap* pbm = nyx_pbm_alloc(bm->width, bm->height, bm->allocator);
+	if (!pbm)
+		return NULL;
+
+	if (!nyx_pbm_deinterleave(bm, pbm))
+	{
+		nyx_pbm_destroy(pbm);
+		return NULL;
+	}
+
+	return pbm;
+}
+
+/*** Conversions ***/
+bool nyx_pbm_deinterleave(const bitmap* bm_in, planar_bitmap* pbm_out)
+{
+	if ((!bm_in) || (!pbm_out))
+		return false;
+
+	if ((bm_in->width != pbm_out->width) || (bm_in->height != pbm_out->height))
+		return false;
+
+	const size_t width = bm_in->width;
+	for (size_t y = 0; y < bm_in->height; y++)
+	{
+		const uint8_t* src = (const uint8_t*)bm_in->buffer + (y * bm_in->stride);
+		const size_t offset = y * pbm_out->stride;
+		uint8_t* r = pbm_out->planes[plane_r] + offset;
+		uint8_t* g = pbm_out->planes[plane_g] + offset;
+		uint8_t* b = pbm_out->planes[plane_b] + offset;
+		uint8_t* a = pbm_out->planes[plane_a] + offset;
+		// constant arguments, each case gets its own fixed stride loop once inlined
+		switch (bm_in->format)
+		{
+			case pixel_format_rgba32:
+				_nyx_pbm_split_row(src, 4, 0, 2, r, g, b, a, width);
+				break;
+			case pixel_format_bgra32:
+				_nyx_pbm_split_row(src, 4, 2, 0, r, g, b, a, width);
+				break;
+			case pixel_format_rgb24:
+				_nyx_pbm_split_row(src, 3, 0, 2, r, g, b, NULL, width);
+				memset(a, NYX_MAX_PIXEL_COMPONENT_VALUE, width);
+				break;
+			case pixel_format_bgr24:
+				_nyx_pbm_split_row(src, 3, 2, 0, r, g, b, NULL, width);
+				memset(a, NYX_MAX_PIXEL_COMPONENT_VALUE, width);
+				break;
+			case pixel_format_gray8:
+				memcpy(r, src, width);
+				memcpy(g, src, width);
+				memcpy(b, src, width);
+				memset(a, NYX_MAX_PIXEL_COMPONENT_VALUE, width);
+				break;
+			default:
+				return false;
+		}
+	}
+
+	return true;
+}
+
+bool nyx_pbm_interleave(const planar_bitmap* pbm_in, bitmap* bm_out)
+{
+	if ((!pbm_in) || (!bm_out))
+		return false;
+
+	if ((pbm_in->width != bm_out->width) || (pbm_in->height != bm_out->height))
+		return false;
+
+	if (!nyx_bm_prepare_overwrite(bm_out))
+		return false;
+
+	const size_t width = pbm_in->width;
+	for (size_t y = 0; y < pbm_in->height; y++)
+	{
+		uint8_t* dst = (uint8_t*)bm_out->buffer + (y * bm_out->stride);
+		const size_t offset = y * pbm_in->stride;
+		const uint8_t* r = pbm_in->planes[plane_r] + offset;
+		const uint8_t* g = pbm_in->planes[plane_g] + offset;
+		const uint8_t* b = pbm_in->planes[plane_b] + offset;
+		const uint8_t* a = pbm_in->planes[plane_a] + offset;
+		switch (bm_out->format)
+		{
+			case pixel_format_rgba32:
+				_nyx_pbm_merge_row(r, g, b, a, dst, 4, 0, 2, width);
+				break;
+			case pixel_format_bgra32:
+				_nyx_pbm_merge_row(r, g, b, a, dst, 4, 2, 0, width);
+				break;
+			case pixel_format_rgb24:
+				_nyx_pbm_merge_row(r, g, b, NULL, dst, 3, 0, 2, width);
+				break;
+			case pixel_format_bgr24:
+				_nyx_pbm_merge_row(r, g, b, NULL, dst, 3, 2, 0, width);
+				break;
+			case pixel_format_gray8:
+				nyx_px_planes_to_luma_row(r, g, b, dst, width);
+				break;
+			default:
+				return false;
+		}
+	}
+
+	return true;
+}
+
+/*** Private ***/
+static inline void _nyx_pbm_split_row(const uint8_t* src, const size_t bpp, const size_t r_off, const size_t b_off, uint8_t* r, uint8_t* g, uint8_t* b, uint8_t* a, const size_t width)
+{
+	// strided loads to contiguous stores, the compiler turns this into shuffles
+	if (a)
+	{
+		for (size_t x = 0; x < width; x++)
+		{
+			r[x] = src[(x * bpp) + r_off];
+			g[x] = src[(x * bpp) + 1];
+			b[x] = src[(x * bpp) + b_off];
+			a[x] = src[(x * bpp) + 3];
+		}
+	}
+	else
+	{
+		for (size_t x = 0; x < width; x++)
+		{
+			r[x] = src[(x * bpp) + r_off];
+			g[x] = src[(x * bpp) + 1];
+			b[x] = src[(x * bpp) + b_off];
+		}
+	}
+}
+
+static inline void _nyx_pbm_merge_row(const uint8_t* r, const uint8_t* g, const uint8_t* b, const uint8_t* a, uint8_t* dst, const size_t bpp, const size_t r_off, const size_t b_off, const size_t width)
+{
+	if (a)
+	{
+		for (size_t x = 0; x < width; x++)
+		{
+			dst[(x * bpp) + r_off] = r[x];
+			dst[(x * bpp) + 1] = g[x];
+			dst[(x * bpp) + b_off] = b[x];
+			dst[(x * bpp) + 3] = a[x];
+		}
+	}
+	else
+	{
+		for (size_t x = 0; x < width; x++)
+		{
+			dst[(x * bpp) + r_off] = r[x];
+			dst[(x * bpp) + 1] = g[x];
+			dst[(x * bpp) + b_off] = b[x];
+		}
+	}
+}
@@ -0,0 +1,71 @@
+#ifndef __NYX_PLANARBITMAP_H__
+#define __NYX_PLANARBITMAP_H__
+
+#include "bitmap.h"
+
+
+/* Planes of a planar bitmap */
+typedef enum _nyx_plane_t {
+	plane_r = 0,
+	plane_g,
+	plane_b,
+	plane_a,
+} plane_t;
+
+#define NYX_NUM_PLANES 4
+
+/* Planar bitmap, one 8-bit plane per component */
+typedef struct _nyx_planar_bitmap_struct
+{
+	uint8_t* planes[NYX_NUM_PLANES]; // each plane is aligned on NYX_BM_MEM_ALIGN bytes
+	size_t width;
+	size_t height;
+	size_t stride; // bytes between two rows of a plane, multiple of NYX_BM_MEM_ALIGN
+	void* buffer; // single block holding the planes
+	const bm_allocator* allocator; // allocator which owns buffer
+} planar_bitmap;
+
+/*** Planar bitmap memory management ***/
+
+/**
+ * @brief Create a planar bitmap object, its planes come from a single allocation
+ * @param width [in] : bitmap width
+ * @param height [in] : bitmap height
+ * @param allocator [in] : allocator for the planes, NULL for the current thread allocator
+ * @returns the planar bitmap, NULL if memory alloc failed
+ */
+planar_bitmap* nyx_pbm_alloc(const size_t width, const size_t height, const bm_allocator* allocator);
+
+/**
+ * @brief free the planar bitmap and its planes
+ * @param pbm [in] : planar bitmap object to destroy
+ */
+void nyx_pbm_destroy(planar_bitmap* pbm);
+
+/**
+ * @brief Create a planar bitmap object from an interleaved bitmap
+ * @param bm [in] : interleaved bitmap, any pixel format
+ * @returns the planar bitmap, NULL if memory alloc failed
+ */
+planar_bitmap* nyx_pbm_create_from_bitmap(const bitmap* bm);
+
+/*** Conversions ***/
+
+/**
+ * @brief Split the pixels of an interleaved bitmap into planes, both bitmap must have the same width and height
+ * @param bm_in [in] : interleaved bitmap, formats without alpha give an opaque alpha plane, GRAY8 is copied to the color planes
+ * @param pbm_out [out] : planar bitmap
+ * @returns true if all OK
+ */
+bool nyx_pbm_deinterleave(const bitmap* bm_in, planar_bitmap* pbm_out);
+
+/**
+ * @brief Merge the planes of a planar bitmap into an interleaved bitmap, both bitmap must have the same width and height
+ * @param pbm_in [in] : planar bitmap
+ * @param bm_out [out] : interleaved bitmap, alpha is dropped when its format has none, GRAY8 receives the luma
+ * @returns true if all OK
+ */
+bool nyx_pbm_interleave(const planar_bitmap* pbm_in, bitmap* bm_out);
+
+
+#endif /* __NYX_PLANARBITMAP_H__ */
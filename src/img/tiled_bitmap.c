@@ -0,0 +1,120 @@
+#include "tiled_bitmap.h"
+#include <stdlib.h>
+#include <string.h>
+
+
+static void _nyx_tbm_copy_row(const tiled_bitmap* tbm, const size_t y, uint8_t* row, const bool to_tiles);
+
+
+/*** Tiled bitmap memory management ***/
+tiled_bitmap* nyx_tbm_alloc(const size_t width, const size_t height, const pixel_format_t format, const bm_allocator* allocator)
+{
+	const size_t bytes_per_pixel = nyx_bytes_per_pixel_for_format(format);
+	if (0 == bytes_per_pixel)
+		return NULL;
+
+	// alloc bitmap
+	tiled_bitmap* tbm = (tiled_bitmap*)malloc(sizeof(tiled_bitmap));
+	if (!tbm)
+		return NULL;
+
+	// alloc underlying buffer, whole tiles on the edges keep the addressing branch free
+	if (!allocator)
+		allocator = nyx_bm_allocator_get_current();
+	tbm->tiles_x = (width + NYX_TILE_MASK) >> NYX_TILE_SHIFT;
+	tbm->tiles_y = (height + NYX_TILE_MASK) >> NYX_TILE_SHIFT;
+	tbm->tile_stride = NYX_TILE_SIZE * NYX_TILE_SIZE * bytes_per_pixel;
+	tbm->buffer = allocator->alloc_fptr(allocator->ctx, tbm->tiles_x * tbm->tiles_y * tbm->tile_stride);
+	if (!tbm->buffer)
+	{
+		free(tbm);
+		return NULL;
+	}
+
+	tbm->width = width;
+	tbm->height = height;
+	tbm->bpp = bytes_per_pixel;
+	tbm->format = format;
+	tbm->allocator = allocator;
+
+	return tbm;
+}
+
+void nyx_tbm_destroy(tiled_bitmap* tbm)
+{
+	if (tbm)
+	{
+		tbm->allocator->free_fptr(tbm->allocator->ctx, tbm->buffer, tbm->tiles_x * tbm->tiles_y * tbm->tile_stride);
+		free(tbm);
+	}
+}
+
+tiled_bitmap* nyx_tbm_create_from_bitmap(const bitmap* bm)
+{
+	if (!bm)
+		return NULL;
+
+	tiled_bitmap* tbm = nyx_tbm_alloc(bm->width, bm->height, bm->format, bm->allocator);
+	if (!tbm)
+		return NULL;
+
+	(void)nyx_tbm_from_bitmap(bm, tbm);
+
+	return tbm;
+}
+
+/*** Conversions ***/
+bool nyx_tbm_from_bitmap(const bitmap* bm_in, tiled_bitmap* tbm_out)
+{
+	if ((!bm_in) || (!tbm_out))
+		return false;
+
+	if ((bm_in->width != tbm_out->width) || (bm_in->height != tbm_out->height) || (bm_in->format != tbm_out->format))
+		return false;
+
+	for (size_t y = 0; y < bm_in->height; y++)
+		_nyx_tbm_copy_row(tbm_out, y, (uint8_t*)bm_in->buffer + (y * bm_in->stride), true);
+
+	return true;
+}
+
+bool nyx_tbm_to_bitmap(const tiled_bitmap* tbm_in, bitmap* bm_out)
+{
+	if ((!tbm_in) || (!bm_out))
+		return false;
+
+	if ((tbm_in->width != bm_out->width) || (tbm_in->height != bm_out->height) || (tbm_in->format != bm_out->format))
+		return false;
+
+	if (!nyx_bm_prepare_overwrite(bm_out))
+		return false;
+
+	for (size_t y = 0; y < tbm_in->height; y++)
+		_nyx_tbm_copy_row(tbm_in, y, (uint8_t*)bm_out->buffer + (y * bm_out->stride), false);
+
+	return true;
+}
+
+void nyx_tbm_get_row(const tiled_bitmap* tbm, const size_t y, uint8_t* dst)
+{
+	_nyx_tbm_copy_row(tbm, y, dst, false);
+}
+
+/*** Private ***/
+static void _nyx_tbm_copy_row(const tiled_bitmap* tbm, const size_t y, uint8_t* row, const bool to_tiles)
+{
+	// a row crosses every tile of its row of tiles, one run per tile
+	const size_t run_size = NYX_TILE_SIZE * tbm->bpp;
+	size_t x = 0;
+	for (size_t tx = 0; tx < tbm->tiles_x; tx++)
+	{
+		uint8_t* tile_row = NYX_TBM_GET_PIXEL(tbm, x, y);
+		const size_t size = NYX_MIN(run_size, (tbm->width - x) * tbm->bpp);
+		if (to_tiles)
+			memcpy(tile_row, row, size);
+		else
+			memcpy(row, tile_row, size);
+		row += size;
+		x += NYX_TILE_SIZE;
+	}
+}
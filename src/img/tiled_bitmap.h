@@ -0,0 +1,83 @@
+#ifndef __NYX_TILEDBITMAP_H__
+#define __NYX_TILEDBITMAP_H__
+
+#include "bitmap.h"
+
+
+/* Tiles are NYX_TILE_SIZE x NYX_TILE_SIZE pixels */
+#define NYX_TILE_SHIFT 6
+#define NYX_TILE_SIZE ((size_t)1 << NYX_TILE_SHIFT)
+#define NYX_TILE_MASK (NYX_TILE_SIZE - 1)
+
+/* Tiled bitmap, tiles are stored contiguously in row-major order and their pixels too */
+typedef struct _nyx_tiled_bitmap_struct
+{
+	void* buffer;
+	size_t width;
+	size_t height;
+	size_t tiles_x; // number of tiles in a row of tiles
+	size_t tiles_y; // number of rows of tiles
+	size_t tile_stride; // bytes between two tiles
+	size_t bpp; // bytes per pixel
+	pixel_format_t format;
+	const bm_allocator* allocator; // allocator which owns buffer
+} tiled_bitmap;
+
+/* Address of the pixel at X,Y */
+#define NYX_TBM_GET_PIXEL(TBM, X, Y) ((uint8_t*)(TBM)->buffer + (((((Y) >> NYX_TILE_SHIFT) * (TBM)->tiles_x) + ((X) >> NYX_TILE_SHIFT)) * (TBM)->tile_stride) + (((((Y) & NYX_TILE_MASK) << NYX_TILE_SHIFT) + ((X) & NYX_TILE_MASK)) * (TBM)->bpp))
+/* Address of the first pixel of the tile at TX,TY */
+#define NYX_TBM_GET_TILE(TBM, TX, TY) ((uint8_t*)(TBM)->buffer + ((((TY) * (TBM)->tiles_x) + (TX)) * (TBM)->tile_stride))
+
+/*** Tiled bitmap memory management ***/
+
+/**
+ * @brief Create a tiled bitmap object, edge tiles are allocated whole
+ * @param width [in] : bitmap width
+ * @param height [in] : bitmap height
+ * @param format [in] : pixel format
+ * @param allocator [in] : allocator for the buffer, NULL for the current thread allocator
+ * @returns the tiled bitmap, NULL if memory alloc failed
+ */
+tiled_bitmap* nyx_tbm_alloc(const size_t width, const size_t height, const pixel_format_t format, const bm_allocator* allocator);
+
+/**
+ * @brief free the tiled bitmap and its buffer
+ * @param tbm [in] : tiled bitmap object to destroy
+ */
+void nyx_tbm_destroy(tiled_bitmap* tbm);
+
+/**
+ * @brief Create a tiled bitmap object from a linear bitmap, same pixel format
+ * @param bm [in] : linear bitmap
+ * @returns the tiled bitmap, NULL if memory alloc failed
+ */
+tiled_bitmap* nyx_tbm_create_from_bitmap(const bitmap* bm);
+
+/*** Conversions ***/
+
+/**
+ * @brief Copy a linear bitmap into a tiled bitmap, both bitmap must have the same width, height and pixel format
+ * @param bm_in [in] : linear bitmap
+ * @param tbm_out [out] : tiled bitmap
+ * @returns true if all OK
+ */
+bool nyx_tbm_from_bitmap(const bitmap* bm_in, tiled_bitmap* tbm_out);
+
+/**
+ * @brief Copy a tiled bitmap into a linear bitmap, both bitmap must have the same width, height and pixel format
+ * @param tbm_in [in] : tiled bitmap
+ * @param bm_out [out] : linear bitmap
+ * @returns true if all OK
+ */
+bool nyx_tbm_to_bitmap(const tiled_bitmap* tbm_in, bitmap* bm_out);
+
+/**
+ * @brief Gather a row of a tiled bitmap
+ * @param tbm [in] : tiled bitmap
+ * @param y [in] : row to gather
+ * @param dst [out] : row, width * bpp bytes
+ */
+void nyx_tbm_get_row(const tiled_bitmap* tbm, const size_t y, uint8_t* dst);
+
+
+#endif /* __NYX_TILEDBITMAP_H__ */
@@ -12,9 +12,40 @@ size_t nyx_num_components_for_colorspace(const colorspace_t colorspace)
 		case colorspace_rgba:
 			num_components = 4;
 			break;
+		case colorspace_gray:
+			num_components = 1;
+			break;
 		default:
 			num_components = 0;
 			break;
 	}
 	return num_components;
 }
+
+size_t nyx_bytes_per_pixel_for_format(const pixel_format_t format)
+{
+	size_t bytes_per_pixel = 0;
+	switch (format)
+	{
+		case pixel_format_rgba32:
+		case pixel_format_bgra32:
+			bytes_per_pixel = 4;
+			break;
+		case pixel_format_rgb24:
+		case pixel_format_bgr24:
+			bytes_per_pixel = 3;
+			break;
+		case pixel_format_gray8:
+			bytes_per_pixel = 1;
+			break;
+		default:
+			bytes_per_pixel = 0;
+			break;
+	}
+	return bytes_per_pixel;
+}
+
+bool nyx_format_has_alpha(const pixel_format_t format)
+{
+	return ((pixel_format_rgba32 == format) || (pixel_format_bgra32 == format));
+}
@@ -12,6 +12,20 @@
 #define NYX_USE_ALIGNED_ALLOCATIONS 1
 //#undef NYX_USE_ALIGNED_ALLOCATIONS
 
+/* Map large bitmap buffers with huge pages when available */
+#define NYX_USE_HUGE_PAGES 1
+//#undef NYX_USE_HUGE_PAGES
+/* Size from which bitmap buffers are mapped, the mapping is rounded up to a huge page */
+#define NYX_HUGE_PAGES_THRESHOLD ((size_t)4 * 1024 * 1024)
+
+/* Pin workers to NUMA nodes with libnuma (-lnuma), when its header is installed */
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<numa.h>)
+#define NYX_USE_LIBNUMA 1
+#endif
+#endif
+//#undef NYX_USE_LIBNUMA
+
 
 /* Error log macro */
 #ifdef NYX_DEBUG
@@ -44,6 +58,7 @@ typedef enum _nyx_img_type_t {
 	img_type_tga = 1,
 	img_type_jpg,
 	img_type_png,
+	img_type_qoi,
 } img_type_t;
 
 /* Color space */
@@ -51,8 +66,18 @@ typedef enum _nyx_colorspace_t {
 	colorspace_unknown = 0,
 	colorspace_rgb = 1,
 	colorspace_rgba,
+	colorspace_gray,
 } colorspace_t;
 
+/* Pixel format, memory layout of a bitmap pixel */
+typedef enum _nyx_pixel_format_t {
+	pixel_format_rgba32 = 0,
+	pixel_format_bgra32,
+	pixel_format_rgb24,
+	pixel_format_bgr24,
+	pixel_format_gray8,
+} pixel_format_t;
+
 /* Point */
 typedef struct _nyx_point_struct {
 	size_t x;
@@ -78,6 +103,20 @@ typedef struct _nyx_rect_struct {
  */
 size_t nyx_num_components_for_colorspace(const colorspace_t colorspace);
 
+/**
+ * @brief Retrieve the number of bytes of a pixel for a pixel format
+ * @param format [in] : the pixel format
+ * @returns the number of bytes per pixel for this format
+ */
+size_t nyx_bytes_per_pixel_for_format(const pixel_format_t format);
+
+/**
+ * @brief Check if a pixel format has an alpha channel
+ * @param format [in] : the pixel format
+ * @returns true if the format has an alpha channel
+ */
+bool nyx_format_has_alpha(const pixel_format_t format);
+
 
 /* Minimun value for a pixel component */
 #define NYX_MIN_PIXEL_COMPONENT_VALUE ((uint8_t)0)
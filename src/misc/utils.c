@@ -1,5 +1,19 @@
 #include "utils.h"
 #include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "global.h"
+
+
+/* Page allocations are tracked per path, which helps seeing if huge pages are really used */
+static pthread_mutex_t __page_lock = PTHREAD_MUTEX_INITIALIZER;
+static page_alloc_stats __page_stats;
+/* Size of a regular page when pre-faulting */
+#define NYX_SMALL_PAGE_SIZE 4096
 
 
 void* nyx_aligned_malloc(const size_t size, const size_t align)
@@ -26,3 +40,128 @@ void nyx_aligned_free(void* ptr)
     if (ptr)
         free(((void**)ptr)[-1]);
 }
+
+void* nyx_page_alloc(const size_t size, const bool prefault, page_alloc_path_t* out_path)
+{
+	if (0 == size)
+		return NULL;
+
+	const size_t mapped_size = (size + (NYX_HUGE_PAGE_SIZE - 1)) & ~(NYX_HUGE_PAGE_SIZE - 1);
+	page_alloc_path_t path = page_alloc_path_small;
+	uint8_t* ptr = MAP_FAILED;
+#ifdef MAP_HUGETLB
+	// explicit huge pages, only works if the admin reserved some
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB;
+#ifdef MAP_POPULATE
+	if (prefault)
+		flags |= MAP_POPULATE;
+#endif
+	ptr = (uint8_t*)mmap(NULL, mapped_size, PROT_READ | PROT_WRITE, flags, -1, 0);
+	if (ptr != MAP_FAILED)
+		path = page_alloc_path_hugetlb;
+#endif
+	if (MAP_FAILED == ptr)
+	{
+		// a huge page can only back an aligned range, map one more and trim the edges
+		uint8_t* raw = (uint8_t*)mmap(NULL, mapped_size + NYX_HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (MAP_FAILED == raw)
+		{
+			NYX_ERRLOG("[!] failed to map %zu bytes\n", mapped_size);
+			return NULL;
+		}
+		ptr = (uint8_t*)(((uintptr_t)raw + (NYX_HUGE_PAGE_SIZE - 1)) & ~(uintptr_t)(NYX_HUGE_PAGE_SIZE - 1));
+		const size_t head = (size_t)(ptr - raw);
+		if (head > 0)
+			munmap(raw, head);
+		if (head < NYX_HUGE_PAGE_SIZE)
+			munmap(ptr + mapped_size, NYX_HUGE_PAGE_SIZE - head);
+#ifdef MADV_HUGEPAGE
+		if (0 == madvise(ptr, mapped_size, MADV_HUGEPAGE))
+			path = page_alloc_path_thp;
+#endif
+		// touched after the advice so the faults get huge pages
+		if (prefault)
+		{
+			for (size_t i = 0; i < mapped_size; i += NYX_SMALL_PAGE_SIZE)
+				ptr[i] = 0;
+		}
+	}
+
+	pthread_mutex_lock(&__page_lock);
+	__page_stats.num_allocs[path]++;
+	__page_stats.bytes_allocated[path] += mapped_size;
+	__page_stats.bytes_mapped += mapped_size;
+	pthread_mutex_unlock(&__page_lock);
+	if (out_path)
+		*out_path = path;
+
+	return ptr;
+}
+
+void nyx_page_free(void* ptr, const size_t size)
+{
+	if (!ptr)
+		return;
+
+	const size_t mapped_size = (size + (NYX_HUGE_PAGE_SIZE - 1)) & ~(NYX_HUGE_PAGE_SIZE - 1);
+	munmap(ptr, mapped_size);
+	pthread_mutex_lock(&__page_lock);
+	__page_stats.num_frees++;
+	__page_stats.bytes_mapped -= mapped_size;
+	pthread_mutex_unlock(&__page_lock);
+}
+
+void nyx_page_alloc_get_stats(page_alloc_stats* out_stats)
+{
+	if (!out_stats)
+		return;
+
+	pthread_mutex_lock(&__page_lock);
+	*out_stats = __page_stats;
+	pthread_mutex_unlock(&__page_lock);
+}
+
+const void* nyx_file_map(const char* filepath, const bool sequential, size_t* out_size)
+{
+	if ((!filepath) || (!out_size))
+		return NULL;
+
+	const int fd = open(filepath, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+
+	// pipes and devices can't be mapped, empty files have nothing to map
+	struct stat st;
+	void* ptr = MAP_FAILED;
+	if ((0 == fstat(fd, &st)) && (S_ISREG(st.st_mode)) && (st.st_size > 0))
+		ptr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (MAP_FAILED == ptr)
+		return NULL;
+
+	if (sequential)
+		(void)madvise(ptr, (size_t)st.st_size, MADV_SEQUENTIAL);
+	*out_size = (size_t)st.st_size;
+	return ptr;
+}
+
+void nyx_file_unmap(const void* ptr, const size_t size)
+{
+	if (ptr)
+		munmap((void*)ptr, size);
+}
+
+const char* nyx_page_alloc_path_name(const page_alloc_path_t path)
+{
+	switch (path)
+	{
+		case page_alloc_path_hugetlb:
+			return "hugetlb";
+		case page_alloc_path_thp:
+			return "transparent huge pages";
+		case page_alloc_path_small:
+			return "regular pages";
+		default:
+			return "unknown";
+	}
+}
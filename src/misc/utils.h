@@ -2,6 +2,29 @@
 #define __NYX_UTILS_H__
 
 #include <sys/types.h>
+#include <stdbool.h>
+
+
+/* Path taken by a page allocation */
+typedef enum _nyx_page_alloc_path_t {
+	page_alloc_path_hugetlb = 0, // explicit huge pages (MAP_HUGETLB)
+	page_alloc_path_thp, // transparent huge pages (MADV_HUGEPAGE)
+	page_alloc_path_small, // regular pages, huge pages are unavailable
+} page_alloc_path_t;
+
+#define NYX_PAGE_ALLOC_NUM_PATHS 3
+
+/* Page allocations statistics */
+typedef struct _nyx_page_alloc_stats_struct
+{
+	size_t num_allocs[NYX_PAGE_ALLOC_NUM_PATHS]; // allocations which took each path
+	size_t bytes_allocated[NYX_PAGE_ALLOC_NUM_PATHS]; // bytes mapped by each path
+	size_t num_frees;
+	size_t bytes_mapped; // currently mapped, all paths
+} page_alloc_stats;
+
+/* Size of a huge page, page allocations are rounded to it */
+#define NYX_HUGE_PAGE_SIZE ((size_t)2 * 1024 * 1024)
 
 
 /**
@@ -18,5 +41,50 @@ void* nyx_aligned_malloc(const size_t size, const size_t align);
  */
 void nyx_aligned_free(void* ptr);
 
+/**
+ * @brief Map anonymous memory backed by huge pages if possible, explicit ones first, then transparent ones, then regular pages
+ * @param size [in] : Size of the allocation, rounded up to NYX_HUGE_PAGE_SIZE
+ * @param prefault [in] : map every page now instead of on first use
+ * @param out_path [out] : {OPTIONAL} path taken by the allocation
+ * @returns Pointer to allocated memory, aligned on NYX_HUGE_PAGE_SIZE, NULL if the mapping failed
+ */
+void* nyx_page_alloc(const size_t size, const bool prefault, page_alloc_path_t* out_path);
+
+/**
+ * @brief Unmap memory from nyx_page_alloc()
+ * @param ptr [in] : Memory to free
+ * @param size [in] : Size given to nyx_page_alloc()
+ */
+void nyx_page_free(void* ptr, const size_t size);
+
+/**
+ * @brief Retrieve the page allocations statistics
+ * @param out_stats [out] : statistics, per path ones are indexed by page_alloc_path_t
+ */
+void nyx_page_alloc_get_stats(page_alloc_stats* out_stats);
+
+/**
+ * @brief Get a printable name for a page allocation path
+ * @param path [in] : path
+ * @returns the name
+ */
+const char* nyx_page_alloc_path_name(const page_alloc_path_t path);
+
+/**
+ * @brief Map a whole file read-only, its pages are read on first access
+ * @param filepath [in] : Path of the file
+ * @param sequential [in] : the file is read from start to end, the kernel reads ahead more and drops the pages behind (MADV_SEQUENTIAL)
+ * @param out_size [out] : size of the file
+ * @returns the mapping, NULL if the file can't be mapped (missing, empty, not a regular file)
+ */
+const void* nyx_file_map(const char* filepath, const bool sequential, size_t* out_size);
+
+/**
+ * @brief Unmap a file mapped by nyx_file_map()
+ * @param ptr [in] : mapping
+ * @param size [in] : size of the file
+ */
+void nyx_file_unmap(const void* ptr, const size_t size);
+
 
 #endif /* __NYX_UTILS_H__ */
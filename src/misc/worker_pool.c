@@ -0,0 +1,253 @@
+#include "worker_pool.h"
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#ifdef NYX_USE_LIBNUMA
+#include <numa.h>
+#endif
+
+
+/* Worker thread */
+typedef struct _nyx_worker_struct
+{
+	worker_pool* pool;
+	pthread_t thread;
+	size_t index;
+	int node; // NUMA node the worker is pinned to
+	atomic_size_t next; // next task of the worker range, shared with the stealers
+	size_t end; // task after the last one of the worker range
+} pool_worker;
+
+/* Pool of worker threads */
+struct _nyx_worker_pool_struct
+{
+	pthread_mutex_t lock;
+	pthread_cond_t job_cond; // a job was posted, or the pool is stopping
+	pthread_cond_t done_cond; // all workers finished the job
+	pool_worker* workers;
+	size_t num_workers;
+	size_t num_started;
+	bool numa; // workers are pinned
+	// current job
+	worker_task_fptr task;
+	void* ctx;
+	size_t generation; // incremented for each job
+	size_t num_busy; // workers still working on the job
+	bool stop;
+};
+
+static void* _nyx_worker_main(void* arg);
+static void _nyx_worker_drain(pool_worker* w, pool_worker* victim);
+static size_t _nyx_worker_pool_get_nodes(int** out_nodes);
+
+
+worker_pool* nyx_worker_pool_create(const size_t num_workers)
+{
+	worker_pool* pool = (worker_pool*)calloc(1, sizeof(worker_pool));
+	if (!pool)
+		return NULL;
+
+	pool->num_workers = (num_workers > 0) ? num_workers : (size_t)NYX_MAX(1, sysconf(_SC_NPROCESSORS_ONLN));
+	pool->workers = (pool_worker*)calloc(pool->num_workers, sizeof(pool_worker));
+	int* nodes = NULL;
+	const size_t num_nodes = _nyx_worker_pool_get_nodes(&nodes);
+	if ((!pool->workers) || (0 == num_nodes))
+	{
+		free(nodes);
+		free(pool->workers);
+		free(pool);
+		return NULL;
+	}
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->job_cond, NULL);
+	pthread_cond_init(&pool->done_cond, NULL);
+	pool->numa = (num_nodes > 1);
+
+	// contiguous groups of workers per node, so neighbouring tasks stay on the same node
+	for (size_t i = 0; i < pool->num_workers; i++)
+	{
+		pool_worker* w = &pool->workers[i];
+		w->pool = pool;
+		w->index = i;
+		w->node = nodes[(i * num_nodes) / pool->num_workers];
+		atomic_init(&w->next, 0);
+		if (pthread_create(&w->thread, NULL, _nyx_worker_main, w) != 0)
+		{
+			NYX_ERRLOG("[!] failed to start worker %zu\n", i);
+			break;
+		}
+		pool->num_started++;
+	}
+	free(nodes);
+
+	if (pool->num_started != pool->num_workers)
+	{
+		nyx_worker_pool_destroy(pool);
+		return NULL;
+	}
+	NYX_DLOG("[+] worker pool : %zu workers on %zu node%s\n", pool->num_workers, num_nodes, (num_nodes > 1) ? "s" : "");
+
+	return pool;
+}
+
+void nyx_worker_pool_destroy(worker_pool* pool)
+{
+	if (!pool)
+		return;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->stop = true;
+	pthread_cond_broadcast(&pool->job_cond);
+	pthread_mutex_unlock(&pool->lock);
+	for (size_t i = 0; i < pool->num_started; i++)
+		pthread_join(pool->workers[i].thread, NULL);
+
+	pthread_cond_destroy(&pool->done_cond);
+	pthread_cond_destroy(&pool->job_cond);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool->workers);
+	free(pool);
+}
+
+bool nyx_worker_pool_run(worker_pool* pool, const size_t num_tasks, worker_task_fptr task, void* ctx)
+{
+	if ((!pool) || (!task))
+		return false;
+
+	if (0 == num_tasks)
+		return true;
+
+	pthread_mutex_lock(&pool->lock);
+	// static mapping, the same task index goes to the same worker from one job to the next
+	for (size_t i = 0; i < pool->num_workers; i++)
+	{
+		pool_worker* w = &pool->workers[i];
+		atomic_store(&w->next, (i * num_tasks) / pool->num_workers);
+		w->end = ((i + 1) * num_tasks) / pool->num_workers;
+	}
+	pool->task = task;
+	pool->ctx = ctx;
+	pool->num_busy = pool->num_workers;
+	pool->generation++;
+	pthread_cond_broadcast(&pool->job_cond);
+	while (pool->num_busy > 0)
+		pthread_cond_wait(&pool->done_cond, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+
+	return true;
+}
+
+size_t nyx_worker_pool_get_num_workers(const worker_pool* pool)
+{
+	return (pool != NULL) ? pool->num_workers : 0;
+}
+
+int nyx_worker_pool_get_worker_node(const worker_pool* pool, const size_t worker)
+{
+	if ((!pool) || (worker >= pool->num_workers))
+		return 0;
+	return pool->workers[worker].node;
+}
+
+size_t nyx_worker_pool_get_task_owner(const worker_pool* pool, const size_t num_tasks, const size_t task)
+{
+	if ((!pool) || (0 == num_tasks))
+		return 0;
+	// inverse of the range split in nyx_worker_pool_run(), the last worker whose range starts at or before task
+	return (((task + 1) * pool->num_workers) - 1) / num_tasks;
+}
+
+/*** Private ***/
+static void* _nyx_worker_main(void* arg)
+{
+	pool_worker* w = (pool_worker*)arg;
+	worker_pool* pool = w->pool;
+#ifdef NYX_USE_LIBNUMA
+	if (pool->numa)
+	{
+		// run on the node CPUs and allocate from its memory
+		numa_run_on_node(w->node);
+		numa_set_localalloc();
+	}
+#endif
+
+	size_t generation = 0;
+	for (;;)
+	{
+		pthread_mutex_lock(&pool->lock);
+		while ((!pool->stop) && (generation == pool->generation))
+			pthread_cond_wait(&pool->job_cond, &pool->lock);
+		if (pool->stop)
+		{
+			pthread_mutex_unlock(&pool->lock);
+			break;
+		}
+		generation = pool->generation;
+		pthread_mutex_unlock(&pool->lock);
+
+		// own tasks first, then help the workers of the same node
+		_nyx_worker_drain(w, w);
+		for (size_t i = 1; i < pool->num_workers; i++)
+		{
+			pool_worker* victim = &pool->workers[(w->index + i) % pool->num_workers];
+			if (victim->node == w->node)
+				_nyx_worker_drain(w, victim);
+		}
+
+		pthread_mutex_lock(&pool->lock);
+		if (0 == --pool->num_busy)
+			pthread_cond_signal(&pool->done_cond);
+		pthread_mutex_unlock(&pool->lock);
+	}
+
+	return NULL;
+}
+
+static void _nyx_worker_drain(pool_worker* w, pool_worker* victim)
+{
+	worker_pool* pool = w->pool;
+	size_t task;
+	while ((task = atomic_fetch_add(&victim->next, 1)) < victim->end)
+		pool->task(pool->ctx, task, w->index);
+}
+
+/**
+ * @brief Get the NUMA nodes which have CPUs
+ * @param out_nodes [out] : nodes, to free
+ * @returns number of nodes, 1 (node 0) without NUMA support, 0 if memory alloc failed
+ */
+static size_t _nyx_worker_pool_get_nodes(int** out_nodes)
+{
+	size_t num_nodes = 0;
+#ifdef NYX_USE_LIBNUMA
+	if (numa_available() >= 0)
+	{
+		const int max_node = numa_max_node();
+		int* nodes = (int*)malloc(sizeof(int) * (size_t)(max_node + 1));
+		struct bitmask* cpus = numa_allocate_cpumask();
+		if ((!nodes) || (!cpus))
+		{
+			free(nodes);
+			if (cpus) numa_free_cpumask(cpus);
+			return 0;
+		}
+		for (int node = 0; node <= max_node; node++)
+		{
+			if ((0 == numa_node_to_cpus(node, cpus)) && (numa_bitmask_weight(cpus) > 0))
+				nodes[num_nodes++] = node;
+		}
+		numa_free_cpumask(cpus);
+		if (num_nodes > 0)
+		{
+			*out_nodes = nodes;
+			return num_nodes;
+		}
+		free(nodes);
+	}
+#endif
+	// no NUMA, everything on node 0
+	*out_nodes = (int*)calloc(1, sizeof(int));
+	num_nodes = (*out_nodes != NULL) ? 1 : 0;
+	return num_nodes;
+}
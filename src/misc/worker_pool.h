@@ -0,0 +1,61 @@
+#ifndef __NYX_WORKERPOOL_H__
+#define __NYX_WORKERPOOL_H__
+
+#include "global.h"
+
+
+/* Pool of worker threads, pinned to NUMA nodes */
+typedef struct _nyx_worker_pool_struct worker_pool;
+
+/* Task of a job, called once per task index */
+typedef void (*worker_task_fptr)(void* ctx, const size_t task, const size_t worker);
+
+/**
+ * @brief Create a pool of workers, spread in contiguous groups over the NUMA nodes which have CPUs and pinned to them
+ * @param num_workers [in] : number of workers, 0 for one per online CPU
+ * @returns the pool, NULL if something failed
+ */
+worker_pool* nyx_worker_pool_create(const size_t num_workers);
+
+/**
+ * @brief Stop the workers and destroy the pool
+ * @param pool [in] : pool to destroy
+ */
+void nyx_worker_pool_destroy(worker_pool* pool);
+
+/**
+ * @brief Run a job and wait for its completion, a given task index always goes to the same worker first, idle workers only steal tasks of workers on their node
+ * @param pool [in] : pool
+ * @param num_tasks [in] : number of tasks of the job
+ * @param task [in] : function called for each task
+ * @param ctx [in] : {OPTIONAL} context given to task
+ * @returns true if all OK
+ */
+bool nyx_worker_pool_run(worker_pool* pool, const size_t num_tasks, worker_task_fptr task, void* ctx);
+
+/**
+ * @brief Get the number of workers of a pool
+ * @param pool [in] : pool
+ * @returns the number of workers
+ */
+size_t nyx_worker_pool_get_num_workers(const worker_pool* pool);
+
+/**
+ * @brief Get the NUMA node a worker is pinned to
+ * @param pool [in] : pool
+ * @param worker [in] : worker index
+ * @returns the node, 0 without NUMA support
+ */
+int nyx_worker_pool_get_worker_node(const worker_pool* pool, const size_t worker);
+
+/**
+ * @brief Get the worker which owns a task of a job, that's where its memory should be first touched
+ * @param pool [in] : pool
+ * @param num_tasks [in] : number of tasks of the job
+ * @param task [in] : task index
+ * @returns the worker index
+ */
+size_t nyx_worker_pool_get_task_owner(const worker_pool* pool, const size_t num_tasks, const size_t task);
+
+
+#endif /* __NYX_WORKERPOOL_H__ */
@@ -69,9 +69,9 @@ int main(int argc, const char* argv[])
 	end = clock();
 	fprintf(stdout, "[+] Time: %fs (%d)\n", ((double)(end - begin) / CLOCKS_PER_SEC), (int)ok);
 	
-	//nyx_img_write_bitmap_to_file("/Users/nyxouf/Desktop/_out1.png", bm_out, img_type_png, colorspace_rgba);
-	//nyx_img_write_bitmap_to_file("/Users/nyxouf/Desktop/_out1.jpg", bm_out, img_type_jpg, colorspace_rgb);
-	nyx_img_write_bitmap_to_file("/Users/nyxouf/Desktop/_out1.tga", bm_out, img_type_tga, colorspace_rgba);
+	//nyx_img_write_bitmap_to_file("/Users/nyxouf/Desktop/_out1.png", bm_out, img_type_png, colorspace_rgba, NULL);
+	//nyx_img_write_bitmap_to_file("/Users/nyxouf/Desktop/_out1.jpg", bm_out, img_type_jpg, colorspace_rgb, NULL);
+	nyx_img_write_bitmap_to_file("/Users/nyxouf/Desktop/_out1.tga", bm_out, img_type_tga, colorspace_rgba, NULL);
 
 out:
 	nyx_bm_destroy(bm_out);